@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Headless micro-benchmarks for the shape and pose paths of util_rviz.
+ * Ogre runs headless like in the unit tests (see test/headless_ogre.hpp), nothing is rendered. Every benchmark is run
+ * once to warm up and then repeated, the median of the repetitions is written to stdout as JSON.
+ *
+ * Usage: util_rviz_benchmark [--repetitions N] [number of agents ...]
+ *        (defaults: 5 repetitions of 1000 10000 50000 agents)
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreSceneManager.h>
+#include <ros/ros.h>
+
+#include "util_rviz/util_rviz.hpp"
+#include "util_rviz/util_rvizshapes.hpp"
+#include "../test/headless_ogre.hpp"
+
+namespace {
+
+struct Result {
+    std::string name;
+    size_t agents;
+    std::vector<double> seconds;
+};
+
+std::vector<Result> results;
+bool recording = false;
+
+// Times f and adds the time to the samples of this benchmark, nothing is recorded during the warm-up run
+void measure(const std::string& name, size_t agents, const std::function<void()>& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (!recording) {
+        return;
+    }
+    auto it = std::find_if(
+        results.begin(), results.end(), [&](const Result& r) { return r.name == name && r.agents == agents; });
+    if (it == results.end()) {
+        results.push_back(Result{name, agents, {}});
+        it = std::prev(results.end());
+    }
+    it->seconds.push_back(elapsed.count());
+}
+
+double median(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    const size_t half = samples.size() / 2;
+    return samples.size() % 2 ? samples[half] : (samples[half - 1] + samples[half]) / 2;
+}
+
+void printJson(std::ostream& out) {
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        const double seconds = median(r.seconds);
+        out << "    {\"name\": \"" << r.name << "\", \"agents\": " << r.agents
+            << ", \"repetitions\": " << r.seconds.size() << ", \"seconds\": " << seconds
+            << ", \"min_seconds\": " << *std::min_element(r.seconds.begin(), r.seconds.end())
+            << ", \"ns_per_agent\": " << seconds * 1e9 / r.agents << "}" << (i + 1 < results.size() ? "," : "")
+            << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+template <typename T>
+void benchmarkArchetype(Ogre::SceneManager* scene_manager, const std::string& name, size_t n, bool baked) {
+    const std::string prefix = name + (baked ? "_baked" : "");
+    std::vector<std::unique_ptr<T>> objects;
+    objects.reserve(n);
+    measure(prefix + "/construct", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            objects.emplace_back(new T(scene_manager, NULL, baked));
+        }
+    });
+
+    measure(prefix + "/setPosition", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            objects[i]->setPosition(Ogre::Vector3(i, 1.0, 0.0));
+        }
+    });
+    measure(prefix + "/setOrientation", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            objects[i]->setOrientation(Ogre::Quaternion(Ogre::Radian(i * 0.01), Ogre::Vector3::UNIT_Z));
+        }
+    });
+    measure(prefix + "/setColor", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            objects[i]->setColor(Ogre::ColourValue(i % 256 / 255.f, 0.5f, 0.5f, 1.f));
+        }
+    });
+    measure(prefix + "/setColorUnchanged", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            objects[i]->setColor(Ogre::ColourValue(i % 256 / 255.f, 0.5f, 0.5f, 1.f));
+        }
+    });
+
+    size_t count = 0;
+    measure(prefix + "/getEntities", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            count += objects[i]->getEntities().size();
+        }
+    });
+    measure(prefix + "/getMaterials", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            count += objects[i]->getMaterials().size();
+        }
+    });
+    measure(prefix + "/forEachEntity", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            objects[i]->forEachEntity([&count](Ogre::Entity*) { ++count; });
+        }
+    });
+    if (count == std::numeric_limits<size_t>::max()) {
+        std::cerr << count;
+    }
+
+    measure(prefix + "/destruct", n, [&] { objects.clear(); });
+}
+
+void benchmarkColorPartly(Ogre::SceneManager* scene_manager, size_t n, bool baked) {
+    std::vector<std::unique_ptr<rviz::SimpleCar>> cars;
+    for (size_t i = 0; i < n; ++i) {
+        cars.emplace_back(new rviz::SimpleCar(scene_manager, NULL, baked));
+    }
+    measure(std::string("SimpleCar") + (baked ? "_baked" : "") + "/setColorPartly", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            cars[i]->setColorPartly(Ogre::ColourValue(0.5f, i % 256 / 255.f, 0.5f, 1.f));
+        }
+    });
+}
+
+void benchmarkSafeSetters(Ogre::SceneManager* scene_manager, size_t n) {
+    std::vector<Ogre::SceneNode*> nodes;
+    for (size_t i = 0; i < n; ++i) {
+        nodes.push_back(scene_manager->getRootSceneNode()->createChildSceneNode());
+    }
+    const Ogre::Vector3 nan(std::numeric_limits<float>::quiet_NaN(), 0.0, 0.0);
+    measure("setPositionSafely/valid", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            util_rviz::setPositionSafely(nodes[i], Ogre::Vector3(i, 0.0, 0.0));
+        }
+    });
+    measure("setPositionSafely/nan", n, [&] {
+        for (size_t i = 0; i < n; ++i) {
+            util_rviz::setPositionSafely(nodes[i], nan);
+        }
+    });
+
+    std::vector<Ogre::Vector3> positions(n, Ogre::Vector3(1.0, 2.0, 3.0));
+    std::vector<Ogre::Quaternion> orientations(n, Ogre::Quaternion::IDENTITY);
+    measure("setPosesSafely/valid", n, [&] { util_rviz::setPosesSafely(nodes, positions, orientations); });
+
+    for (auto node : nodes) {
+        scene_manager->destroySceneNode(node);
+    }
+}
+
+void runAll(Ogre::SceneManager* scene_manager, size_t n) {
+    for (bool baked : {false, true}) {
+        benchmarkArchetype<rviz::SimpleCar>(scene_manager, "SimpleCar", n, baked);
+        benchmarkArchetype<rviz::SimpleBike>(scene_manager, "SimpleBike", n, baked);
+        benchmarkArchetype<rviz::SimplePedestrian>(scene_manager, "SimplePedestrian", n, baked);
+        benchmarkArchetype<rviz::SimpleUnknown>(scene_manager, "SimpleUnknown", n, baked);
+        benchmarkColorPartly(scene_manager, n, baked);
+    }
+    benchmarkSafeSetters(scene_manager, n);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t repetitions = 5;
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--repetitions" && i + 1 < argc) {
+            repetitions = std::max<size_t>(1, std::strtoul(argv[++i], NULL, 10));
+        } else {
+            sizes.push_back(std::strtoul(argv[i], NULL, 10));
+        }
+    }
+    if (sizes.empty()) {
+        sizes = {1000, 10000, 50000};
+    }
+
+    ros::Time::init();
+    Ogre::Root root("", "", "util_rviz_benchmark.log");
+    Ogre::SceneManager* scene_manager = util_rviz_test::createHeadlessSceneManager(root);
+
+    for (size_t n : sizes) {
+        recording = false;
+        runAll(scene_manager, n);
+        recording = true;
+        for (size_t i = 0; i < repetitions; ++i) {
+            runAll(scene_manager, n);
+        }
+    }
+
+    printJson(std::cout);
+    return 0;
+}
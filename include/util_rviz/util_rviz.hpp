@@ -30,7 +30,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
@@ -40,6 +48,12 @@
 #include <OGRE/OgreVector3.h>
 #include <ros/ros.h>
 
+#include "util_rvizstats.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 namespace {
 /* Type Traits for Pointer Like types. Covering Raw Pointers, std-smart pointers and boost smart pointers */
@@ -79,51 +93,82 @@ template <class T>
 struct is_pointer_type : is_pointer_type_helper<typename std::remove_cv<T>::type> {};
 
 /* Helper Functions to Handle Reference, Pointer and SmartPointer Types in the Templates
- * Returns a pointer like type
+ * Returns a raw pointer, or a locked std/boost::shared_ptr for weak pointers
  * Covering Raw Pointers, std smart pointers and boost smart pointers
+ * Handles are taken by reference and never copied, which would cost two atomic reference count operations
  */
 // Reference into Pointer
-template <typename T>
-T* ptr(T& obj) {
-    return &obj;
-}
+template <class T>
+struct pointer_access {
+    template <class U>
+    static U* get(U& obj) {
+        return &obj;
+    }
+};
 // Object is already Pointer
-template <typename T>
-T* ptr(T* obj) {
-    return obj;
-}
+template <class T>
+struct pointer_access<T*> {
+    static T* get(T* obj) {
+        return obj;
+    }
+};
 // Object is already (smart) Pointer
-template <typename T>
-std::shared_ptr<T> ptr(std::shared_ptr<T> obj) {
-    return obj;
-}
+template <class T>
+struct pointer_access<std::shared_ptr<T>> {
+    static T* get(const std::shared_ptr<T>& obj) {
+        return obj.get();
+    }
+};
 // Object is already (smart) Pointer
-template <typename T>
-std::unique_ptr<T> ptr(std::unique_ptr<T> obj) {
-    return obj;
-}
+template <class T>
+struct pointer_access<std::unique_ptr<T>> {
+    static T* get(const std::unique_ptr<T>& obj) {
+        return obj.get();
+    }
+};
+// Weak Pointer has to be locked for the call
+template <class T>
+struct pointer_access<std::weak_ptr<T>> {
+    static std::shared_ptr<T> get(const std::weak_ptr<T>& obj) {
+        return obj.lock();
+    }
+};
 // Object is already (smart) Pointer
-template <typename T>
-std::weak_ptr<T> ptr(std::weak_ptr<T> obj) {
-    return obj;
-}
+template <class T>
+struct pointer_access<boost::shared_ptr<T>> {
+    static T* get(const boost::shared_ptr<T>& obj) {
+        return obj.get();
+    }
+};
 // Object is already (smart) Pointer
-template <typename T>
-boost::shared_ptr<T> ptr(boost::shared_ptr<T> obj) {
-    return obj;
-} // Object is already (smart) Pointer
-template <typename T>
-boost::scoped_ptr<T> ptr(boost::scoped_ptr<T> obj) {
-    return obj;
-}
+template <class T>
+struct pointer_access<boost::scoped_ptr<T>> {
+    static T* get(const boost::scoped_ptr<T>& obj) {
+        return obj.get();
+    }
+};
+// Weak Pointer has to be locked for the call
+template <class T>
+struct pointer_access<boost::weak_ptr<T>> {
+    static boost::shared_ptr<T> get(const boost::weak_ptr<T>& obj) {
+        return obj.lock();
+    }
+};
 // Object is already (smart) Pointer
+template <class T>
+struct pointer_access<boost::intrusive_ptr<T>> {
+    static T* get(const boost::intrusive_ptr<T>& obj) {
+        return obj.get();
+    }
+};
+
 template <typename T>
-boost::weak_ptr<T> ptr(boost::weak_ptr<T> obj) {
-    return obj;
+auto ptr(T& obj) -> decltype(pointer_access<typename std::remove_cv<T>::type>::get(obj)) {
+    return pointer_access<typename std::remove_cv<T>::type>::get(obj);
 }
-// Object is already (smart) Pointer
+// Temporary raw Pointer
 template <typename T>
-boost::intrusive_ptr<T> ptr(boost::intrusive_ptr<T> obj) {
+T* ptr(T* obj) {
     return obj;
 }
 } // end namespace
@@ -131,30 +176,407 @@ boost::intrusive_ptr<T> ptr(boost::intrusive_ptr<T> obj) {
 
 namespace util_rviz {
 
-template <typename T>
-void setPositionSafely(T& settableObject, const Ogre::Vector3& position) {
-    if (ptr(settableObject) && !position.isNaN()) {
-        ptr(settableObject)->setPosition(position);
-    } else {
-        if (position.isNaN()) {
+namespace validation {
+
+enum class Quantity { Position, Orientation, Scale };
+enum class Rejection { Null, NotFinite };
+
+inline const char* name(Quantity quantity) {
+    switch (quantity) {
+    case Quantity::Position:
+        return "position";
+    case Quantity::Orientation:
+        return "orientation";
+    default:
+        return "scale";
+    }
+}
+
+inline void count(Quantity quantity, Rejection rejection) {
+    static const stats::Counter counters[3][2] = {{stats::PositionRejectedNull, stats::PositionRejectedNonFinite},
+                                                  {stats::OrientationRejectedNull, stats::OrientationRejectedNonFinite},
+                                                  {stats::ScaleRejectedNull, stats::ScaleRejectedNonFinite}};
+    stats::add(counters[int(quantity)][int(rejection)]);
+}
+
+/*
+ * Validation policies for the set...Safely() functions. A policy provides
+ * - count: Whether applied and rejected updates are counted in util_rviz::stats.
+ * - partial: Whether the valid parts of an update are applied if other parts are invalid (e.g. the position of a
+ *   pose with NaN orientation). Otherwise the whole update is rejected.
+ * - rejected(quantity, rejection): Called once per update if the object is NULL, with the first quantity of the update.
+ * - invalid(value, quantity): Called if a value is not finite. May correct the value and return true to apply it.
+ */
+
+/** \brief Reject invalid updates silently, without counting. */
+struct Skip {
+    static constexpr bool count = false;
+    static constexpr bool partial = false;
+    static void rejected(Quantity, Rejection) {
+    }
+    template <typename V>
+    static bool invalid(V&, Quantity) {
+        return false;
+    }
+};
+
+/** \brief Reject and count invalid updates. */
+struct CountOnly {
+    static constexpr bool count = true;
+    static constexpr bool partial = false;
+    static void rejected(Quantity quantity, Rejection rejection) {
+        validation::count(quantity, rejection);
+    }
+    template <typename V>
+    static bool invalid(V&, Quantity quantity) {
+        validation::count(quantity, Rejection::NotFinite);
+        return false;
+    }
+};
+
+/** \brief Reject and count invalid updates and log them, at most once per second. This is the default. */
+struct LogThrottled : CountOnly {
+    static void rejected(Quantity quantity, Rejection rejection) {
+        CountOnly::rejected(quantity, rejection);
+        switch (quantity) {
+        case Quantity::Position:
+            ROS_ERROR_THROTTLE(1, "Could not set position. Object is NULL.");
+            break;
+        case Quantity::Orientation:
+            ROS_ERROR_THROTTLE(1, "Could not set orientation. Object is NULL.");
+            break;
+        case Quantity::Scale:
+            ROS_ERROR_THROTTLE(1, "Could not set scale. Object is NULL.");
+            break;
+        }
+    }
+    template <typename V>
+    static bool invalid(V& value, Quantity quantity) {
+        CountOnly::invalid(value, quantity);
+        switch (quantity) {
+        case Quantity::Position:
             ROS_ERROR_THROTTLE(1, "Could not set position. Position is not valid (NAN).");
-        } else {
-            ROS_ERROR_THROTTLE(1, "Could not set position.");
+            break;
+        case Quantity::Orientation:
+            ROS_ERROR_THROTTLE(1, "Could not set orientation. Orientation is not valid (NAN).");
+            break;
+        case Quantity::Scale:
+            ROS_ERROR_THROTTLE(1, "Could not set scale. Scale is not valid (NAN).");
+            break;
+        }
+        return false;
+    }
+};
+
+/** \brief Apply the valid parts of an update, the object keeps the last valid value of the others. */
+struct LastValid : CountOnly {
+    static constexpr bool partial = true;
+};
+
+/**
+ * \brief Replace NaN components by the neutral value (zero position, unit scale, identity orientation) and infinite
+ * components by +-limit(). Invalid values are counted, but applied.
+ */
+struct Clamp : CountOnly {
+    static constexpr bool partial = true;
+    static float limit() {
+        return 1e6f;
+    }
+    static bool invalid(Ogre::Vector3& value, Quantity quantity) {
+        CountOnly::invalid(value, quantity);
+        const float neutral = quantity == Quantity::Scale ? 1.f : 0.f;
+        for (size_t i = 0; i < 3; ++i) {
+            value[i] = std::isnan(value[i]) ? neutral : std::max(-limit(), std::min(limit(), value[i]));
         }
+        return true;
     }
+    static bool invalid(Ogre::Quaternion& value, Quantity quantity) {
+        CountOnly::invalid(value, quantity);
+        value = Ogre::Quaternion::IDENTITY;
+        return true;
+    }
+};
+
+/** \brief Throw std::invalid_argument on invalid updates, after counting them. */
+struct Throw : CountOnly {
+    static void rejected(Quantity quantity, Rejection rejection) {
+        CountOnly::rejected(quantity, rejection);
+        throw std::invalid_argument(std::string("Could not set ") + name(quantity) + ". Object is NULL.");
+    }
+    template <typename V>
+    static bool invalid(V& value, Quantity quantity) {
+        CountOnly::invalid(value, quantity);
+        throw std::invalid_argument(std::string("Could not set ") + name(quantity) + ". Value is not finite.");
+    }
+};
+
+// A NULL object rejects every quantity of an update. All of them are counted, but only the first is reported.
+template <typename Policy>
+void rejectedNull(std::initializer_list<Quantity> quantities) {
+    if (Policy::count) {
+        for (auto it = quantities.begin() + 1; it != quantities.end(); ++it) {
+            count(*it, Rejection::Null);
+        }
+    }
+    Policy::rejected(*quantities.begin(), Rejection::Null);
+}
+
+inline bool isFinite(const Ogre::Vector3& v) {
+    return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+inline bool isFinite(const Ogre::Quaternion& q) {
+    return std::isfinite(q.w) && std::isfinite(q.x) && std::isfinite(q.y) && std::isfinite(q.z);
+}
+
+// Returns whether the (possibly corrected) value shall be applied
+template <typename Policy, typename V>
+bool check(V& value, Quantity quantity) {
+    return isFinite(value) || Policy::invalid(value, quantity);
+}
+
+template <typename Policy>
+void applied(Quantity quantity) {
+    static const stats::Counter counters[3] = {
+        stats::PositionApplied, stats::OrientationApplied, stats::ScaleApplied};
+    if (Policy::count) {
+        stats::add(counters[int(quantity)]);
+    }
+}
+
+} // namespace validation
+
+/**
+ * \brief Set the position of a (pointer to an) object, if both are valid.
+ * What happens with invalid values is defined by the Policy, see util_rviz::validation.
+ *
+ * @return Whether the position was set.
+ */
+template <typename Policy = validation::LogThrottled, typename T>
+bool setPositionSafely(T& settableObject, Ogre::Vector3 position) {
+    using validation::Quantity;
+    auto obj = ptr(settableObject);
+    if (!obj) {
+        Policy::rejected(Quantity::Position, validation::Rejection::Null);
+        return false;
+    }
+    if (!validation::check<Policy>(position, Quantity::Position)) {
+        return false;
+    }
+    obj->setPosition(position);
+    validation::applied<Policy>(Quantity::Position);
+    return true;
+}
+
+/**
+ * \brief Set the orientation of a (pointer to an) object, see setPositionSafely().
+ */
+template <typename Policy = validation::LogThrottled, typename T>
+bool setOrientationSafely(T& settableObject, Ogre::Quaternion orientation) {
+    using validation::Quantity;
+    auto obj = ptr(settableObject);
+    if (!obj) {
+        Policy::rejected(Quantity::Orientation, validation::Rejection::Null);
+        return false;
+    }
+    if (!validation::check<Policy>(orientation, Quantity::Orientation)) {
+        return false;
+    }
+    obj->setOrientation(orientation);
+    validation::applied<Policy>(Quantity::Orientation);
+    return true;
+}
+
+/**
+ * \brief Set the scale of a (pointer to an) object, see setPositionSafely().
+ */
+template <typename Policy = validation::LogThrottled, typename T>
+bool setScaleSafely(T& settableObject, Ogre::Vector3 scale) {
+    using validation::Quantity;
+    auto obj = ptr(settableObject);
+    if (!obj) {
+        Policy::rejected(Quantity::Scale, validation::Rejection::Null);
+        return false;
+    }
+    if (!validation::check<Policy>(scale, Quantity::Scale)) {
+        return false;
+    }
+    obj->setScale(scale);
+    validation::applied<Policy>(Quantity::Scale);
+    return true;
+}
+
+/**
+ * \brief Set position and orientation of a (pointer to an) object at once.
+ * Unless the Policy allows partial updates, nothing is set if one of the values is invalid.
+ *
+ * @return Whether both values were set.
+ */
+template <typename Policy = validation::LogThrottled, typename T>
+bool setPoseSafely(T& settableObject, Ogre::Vector3 position, Ogre::Quaternion orientation) {
+    using validation::Quantity;
+    auto obj = ptr(settableObject);
+    if (!obj) {
+        validation::rejectedNull<Policy>({Quantity::Position, Quantity::Orientation});
+        return false;
+    }
+    const bool positionValid = validation::check<Policy>(position, Quantity::Position);
+    const bool orientationValid = validation::check<Policy>(orientation, Quantity::Orientation);
+    if (!Policy::partial && !(positionValid && orientationValid)) {
+        return false;
+    }
+    if (positionValid) {
+        obj->setPosition(position);
+        validation::applied<Policy>(Quantity::Position);
+    }
+    if (orientationValid) {
+        obj->setOrientation(orientation);
+        validation::applied<Policy>(Quantity::Orientation);
+    }
+    return positionValid && orientationValid;
+}
+
+/**
+ * \brief Set position, orientation and scale of a (pointer to an) object at once, see setPoseSafely().
+ */
+template <typename Policy = validation::LogThrottled, typename T>
+bool setTransformSafely(T& settableObject,
+                        Ogre::Vector3 position,
+                        Ogre::Quaternion orientation,
+                        Ogre::Vector3 scale) {
+    using validation::Quantity;
+    auto obj = ptr(settableObject);
+    if (!obj) {
+        validation::rejectedNull<Policy>({Quantity::Position, Quantity::Orientation, Quantity::Scale});
+        return false;
+    }
+    const bool positionValid = validation::check<Policy>(position, Quantity::Position);
+    const bool orientationValid = validation::check<Policy>(orientation, Quantity::Orientation);
+    const bool scaleValid = validation::check<Policy>(scale, Quantity::Scale);
+    if (!Policy::partial && !(positionValid && orientationValid && scaleValid)) {
+        return false;
+    }
+    if (positionValid) {
+        obj->setPosition(position);
+        validation::applied<Policy>(Quantity::Position);
+    }
+    if (orientationValid) {
+        obj->setOrientation(orientation);
+        validation::applied<Policy>(Quantity::Orientation);
+    }
+    if (scaleValid) {
+        obj->setScale(scale);
+        validation::applied<Policy>(Quantity::Scale);
+    }
+    return positionValid && orientationValid && scaleValid;
 }
 
+/**
+ * \brief Check which values of an array are finite (neither NaN nor infinite).
+ * mask[i] is set to 1 if values[i] is finite and to 0 otherwise. Uses SSE2 if available.
+ */
+inline void finiteMask(const float* values, size_t count, uint8_t* mask) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // A float is not finite if all bits of its exponent are set
+    const __m128i exponent = _mm_set1_epi32(0x7f800000);
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= count; i += 16) {
+        __m128i nonFinite[4];
+        for (int j = 0; j < 4; ++j) {
+            __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 4 * j));
+            nonFinite[j] = _mm_cmpeq_epi32(_mm_and_si128(bits, exponent), exponent);
+        }
+        // Saturating packs keep 0 and -1, so every float ends up as one byte
+        __m128i packed = _mm_packs_epi16(_mm_packs_epi32(nonFinite[0], nonFinite[1]),
+                                         _mm_packs_epi32(nonFinite[2], nonFinite[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), _mm_andnot_si128(packed, one));
+    }
+#endif
+    for (; i < count; ++i) {
+        uint32_t bits;
+        std::memcpy(&bits, values + i, sizeof(bits));
+        mask[i] = (bits & 0x7f800000u) != 0x7f800000u;
+    }
+}
+
+inline void finiteMask(const double* values, size_t count, uint8_t* mask) {
+    for (size_t i = 0; i < count; ++i) {
+        mask[i] = std::isfinite(values[i]);
+    }
+}
+
+/**
+ * \brief Set the poses of many objects at once.
+ * The positions and orientations of the whole batch are validated at once, only objects with a valid (non-null)
+ * pointer and a finite position and orientation are updated. Nothing is logged.
+ *
+ * @param rejected If not NULL, it is cleared and filled with the indices of the rejected entries in ascending order.
+ * Pass the same vector every frame to reuse its capacity.
+ * @return The number of rejected entries.
+ */
 template <typename T>
-void setOrientationSafely(T& settableObject, const Ogre::Quaternion& orientation) {
-    if (ptr(settableObject) && !orientation.isNaN()) {
-        ptr(settableObject)->setOrientation(orientation);
-    } else {
-        if (orientation.isNaN()) {
-            ROS_ERROR_THROTTLE(1, "Could not set position. Orientation is not valid (NAN).");
+size_t setPosesSafely(const T* settableObjects,
+                      const Ogre::Vector3* positions,
+                      const Ogre::Quaternion* orientations,
+                      size_t count,
+                      std::vector<size_t>* rejected = NULL) {
+    static_assert(sizeof(Ogre::Vector3) == 3 * sizeof(Ogre::Real), "Ogre::Vector3 has to be tightly packed");
+    static_assert(sizeof(Ogre::Quaternion) == 4 * sizeof(Ogre::Real), "Ogre::Quaternion has to be tightly packed");
+    stats::ScopedTimer timer(stats::SetPoses);
+
+    // Reused between calls to avoid allocations in the per-frame update
+    static thread_local std::vector<uint8_t> positionMask;
+    static thread_local std::vector<uint8_t> orientationMask;
+    positionMask.resize(3 * count);
+    orientationMask.resize(4 * count);
+    if (count > 0) {
+        finiteMask(positions[0].ptr(), 3 * count, positionMask.data());
+        finiteMask(orientations[0].ptr(), 4 * count, orientationMask.data());
+    }
+
+    if (rejected) {
+        rejected->clear();
+    }
+    size_t rejectedCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* p = &positionMask[3 * i];
+        const uint8_t* q = &orientationMask[4 * i];
+        const bool valid = p[0] & p[1] & p[2] & q[0] & q[1] & q[2] & q[3];
+        auto obj = ptr(settableObjects[i]);
+        if (valid && obj) {
+            obj->setPosition(positions[i]);
+            obj->setOrientation(orientations[i]);
         } else {
-            ROS_ERROR_THROTTLE(1, "Could not set position.");
+            ++rejectedCount;
+            if (rejected) {
+                rejected->push_back(i);
+            }
+        }
+    }
+    stats::add(stats::PosesApplied, count - rejectedCount);
+    stats::add(stats::PosesRejected, rejectedCount);
+    return rejectedCount;
+}
+
+/**
+ * \brief Set the poses of many objects at once, see above.
+ * Objects without a corresponding position or orientation are rejected.
+ */
+template <typename T>
+size_t setPosesSafely(const std::vector<T>& settableObjects,
+                      const std::vector<Ogre::Vector3>& positions,
+                      const std::vector<Ogre::Quaternion>& orientations,
+                      std::vector<size_t>* rejected = NULL) {
+    const size_t count = std::min(settableObjects.size(), std::min(positions.size(), orientations.size()));
+    const size_t rejectedCount =
+        setPosesSafely(settableObjects.data(), positions.data(), orientations.data(), count, rejected);
+    if (rejected) {
+        for (size_t i = count; i < settableObjects.size(); ++i) {
+            rejected->push_back(i);
         }
     }
+    return rejectedCount + settableObjects.size() - count;
 }
 
 } // namespace util_rviz
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+class AgentView;
+
+/**
+ * \brief Container for many agents that keeps their state in contiguous arrays (structure of arrays).
+ * Setters only write to the arrays and mark the agent dirty, Ogre is only touched in sync(), which should be called
+ * once per frame on the render thread. Bulk passes (e.g. recoloring by speed) can work directly on the arrays returned
+ * by positions(), colors() etc. and mark the agents dirty afterwards. Such passes may run in parallel, sync() may not.
+ *
+ * Agents are referenced by stable slots. Internally the arrays are kept dense, so the array index of an agent
+ * (see index()) changes when other agents are removed.
+ *
+ * The archetypes (SimpleCar etc.) are not views on these arrays, they stay self-contained MultiShapes that AgentScene
+ * creates and updates in sync(). Code written against the MultiShape setters can use an AgentView instead.
+ */
+class AgentScene {
+public:
+    typedef uint32_t Slot;
+
+    AgentScene(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL, bool baked = false);
+
+    /**
+     * \brief Add an agent with the given id. Its shape is created in the next sync().
+     */
+    Slot add(uint64_t id, Archetype archetype);
+
+    /**
+     * \brief Remove an agent and destroy its shape. The slot may be reused by later agents.
+     *
+     * @return false if the slot is not in use, e.g. because it was removed before. Nothing is changed then.
+     */
+    bool remove(Slot slot);
+
+    /**
+     * \brief Whether the slot refers to an agent, i.e. it was returned by add() and not removed since.
+     */
+    bool contains(Slot slot) const {
+        return slot < slotToIndex_.size() && slotToIndex_[slot] != InvalidIndex;
+    }
+
+    void setPosition(Slot slot, const Ogre::Vector3& position);
+    void setOrientation(Slot slot, const Ogre::Quaternion& orientation);
+    void setScale(Slot slot, const Ogre::Vector3& scale);
+    void setColor(Slot slot, const Ogre::ColourValue& c);
+
+    /**
+     * \brief Like setColor(), but keeps the black parts black for cars (see SimpleCar::setColorPartly()).
+     */
+    void setColorPartly(Slot slot, const Ogre::ColourValue& c);
+    void setVisible(Slot slot, bool visible);
+
+    /**
+     * \brief Apply the state of all dirty agents to their shapes.
+     */
+    void sync();
+
+    /**
+     * \brief Get a view on an agent that can be used like a MultiShape for setting its state.
+     */
+    AgentView view(Slot slot);
+
+    /**
+     * \brief Get the shape of an agent, or NULL if it was not created yet (see sync()).
+     */
+    MultiShape* shape(Slot slot) {
+        return shapes_[index(slot)].get();
+    }
+
+    size_t index(Slot slot) const {
+        return slotToIndex_[slot];
+    }
+
+    Slot slot(size_t index) const {
+        return indexToSlot_[index];
+    }
+
+    size_t size() const {
+        return ids_.size();
+    }
+
+    /**
+     * \brief Mark the agent at the given array index dirty, e.g. after writing to the arrays directly.
+     * flags is a combination of MultiShape::DirtyFlag values. DirtyColor marks the color as set (see colorsSet()).
+     */
+    void markDirty(size_t index, uint32_t flags) {
+        dirty_[index] |= flags;
+        if (flags & MultiShape::DirtyColor) {
+            colorSet_[index] = true;
+        }
+    }
+
+    /**
+     * \brief Mark all agents dirty, see markDirty().
+     */
+    void markAllDirty(uint32_t flags);
+
+    // Direct access to the arrays, indexed by index()
+    const uint64_t* ids() const {
+        return ids_.data();
+    }
+    const Archetype* archetypes() const {
+        return archetypes_.data();
+    }
+    Ogre::Vector3* positions() {
+        return positions_.data();
+    }
+    Ogre::Quaternion* orientations() {
+        return orientations_.data();
+    }
+    Ogre::Vector3* scales() {
+        return scales_.data();
+    }
+    Ogre::ColourValue* colors() {
+        return colors_.data();
+    }
+    uint8_t* visibilities() {
+        return visible_.data();
+    }
+    const Ogre::Vector3* positions() const {
+        return positions_.data();
+    }
+    const Ogre::Quaternion* orientations() const {
+        return orientations_.data();
+    }
+    const Ogre::Vector3* scales() const {
+        return scales_.data();
+    }
+    const Ogre::ColourValue* colors() const {
+        return colors_.data();
+    }
+    const uint8_t* visibilities() const {
+        return visible_.data();
+    }
+    /**
+     * \brief Whether the colors were set with setColorPartly().
+     */
+    const uint8_t* colorsPartly() const {
+        return colorPartly_.data();
+    }
+    /**
+     * \brief Whether the colors were set at all. Agents without a color keep the default colors of their shapes.
+     */
+    const uint8_t* colorsSet() const {
+        return colorSet_.data();
+    }
+
+private:
+    static const Slot InvalidIndex = 0xffffffff;
+
+    Ogre::SceneManager* scene_manager_;
+    Ogre::SceneNode* parent_node_;
+    bool baked_;
+
+    // Dense arrays, one entry per agent
+    std::vector<uint64_t> ids_;
+    std::vector<Archetype> archetypes_;
+    std::vector<Ogre::Vector3> positions_;
+    std::vector<Ogre::Quaternion> orientations_;
+    std::vector<Ogre::Vector3> scales_;
+    std::vector<Ogre::ColourValue> colors_;
+    std::vector<uint8_t> colorPartly_;
+    std::vector<uint8_t> colorSet_;
+    std::vector<uint8_t> visible_;
+    std::vector<uint32_t> dirty_;
+    std::vector<std::unique_ptr<MultiShape>> shapes_;
+    std::vector<Slot> indexToSlot_;
+
+    // Sparse mapping of the stable slots
+    std::vector<uint32_t> slotToIndex_;
+    std::vector<Slot> freeSlots_;
+};
+
+/**
+ * \brief Thin handle on one agent of an AgentScene, offering the setters of MultiShape.
+ * Can be used with the util_rviz::set...Safely() functions.
+ */
+class AgentView {
+public:
+    AgentView(AgentScene* scene, AgentScene::Slot slot) : scene_(scene), slot_(slot) {
+    }
+
+    void setPosition(const Ogre::Vector3& position) {
+        scene_->setPosition(slot_, position);
+    }
+    void setOrientation(const Ogre::Quaternion& orientation) {
+        scene_->setOrientation(slot_, orientation);
+    }
+    void setScale(const Ogre::Vector3& scale) {
+        scene_->setScale(slot_, scale);
+    }
+    void setColor(const Ogre::ColourValue& c) {
+        scene_->setColor(slot_, c);
+    }
+    void setColor(float r, float g, float b, float a) {
+        scene_->setColor(slot_, Ogre::ColourValue(r, g, b, a));
+    }
+    void setColorPartly(const Ogre::ColourValue& c) {
+        scene_->setColorPartly(slot_, c);
+    }
+    void visible(bool vis) {
+        scene_->setVisible(slot_, vis);
+    }
+    const Ogre::Vector3& getPosition() const {
+        return scene_->positions()[scene_->index(slot_)];
+    }
+    const Ogre::Quaternion& getOrientation() const {
+        return scene_->orientations()[scene_->index(slot_)];
+    }
+    AgentScene::Slot slot() const {
+        return slot_;
+    }
+
+private:
+    AgentScene* scene_;
+    AgentScene::Slot slot_;
+};
+
+inline AgentView AgentScene::view(Slot slot) {
+    return AgentView(this, slot);
+}
+
+} // namespace rviz
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizagentscene.hpp"
+#include "util_rvizidindexmap.hpp"
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+/**
+ * \brief The coalesced commands for one agent, see ShapeCommandQueue.
+ * Only the fields whose bit is set in fields were written. The setters overwrite a field like the setters of
+ * MultiShape would, e.g. setColor() also overwrites an earlier setColorPartly(), and return whether an earlier write
+ * was superseded.
+ */
+struct ShapeUpdate {
+    enum Field : uint8_t { Position = 1, Orientation = 2, Color = 4, Visibility = 8, ColorPartly = 16 };
+
+    uint64_t id;
+    uint8_t fields;
+    bool visible;
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    Ogre::ColourValue color;       ///< Set with setColor()
+    Ogre::ColourValue colorPartly; ///< Set with setColorPartly(), applied after color
+
+    /**
+     * \brief Get an update without written fields.
+     */
+    static ShapeUpdate none(uint64_t id = 0) {
+        return ShapeUpdate{id, 0, true, Ogre::Vector3::ZERO, Ogre::Quaternion::IDENTITY, Ogre::ColourValue::White,
+                           Ogre::ColourValue::White};
+    }
+
+    bool setPosition(const Ogre::Vector3& p);
+    bool setOrientation(const Ogre::Quaternion& q);
+    bool setColor(const Ogre::ColourValue& c);
+    bool setColorPartly(const Ogre::ColourValue& c);
+    bool setVisible(bool v);
+
+    /**
+     * \brief Write the fields of a later update, as if its setters were called after the ones of this update.
+     * @return The number of superseded fields.
+     */
+    size_t merge(const ShapeUpdate& later);
+
+    /**
+     * \brief Apply the written fields to an object.
+     */
+    void applyTo(MultiShape& shape) const;
+
+    /**
+     * \brief Apply the written fields to an agent of a scene.
+     */
+    void applyTo(AgentScene& scene, AgentScene::Slot slot) const;
+};
+
+/**
+ * \brief Passes setPosition/setOrientation/setColor/setColorPartly/visible commands for agents from any thread to the
+ * render thread.
+ * Producers write the commands into a bounded ring buffer without locks. If the ring is full, commands are merged per
+ * agent into an overflow buffer under a mutex instead, until the render thread caught up. Nothing is dropped.
+ * The render thread calls drain() once per frame, which merges the commands per agent so that the last write to each
+ * field wins and hands out one ShapeUpdate per agent. All producer methods may be called concurrently, drain() only
+ * from one thread at a time.
+ */
+class ShapeCommandQueue {
+public:
+    struct Statistics {
+        uint64_t queued;
+        uint64_t overflowed; ///< Merged into the overflow buffer, because the ring was full
+        uint64_t superseded; ///< Overwritten by a later command for the same agent and field
+        uint64_t drained;    ///< Updates handed out by drain()
+    };
+
+    /**
+     * \brief Create a queue whose ring holds at least capacity commands between two drains.
+     */
+    explicit ShapeCommandQueue(size_t capacity = 4096);
+
+    void setPosition(uint64_t id, const Ogre::Vector3& position);
+    void setOrientation(uint64_t id, const Ogre::Quaternion& orientation);
+    void setColor(uint64_t id, const Ogre::ColourValue& c);
+    void setColorPartly(uint64_t id, const Ogre::ColourValue& c);
+    void visible(uint64_t id, bool visible);
+
+    /**
+     * \brief Take the queued commands and call f(const ShapeUpdate&) once per agent, in the order the agents were
+     * first written to. Commands queued while draining may be left for the next call.
+     * @return The number of updates.
+     */
+    template <typename Function>
+    size_t drain(Function&& f) {
+        collect();
+        for (const auto& u : updates_) {
+            f(u);
+        }
+        return updates_.size();
+    }
+
+    /**
+     * \brief Get the counters, may be called from any thread.
+     */
+    Statistics statistics() const;
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+private:
+    struct Command {
+        uint64_t id;
+        uint8_t field;
+        bool visible;
+        float values[4];
+    };
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Command command;
+    };
+
+    void push(const Command& command);
+    bool pushToRing(const Command& command);
+    void pushToOverflow(const Command& command);
+    void collect();
+
+    /**
+     * Write the command into the update of its agent, returns whether an earlier write was superseded.
+     */
+    static bool write(std::vector<ShapeUpdate>& updates, IdIndexMap& indices, const Command& c);
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+
+    // Keep the producer and consumer positions on separate cache lines
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    std::atomic<uint64_t> queued_;
+    alignas(64) size_t dequeuePos_;
+    std::atomic<uint64_t> superseded_;
+    std::atomic<uint64_t> drained_;
+    std::vector<ShapeUpdate> updates_;
+    IdIndexMap indices_;
+
+    // Once the ring was full, all commands go here until the ring is drained, so that they are applied in order
+    alignas(64) std::atomic<bool> overflowing_;
+    std::atomic<uint64_t> overflowed_;
+    std::mutex overflowMutex_;
+    std::vector<ShapeUpdate> overflow_;
+    IdIndexMap overflowIndices_;
+};
+
+} // namespace rviz
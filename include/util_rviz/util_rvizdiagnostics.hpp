@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <string>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <ros/ros.h>
+
+#include "util_rvizstats.hpp"
+
+
+namespace util_rviz {
+
+/**
+ * \brief Build the status published by DiagnosticsPublisher from two snapshots taken elapsedSeconds apart.
+ * Counters are reported as integers, durations in microseconds.
+ */
+diagnostic_msgs::DiagnosticStatus diagnosticStatus(const stats::Snapshot& current,
+                                                   const stats::Snapshot& last,
+                                                   double elapsedSeconds,
+                                                   double warnRejectionsPerSecond = 1.0);
+
+/**
+ * \brief Periodically publishes the util_rviz statistics as diagnostic_msgs/DiagnosticArray.
+ * The status is WARN if more than warnRejectionsPerSecond pose or scale updates were rejected since the last
+ * publication, e.g. during a NaN storm upstream. The rate is measured in wall time, so it does not depend on sim time.
+ */
+class DiagnosticsPublisher {
+public:
+    DiagnosticsPublisher(ros::NodeHandle& nh,
+                         const ros::Duration& period = ros::Duration(1.0),
+                         double warnRejectionsPerSecond = 1.0,
+                         const std::string& topic = "/diagnostics");
+
+private:
+    void publish(const ros::TimerEvent& event);
+
+    ros::Publisher publisher_;
+    ros::Timer timer_;
+    double warnRejectionsPerSecond_;
+    stats::Snapshot last_;
+    ros::WallTime lastStamp_;
+};
+
+} // namespace util_rviz
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+
+namespace rviz {
+
+class MultiShape;
+
+/**
+ * \brief Resources of one or more MultiShapes, see MultiShape::footprint().
+ * Byte counts are estimates from the sizes of the involved types and containers; allocator overhead is not included.
+ */
+struct Footprint {
+    size_t objects{0};
+    size_t heapBytes{0};       ///< The objects, their containers, rviz::Shapes and control blocks
+    size_t sceneNodes{0};
+    size_t entities{0};
+    size_t ownMaterials{0};    ///< Materials created for the object alone
+    size_t sharedMaterials{0}; ///< Handles to materials of a MaterialCache
+    size_t ogreBytes{0};       ///< The scene nodes, entities and own materials
+
+    size_t bytes() const {
+        return heapBytes + ogreBytes;
+    }
+
+    Footprint& operator+=(const Footprint& other);
+};
+
+/**
+ * \brief The footprint of all MultiShapes that currently exist.
+ * Meshes are shared between all objects of an archetype, so their buffers are counted once here and not per object.
+ */
+struct FootprintReport {
+    Footprint total;
+    std::map<std::string, Footprint> archetypes; ///< By MultiShape::archetypeName()
+    size_t meshes{0};
+    size_t vertexBytes{0};
+    size_t indexBytes{0};
+
+    size_t bytes() const {
+        return total.bytes() + vertexBytes + indexBytes;
+    }
+
+    /**
+     * \brief Format the report, one line per archetype followed by the totals.
+     */
+    std::string toString() const;
+};
+
+namespace footprint {
+
+/**
+ * \brief Sum up the footprints of all existing MultiShapes.
+ * Like all Ogre objects, the registry may only be used from the render thread. Calling this periodically in a long
+ * running session shows leaked objects as a growing count.
+ */
+FootprintReport report();
+
+/**
+ * \brief Get the number of existing MultiShapes.
+ */
+size_t objectCount();
+
+// Called by the constructor and destructor of MultiShape
+void registerObject(const MultiShape* obj);
+void unregisterObject(const MultiShape* obj);
+
+} // namespace footprint
+} // namespace rviz
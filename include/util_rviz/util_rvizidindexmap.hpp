@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace rviz {
+
+/**
+ * \brief Hash map from 64 bit ids to 32 bit values with open addressing (linear probing).
+ * Deletion shifts the following entries back, so there are no tombstones and lookups stay short.
+ */
+class IdIndexMap {
+public:
+    static const uint32_t Missing = 0xffffffff;
+
+    IdIndexMap();
+
+    /**
+     * \brief Get the value of the id, or Missing.
+     */
+    uint32_t find(uint64_t id) const;
+
+    /**
+     * \brief Insert the id or overwrite its value. The value must not be Missing.
+     */
+    void insert(uint64_t id, uint32_t value);
+    void erase(uint64_t id);
+    void clear();
+
+    size_t size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Get the number of buckets, which doubles when more than half of them would be taken.
+     */
+    size_t bucketCount() const {
+        return buckets_.size();
+    }
+
+private:
+    struct Bucket {
+        uint64_t id;
+        uint32_t value; ///< Missing for empty buckets
+    };
+
+    size_t bucketOf(uint64_t id) const;
+    void grow();
+
+    std::vector<Bucket> buckets_;
+    size_t size_;
+};
+
+} // namespace rviz
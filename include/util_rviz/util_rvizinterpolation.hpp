@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreVector3.h>
+#include <ros/ros.h>
+
+#include "util_rviz.hpp"
+
+
+namespace util_rviz {
+
+struct StampedPose {
+    ros::Time stamp;
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+};
+
+/**
+ * \brief Fixed-capacity history of the latest timestamped poses of one object.
+ * Used to display objects smoothly at the render rate although their poses arrive at a lower rate, see advanceTo().
+ */
+template <size_t Capacity = 8>
+class PoseBuffer {
+    static_assert(Capacity >= 2, "Interpolation needs at least two poses");
+
+public:
+    /**
+     * \brief Add a pose. If the buffer is full, the oldest pose is dropped.
+     * Poses with non-finite values or older than the latest pose are rejected. A pose with the same stamp as the latest one
+     * replaces it.
+     *
+     * @return Whether the pose was added.
+     */
+    bool push(const ros::Time& stamp, const Ogre::Vector3& position, const Ogre::Quaternion& orientation) {
+        if (!validation::isFinite(position) || !validation::isFinite(orientation)) {
+            return false;
+        }
+        if (size_ > 0) {
+            StampedPose& latest = at(size_ - 1);
+            if (stamp < latest.stamp) {
+                return false;
+            }
+            if (stamp == latest.stamp) {
+                latest = StampedPose{stamp, position, orientation};
+                return true;
+            }
+        }
+        if (size_ == Capacity) {
+            begin_ = (begin_ + 1) % Capacity;
+            --size_;
+        }
+        at(size_) = StampedPose{stamp, position, orientation};
+        ++size_;
+        return true;
+    }
+
+    /**
+     * \brief Get the pose at time t.
+     * Between two poses, the position is interpolated linearly and the orientation by slerp. After the latest pose,
+     * both are extrapolated from the latest two poses for at most maxExtrapolation and held afterwards. Before the
+     * oldest pose, the oldest pose is returned.
+     *
+     * @return false if the buffer is empty.
+     */
+    bool sample(const ros::Time& t,
+                const ros::Duration& maxExtrapolation,
+                Ogre::Vector3& position,
+                Ogre::Quaternion& orientation) const {
+        if (size_ == 0) {
+            return false;
+        }
+        if (size_ == 1 || t <= at(0).stamp) {
+            const StampedPose& pose = t <= at(0).stamp ? at(0) : at(size_ - 1);
+            position = pose.position;
+            orientation = pose.orientation;
+            return true;
+        }
+
+        // Find the poses around t, or the latest two poses to extrapolate
+        size_t next = 1;
+        while (next < size_ - 1 && at(next).stamp < t) {
+            ++next;
+        }
+        const StampedPose& p0 = at(next - 1);
+        const StampedPose& p1 = at(next);
+        ros::Time target = t;
+        if (target > p1.stamp + maxExtrapolation) {
+            target = p1.stamp + maxExtrapolation;
+        }
+        const Ogre::Real ratio = static_cast<Ogre::Real>((target - p0.stamp).toSec() / (p1.stamp - p0.stamp).toSec());
+        position = p0.position + (p1.position - p0.position) * ratio;
+        orientation = Ogre::Quaternion::Slerp(ratio, p0.orientation, p1.orientation, true);
+        return true;
+    }
+
+    const StampedPose& latest() const {
+        return at(size_ - 1);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void clear() {
+        begin_ = 0;
+        size_ = 0;
+    }
+
+private:
+    StampedPose& at(size_t i) {
+        return poses_[(begin_ + i) % Capacity];
+    }
+    const StampedPose& at(size_t i) const {
+        return poses_[(begin_ + i) % Capacity];
+    }
+
+    std::array<StampedPose, Capacity> poses_;
+    size_t begin_{0};
+    size_t size_{0};
+};
+
+/**
+ * \brief Set the pose of an object to the pose of the buffer at time t, see PoseBuffer::sample().
+ * Usually called once per frame with the current time. The pose is set with setPositionSafely() and
+ * setOrientationSafely().
+ *
+ * @return false if the buffer is empty.
+ */
+template <typename T, size_t Capacity>
+bool advanceTo(T& settableObject,
+               const PoseBuffer<Capacity>& buffer,
+               const ros::Time& t,
+               const ros::Duration& maxExtrapolation = ros::Duration(0.5)) {
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    if (!buffer.sample(t, maxExtrapolation, position, orientation)) {
+        return false;
+    }
+    setPositionSafely(settableObject, position);
+    setOrientationSafely(settableObject, orientation);
+    return true;
+}
+
+} // namespace util_rviz
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <OGRE/OgreBillboardSet.h>
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreFont.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+struct LabelSettings {
+    std::string font{"Liberation Sans"};
+    float charHeight{0.6f};
+    float margin{0.3f};       ///< Distance between the top of an object and its label
+    float fadeStart{40.f};    ///< Labels fade out between fadeStart and fadeEnd from the camera...
+    float fadeEnd{60.f};      ///< ...and have no glyphs beyond
+    size_t maxGlyphs{20000};  ///< Labels that would exceed this number are not shown
+    Ogre::ColourValue color{Ogre::ColourValue::White};
+};
+
+/**
+ * \brief Text labels above MultiShapes, e.g. their id and speed, drawn by a single BillboardSet.
+ * Every character is a camera facing billboard textured from the glyph atlas of the font, so all labels share one
+ * material and one vertex buffer. A label floats above the bounds of its object (above getRootNode()), so its height
+ * depends on the archetype. Changing the text only touches the glyphs of that label, moving objects only their
+ * positions. Labels beyond LabelSettings::fadeEnd give their glyphs back, which bounds the glyph count in large scenes.
+ * Call update() once per frame with the camera that renders the scene. Labels only support single byte characters.
+ * Labels of destroyed objects are removed automatically.
+ */
+class LabelSet : private MultiShape::DestructionListener {
+public:
+    explicit LabelSet(Ogre::SceneManager* scene_manager, const LabelSettings& settings = LabelSettings());
+    ~LabelSet() override;
+    LabelSet(const LabelSet&) = delete;
+    LabelSet& operator=(const LabelSet&) = delete;
+
+    /**
+     * \brief Set the text of the label of the object, adding the label if it does not exist yet.
+     */
+    void setText(MultiShape* obj, const std::string& text);
+
+    /**
+     * \brief Override the height of the label above the origin of the object.
+     */
+    void setHeight(MultiShape* obj, float height);
+
+    /**
+     * \brief Remove the label of the object, e.g. before it is returned to a pool.
+     */
+    void remove(MultiShape* obj);
+
+    void clear();
+
+    /**
+     * \brief Move the labels to their objects, face them to the camera and fade them by distance.
+     */
+    void update(const Ogre::Camera* camera);
+
+    void setVisible(bool visible);
+
+    size_t size() const {
+        return labels_.size();
+    }
+
+    /**
+     * \brief Get the number of glyphs that are currently drawn.
+     */
+    size_t glyphCount() const {
+        return glyphCount_;
+    }
+
+    /**
+     * \brief Lay out a line of text centered on zero, the way labels are laid out.
+     * Appends the offset of the center of each glyph to offsets. Spaces only advance by spaceWidth and get no glyph,
+     * the width of the other characters is given by glyphWidth(unsigned char).
+     *
+     * @return The width of the line.
+     */
+    template <typename GlyphWidth>
+    static float layoutLine(const std::string& text,
+                            float spaceWidth,
+                            GlyphWidth&& glyphWidth,
+                            std::vector<float>& offsets) {
+        const size_t first = offsets.size();
+        float x = 0.f;
+        for (char c : text) {
+            if (c == ' ') {
+                x += spaceWidth;
+                continue;
+            }
+            const float width = glyphWidth(static_cast<unsigned char>(c));
+            offsets.push_back(x + 0.5f * width);
+            x += width;
+        }
+        for (size_t i = first; i < offsets.size(); ++i) {
+            offsets[i] -= 0.5f * x;
+        }
+        return x;
+    }
+
+private:
+    struct Label {
+        MultiShape* obj;
+        std::string text;
+        float height;
+        std::vector<Ogre::Billboard*> glyphs;
+        std::vector<float> offsets; ///< Of the glyphs, from the center of the label along the camera's right axis
+        Ogre::Vector3 anchor;
+        float alpha;
+        bool layoutDirty;
+    };
+
+    void objectDestroyed(MultiShape* obj) override;
+    void layout(Label& label);
+    void place(Label& label, const Ogre::Vector3& right);
+    void release(Label& label);
+
+    Ogre::SceneManager* scene_manager_;
+    Ogre::SceneNode* scene_node_;
+    Ogre::BillboardSet* billboards_;
+    Ogre::FontPtr font_;
+    Ogre::MaterialPtr material_;
+    LabelSettings settings_;
+    std::vector<Label> labels_;
+    std::unordered_map<const MultiShape*, size_t> labelIndices_;
+    std::vector<Ogre::Billboard*> freeGlyphs_;
+    size_t glyphCount_;
+    Ogre::Quaternion cameraOrientation_;
+};
+
+} // namespace rviz
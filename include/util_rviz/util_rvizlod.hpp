@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+/**
+ * \brief Level of detail configuration for one archetype.
+ * distances[i] is the camera distance beyond which the level of detail is at least i + 1, e.g. {50, 150, 400} for
+ * LodReduced, LodBox and LodHidden. Coarser levels than distances.size() are never used.
+ * A level is only left once the distance is more than the relative hysteresis beyond its thresholds, so that objects
+ * at a threshold do not flicker between levels.
+ */
+struct LodSettings {
+    std::vector<float> distances;
+    float hysteresis{0.1f};
+
+    /**
+     * \brief Create settings from thresholds on the projected size of the archetype.
+     * pixelSizes[i] is the projected diameter in pixels below which the level of detail is at least i + 1. The
+     * thresholds are converted to distances for an archetype of the given bounding radius, seen with the given
+     * vertical field of view (in radians) on a viewport of the given height (in pixels).
+     */
+    static LodSettings fromProjectedSize(const std::vector<float>& pixelSizes,
+                                         float radius,
+                                         float fovY,
+                                         float viewportHeight);
+};
+
+/**
+ * \brief Select the level of detail for an object at the given distance from the camera.
+ */
+MultiShape::LodLevel selectLodLevel(float distance, MultiShape::LodLevel current, const LodSettings& settings);
+
+/**
+ * \brief Update the level of detail of all objects in [first, last) for the given camera position.
+ * The iterators have to point to (smart) pointers to MultiShapes of the archetype the settings are meant for.
+ */
+template <typename Iterator>
+void updateLod(Iterator first, Iterator last, const Ogre::Vector3& cameraPosition, const LodSettings& settings) {
+    util_rviz::stats::ScopedTimer timer(util_rviz::stats::LodUpdate);
+    for (; first != last; ++first) {
+        auto& obj = *first;
+        const float distance = obj->getRootNode()->_getDerivedPosition().distance(cameraPosition);
+        obj->setLodLevel(selectLodLevel(distance, obj->getLodLevel(), settings));
+    }
+}
+
+} // namespace rviz
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreMaterial.h>
+
+
+namespace rviz {
+namespace materials {
+
+/**
+ * \brief Create a material that is set up the same way rviz::Shape sets up its materials.
+ */
+Ogre::MaterialPtr createMaterial(const std::string& name);
+
+/**
+ * \brief Apply a color to a material the same way rviz::Shape::setColor() does.
+ */
+void applyColor(const Ogre::MaterialPtr& material, const Ogre::ColourValue& c);
+
+} // namespace materials
+
+/**
+ * \brief Shares materials between all shapes of the same color.
+ * Colors are quantised to 8 bit per channel, including alpha. The material for a color is created on first request
+ * and removed from the Ogre::MaterialManager as soon as no handle to it is left.
+ * Like all Ogre objects, the cache may only be used from the render thread.
+ */
+class MaterialCache {
+public:
+    class Entry;
+    typedef std::shared_ptr<const Entry> Handle;
+
+    MaterialCache();
+
+    /**
+     * \brief Get a handle to the material for the given color.
+     * The material is set up like the materials of rviz::Shape.
+     */
+    Handle get(const Ogre::ColourValue& c);
+
+    /**
+     * \brief Get the number of materials that are currently referenced.
+     */
+    size_t size() const;
+
+    /**
+     * \brief Quantise a color to the key used by the cache (RGBA, 8 bit each).
+     */
+    static uint32_t key(const Ogre::ColourValue& c);
+
+private:
+    struct Storage {
+        std::string prefix;
+        std::unordered_map<uint32_t, std::weak_ptr<const Entry>> entries;
+    };
+    std::shared_ptr<Storage> storage_;
+};
+
+class MaterialCache::Entry {
+public:
+    Entry(const std::shared_ptr<Storage>& storage, uint32_t key, const Ogre::MaterialPtr& material);
+    ~Entry();
+
+    const Ogre::MaterialPtr& material() const {
+        return material_;
+    }
+
+private:
+    std::weak_ptr<Storage> storage_;
+    uint32_t key_;
+    Ogre::MaterialPtr material_;
+};
+
+} // namespace rviz
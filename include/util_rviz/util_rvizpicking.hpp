@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <OGRE/OgreAxisAlignedBox.h>
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreRay.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+/**
+ * \brief Index of the oriented bounding boxes of MultiShapes for picking, without Ogre scene queries.
+ * The box of an object is its local bounds (see MultiShape::getLocalBounds()) transformed by the derived (world)
+ * transform of its scene node. Boxes are sorted into all cells of a uniform grid on the world XY plane that they
+ * overlap, rays walk the cells they cross front to back. Hidden objects are never reported.
+ * Poses are not tracked automatically: Call updateAll() once per frame (or update() after moving an object). Both only
+ * recompute objects whose revision() changed, unless forced, e.g. after the parent node moved. Destroyed objects are
+ * removed automatically.
+ * Queries are not thread safe.
+ */
+class PickingIndex : private MultiShape::DestructionListener {
+public:
+    struct Hit {
+        MultiShape* obj;
+        const Ogre::Any* userData; ///< The user data of obj, see MultiShape::setUserData()
+        float distance;            ///< Distance from the ray origin or camera
+    };
+
+    explicit PickingIndex(float cellSize = 20.f);
+    ~PickingIndex() override;
+    PickingIndex(const PickingIndex&) = delete;
+    PickingIndex& operator=(const PickingIndex&) = delete;
+
+    void insert(MultiShape* obj);
+    void remove(MultiShape* obj);
+    void clear();
+
+    void update(MultiShape* obj, bool force = false);
+    void updateAll(bool force = false);
+
+    /**
+     * \brief Find the nearest object hit by the ray within maxDistance.
+     *
+     * @return Whether an object was hit.
+     */
+    bool raycast(const Ogre::Ray& ray, Hit& hit, float maxDistance = 1000.f) const;
+
+    /**
+     * \brief Append all objects hit by the ray within maxDistance to result, ordered by distance.
+     */
+    void raycastAll(const Ogre::Ray& ray, std::vector<Hit>& result, float maxDistance = 1000.f) const;
+
+    /**
+     * \brief Append all objects that are at least partly inside the rectangle of the camera's viewport to result.
+     * The rectangle is given in normalized screen coordinates (0 to 1, top left to bottom right), as for
+     * Ogre::Camera::getCameraToViewportBoxVolume().
+     */
+    void querySelection(Ogre::Camera* camera,
+                        float left,
+                        float top,
+                        float right,
+                        float bottom,
+                        std::vector<Hit>& result) const;
+
+    size_t size() const {
+        return items_.size();
+    }
+
+private:
+    struct Item {
+        MultiShape* obj;
+        Ogre::AxisAlignedBox local;
+        uint32_t revision;
+        Ogre::Vector3 center;
+        Ogre::Vector3 halfSize;
+        Ogre::Quaternion orientation;
+        int32_t minX, minY, maxX, maxY; ///< Range of covered cells
+    };
+
+    void objectDestroyed(MultiShape* obj) override;
+
+    int32_t cellCoordinate(float v) const;
+
+    /**
+     * Computes the range of cells covered by the selection frustum on the XY plane. Returns false if the frustum
+     * is unbounded, i.e. the camera has no far plane or looks past the horizon.
+     */
+    bool selectionCells(Ogre::Camera* camera,
+                        float left,
+                        float top,
+                        float right,
+                        float bottom,
+                        int32_t& minX,
+                        int32_t& minY,
+                        int32_t& maxX,
+                        int32_t& maxY) const;
+    void computeBox(Item& item);
+    void addToCells(size_t index);
+    void removeFromCells(size_t index);
+    bool pickable(const Item& item) const;
+    bool intersect(const Item& item, const Ogre::Ray& ray, float& distance) const;
+
+    /**
+     * Calls f(items of the cell, distance at which the ray enters the cell) for all cells along the ray, until f
+     * returns false.
+     */
+    template <typename Function>
+    void forEachCellOnRay(const Ogre::Ray& ray, float maxDistance, Function&& f) const;
+
+    float cellSize_;
+    std::vector<Item> items_;
+    std::unordered_map<const MultiShape*, size_t> itemIndices_;
+    std::unordered_map<int64_t, std::vector<size_t>> cells_;
+
+    // An object covering several cells is only tested once per query
+    mutable std::vector<uint32_t> visited_;
+    mutable uint32_t query_;
+};
+
+} // namespace rviz
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+/**
+ * \brief Recycles objects derived from MultiShape instead of destroying and re-creating them.
+ * acquire() hands out a shared pointer to an attached, visible instance. When the last reference is dropped, the
+ * instance is reset, detached from the scene graph and kept for the next acquire() as long as less than
+ * highWaterMark() instances are idle. Otherwise it is destroyed.
+ * The pool may be destroyed before the handed out instances, these are then destroyed on release.
+ * Like all Ogre objects, the pool and its instances may only be used from the render thread.
+ */
+template <typename T>
+class MultiShapePool {
+public:
+    using Factory = std::function<std::unique_ptr<T>(Ogre::SceneManager*)>;
+
+    /**
+     * \brief Create a pool and build prewarmCount idle instances.
+     * By default, instances are created with T(scene_manager). Use the factory to pass further arguments, e.g.
+     * [](Ogre::SceneManager* s) { return std::unique_ptr<SimpleCar>(new SimpleCar(s, NULL, true)); }
+     */
+    explicit MultiShapePool(Ogre::SceneManager* scene_manager,
+                            size_t prewarmCount = 0,
+                            size_t highWaterMark = std::numeric_limits<size_t>::max(),
+                            Factory factory = Factory())
+            : storage_(std::make_shared<Storage>()) {
+        storage_->scene_manager = scene_manager;
+        storage_->highWaterMark = highWaterMark;
+        storage_->factory = factory ? factory : [](Ogre::SceneManager* s) { return std::unique_ptr<T>(new T(s)); };
+        prewarm(prewarmCount);
+    }
+
+    /**
+     * \brief Get an instance attached to parent_node (the root scene node if NULL).
+     * The instance is visible and has the pose, scale, colors and user data of a newly constructed one.
+     */
+    std::shared_ptr<T> acquire(Ogre::SceneNode* parent_node = NULL) {
+        std::unique_ptr<T> obj;
+        if (storage_->idle.empty()) {
+            obj = create();
+        } else {
+            obj = std::move(storage_->idle.back());
+            storage_->idle.pop_back();
+        }
+        obj->attach(parent_node);
+        obj->visible(true);
+        return std::shared_ptr<T>(obj.release(), Releaser{storage_});
+    }
+
+    /**
+     * \brief Take over an instance that was created elsewhere, e.g. by util_rviz::prewarm().
+     * The instance is reset and kept idle like a released one, or destroyed if the high water mark is reached.
+     *
+     * @return Whether the instance was kept.
+     */
+    bool adopt(std::unique_ptr<T> obj) {
+        if (!obj || storage_->idle.size() >= storage_->highWaterMark) {
+            return false;
+        }
+        obj->reset();
+        obj->detach();
+        storage_->idle.push_back(std::move(obj));
+        return true;
+    }
+
+    /**
+     * \brief Build idle instances until at least count instances (but no more than the high water mark) are idle.
+     */
+    void prewarm(size_t count) {
+        count = std::min(count, storage_->highWaterMark);
+        storage_->idle.reserve(count);
+        while (storage_->idle.size() < count) {
+            storage_->idle.push_back(create());
+        }
+    }
+
+    /**
+     * \brief Set the maximum number of idle instances. Surplus idle instances are destroyed.
+     */
+    void setHighWaterMark(size_t highWaterMark) {
+        storage_->highWaterMark = highWaterMark;
+        if (storage_->idle.size() > highWaterMark) {
+            storage_->idle.resize(highWaterMark);
+        }
+    }
+
+    size_t highWaterMark() const {
+        return storage_->highWaterMark;
+    }
+
+    /**
+     * \brief Get the number of idle instances.
+     */
+    size_t idle() const {
+        return storage_->idle.size();
+    }
+
+    /**
+     * \brief Destroy all idle instances.
+     */
+    void clear() {
+        storage_->idle.clear();
+    }
+
+private:
+    struct Storage {
+        Ogre::SceneManager* scene_manager;
+        size_t highWaterMark;
+        Factory factory;
+        std::vector<std::unique_ptr<T>> idle;
+    };
+
+    struct Releaser {
+        std::weak_ptr<Storage> storage;
+
+        void operator()(T* obj) const {
+            std::unique_ptr<T> owned(obj);
+            std::shared_ptr<Storage> s = storage.lock();
+            if (s && s->idle.size() < s->highWaterMark) {
+                owned->reset();
+                owned->detach();
+                s->idle.push_back(std::move(owned));
+            }
+        }
+    };
+
+    std::unique_ptr<T> create() {
+        std::unique_ptr<T> obj = storage_->factory(storage_->scene_manager);
+        obj->reset();
+        obj->detach();
+        return obj;
+    }
+
+    std::shared_ptr<Storage> storage_;
+};
+
+} // namespace rviz
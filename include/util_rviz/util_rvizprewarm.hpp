@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+
+#include "util_rvizmaterials.hpp"
+#include "util_rvizshapes.hpp"
+
+
+namespace util_rviz {
+
+struct PrewarmOptions {
+    bool baked = false;                                 ///< Also build the baked meshes of the archetypes
+    size_t instancesPerArchetype = 0;                   ///< Number of hidden instances to build per archetype
+    Ogre::SceneNode* parent_node = NULL;                ///< Parent of the instances (the root scene node if NULL)
+    std::shared_ptr<rviz::MaterialCache> materialCache; ///< Cache to create the materials of colors in
+    std::vector<Ogre::ColourValue> colors;              ///< Colors to create materials for, needs materialCache
+};
+
+struct PrewarmResult {
+    struct Step {
+        std::string name;
+        double seconds;
+    };
+
+    std::vector<Step> steps;
+    /**
+     * \brief The hidden instances, in the order of rviz::Archetype. Hand them on (e.g. to MultiShapePool::adopt()) or drop them.
+     */
+    std::vector<std::unique_ptr<rviz::MultiShape>> instances;
+    /**
+     * \brief Handles to the materials of PrewarmOptions::colors. They stay in the cache as long as they are held.
+     */
+    std::vector<rviz::MaterialCache::Handle> materials;
+
+    double totalSeconds() const;
+
+    /**
+     * \brief Format the durations of the steps, e.g. "meshes: 12.3 ms, materials: 4.5 ms, total: 16.8 ms".
+     */
+    std::string toString() const;
+};
+
+/**
+ * \brief Load and create the resources that the first objects would otherwise create while drawing a frame.
+ * Loads the primitive meshes used by the archetypes, optionally builds their baked meshes, loads the base material
+ * and the materials of the given colors, and optionally builds hidden instances of each archetype. Meant to be called
+ * from the onInitialize() of a plugin, the result tells how long each step took.
+ * Like all Ogre objects, this may only be used from the render thread.
+ */
+PrewarmResult prewarm(Ogre::SceneManager* scene_manager, const PrewarmOptions& options = PrewarmOptions());
+
+} // namespace util_rviz
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizidindexmap.hpp"
+#include "util_rvizpool.hpp"
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+/**
+ * \brief The state of one object in a frame, see Reconciler.
+ */
+struct AgentState {
+    uint64_t id;
+    Archetype archetype;
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    Ogre::ColourValue color;
+    bool colorPartly; ///< Keep the black parts of cars black, see SimpleCar::setColorPartly()
+};
+
+/**
+ * \brief Keeps a set of MultiShapes in sync with the object list of each frame.
+ * apply() creates the objects of new ids, removes the objects whose ids are no longer listed and updates the others.
+ * Only changed properties are passed on to the objects. If the archetype of an id changes, its object is replaced by
+ * one of the new archetype, which takes over its pose, scale, visibility and user data. The archetypes are different
+ * classes, so the object itself can not be converted: Pointers from find() taken before still refer to the old object,
+ * which is returned to its pool when they are dropped. Call find() again after apply() to get the current object.
+ * Removed objects are returned to a MultiShapePool per archetype, which keeps up to setSpareLimit() of them for reuse.
+ * Objects that are still referenced elsewhere are only returned when the last reference is dropped.
+ */
+class Reconciler {
+public:
+    struct Result {
+        size_t added;
+        size_t updated;
+        size_t retyped;
+        size_t removed;
+    };
+
+    Reconciler(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL, bool baked = false);
+
+    /**
+     * \brief Make the set of objects match the given frame.
+     */
+    Result apply(const AgentState* agents, size_t count);
+    Result apply(const std::vector<AgentState>& agents) {
+        return apply(agents.data(), agents.size());
+    }
+
+    /**
+     * \brief Get the object of an id, or NULL.
+     * The object is replaced if apply() changes the archetype of the id, see the class description.
+     */
+    std::shared_ptr<MultiShape> find(uint64_t id) const;
+
+    /**
+     * \brief Call f(id, MultiShape&) for every object.
+     */
+    template <typename Function>
+    void forEach(Function&& f) const {
+        for (const auto& e : entries_) {
+            f(e.state.id, *e.shape);
+        }
+    }
+
+    void clear();
+    void setSpareLimit(size_t limit);
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+private:
+    struct Entry {
+        AgentState state; ///< As last applied
+        std::shared_ptr<MultiShape> shape;
+        uint64_t frame;
+    };
+
+    std::shared_ptr<MultiShape> acquire(Archetype archetype);
+    void applyColor(MultiShape& shape, const AgentState& agent);
+    void retype(Entry& entry, Archetype archetype);
+
+    Ogre::SceneNode* parent_node_;
+    uint64_t frame_;
+    std::vector<MultiShapePool<MultiShape>> pools_; ///< Indexed by Archetype
+    std::vector<Entry> entries_;
+    IdIndexMap indices_;
+};
+
+} // namespace rviz
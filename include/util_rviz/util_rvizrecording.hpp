@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ros/time.h>
+
+#include "util_rvizagentscene.hpp"
+
+
+namespace rviz {
+
+/*
+ * Recording file format (native byte order):
+ * A FileHeader followed by frames. Each frame is a FrameHeader, followed by `records` AgentRecords and `removed` agent
+ * ids (uint64_t). Keyframes contain all agents, the other frames only the agents that changed since the previous frame
+ * and the ids of the removed agents. All parts are multiples of 8 bytes, so that a mapped file can be read in place.
+ */
+namespace recording {
+
+struct FileHeader {
+    char magic[8]; ///< "URVZREC1"
+    uint32_t version;
+    uint32_t keyframeInterval;
+};
+
+struct FrameHeader {
+    enum Flags : uint32_t { Keyframe = 1 };
+    uint64_t stamp; ///< Nanoseconds
+    uint32_t flags;
+    uint32_t records;
+    uint32_t removed;
+    uint32_t reserved;
+};
+
+struct AgentRecord {
+    uint64_t id;
+    float position[3];
+    float orientation[4]; ///< w, x, y, z
+    float scale[3];
+    float color[4];
+    uint8_t archetype;
+    uint8_t visible;
+    uint8_t colorPartly;
+    uint8_t colorSet; ///< Whether color is valid, agents without a color keep the default colors of their shape
+    uint8_t reserved[4];
+};
+
+static_assert(sizeof(FileHeader) == 16, "Unexpected padding in FileHeader");
+static_assert(sizeof(FrameHeader) == 24, "Unexpected padding in FrameHeader");
+static_assert(sizeof(AgentRecord) == 72, "Unexpected padding in AgentRecord");
+
+} // namespace recording
+
+/**
+ * \brief Appends the state of an AgentScene (id, archetype, pose, scale, color if set, visibility) to a recording file.
+ * Every keyframeInterval-th frame is a keyframe, the others only contain the differences to the previous frame.
+ * Throws std::runtime_error if the file cannot be written.
+ */
+class SceneRecorder {
+public:
+    explicit SceneRecorder(const std::string& path, uint32_t keyframeInterval = 100);
+    ~SceneRecorder();
+    SceneRecorder(const SceneRecorder&) = delete;
+    SceneRecorder& operator=(const SceneRecorder&) = delete;
+
+    /**
+     * \brief Append the current state of the scene. Stamps have to be increasing.
+     */
+    void record(const ros::Time& stamp, const AgentScene& scene);
+
+    void flush();
+
+    size_t frameCount() const {
+        return frameCount_;
+    }
+
+private:
+    struct Previous {
+        recording::AgentRecord record;
+        uint64_t frame;
+    };
+
+    std::FILE* file_;
+    uint32_t keyframeInterval_;
+    uint64_t frameCount_;
+    std::unordered_map<uint64_t, Previous> previous_;
+    std::vector<char> buffer_;
+    std::vector<uint64_t> removed_;
+};
+
+/**
+ * \brief Restores the state of a recording at any time into an AgentScene.
+ * The file is memory mapped and indexed on construction. Seeking forward within the frames of a keyframe applies the
+ * recorded differences directly. Other seeks reconstruct the state from the preceding keyframe and only apply the
+ * differences to the current state of the scene. Call AgentScene::sync() afterwards to update the shapes.
+ * The player assumes that it is the only one adding and removing agents of the scene.
+ * Throws std::runtime_error if the file cannot be read.
+ */
+class ScenePlayer {
+public:
+    ScenePlayer(const std::string& path, AgentScene& scene);
+    ~ScenePlayer();
+    ScenePlayer(const ScenePlayer&) = delete;
+    ScenePlayer& operator=(const ScenePlayer&) = delete;
+
+    /**
+     * \brief Show the last frame recorded at or before the given time (the first frame for earlier times).
+     */
+    void seek(const ros::Time& stamp);
+
+    size_t frameCount() const {
+        return frames_.size();
+    }
+    ros::Time frameStamp(size_t frame) const;
+
+    /**
+     * \brief Get the currently shown frame, or -1 if none.
+     */
+    int64_t currentFrame() const {
+        return current_;
+    }
+
+private:
+    typedef std::unordered_map<uint64_t, recording::AgentRecord> State;
+
+    const recording::FrameHeader& header(size_t frame) const;
+    void applyFrame(size_t frame, State& state, bool toScene);
+    void applyRecord(const recording::AgentRecord& record);
+    void removeAgent(uint64_t id);
+
+    AgentScene& scene_;
+    const char* data_;
+    size_t size_;
+    std::vector<size_t> frames_;    ///< Offsets of the frames in the file
+    std::vector<size_t> keyframes_; ///< Index of the preceding keyframe of each frame
+    int64_t current_;
+    State state_;
+    std::unordered_map<uint64_t, AgentScene::Slot> slots_;
+};
+
+} // namespace rviz
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreVector3.h>
+
+#include "util_rvizcommands.hpp"
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+struct SchedulerSettings {
+    double budget{0.004};    ///< Seconds per frame to spend on applying updates
+    double maxAge{0.5};      ///< Updates pending for this many seconds are applied regardless of the budget
+    double ageScale{0.1};    ///< Waiting this many seconds halves the priority distance of an update
+    size_t minPerFrame{16};  ///< Updates applied per frame even if the budget is exceeded
+};
+
+/**
+ * \brief Applies pending updates of MultiShapes within a time budget per frame.
+ * Updates are collected per object, later writes to the same field replace earlier ones (see ShapeUpdate).
+ * apply() applies them closest to the camera first, with a priority that grows with the time an object has been
+ * waiting, and leaves the rest for the following frames. Updates that waited for SchedulerSettings::maxAge are applied
+ * in any case, so every update is applied eventually.
+ * Updates of destroyed objects are dropped automatically. Like all Ogre objects, the scheduler may only be used from
+ * the render thread; use a ShapeCommandQueue to pass updates from other threads.
+ */
+class UpdateScheduler : private MultiShape::DestructionListener {
+public:
+    struct FrameStatistics {
+        size_t applied{0};
+        size_t overdue{0};    ///< Applied because they reached maxAge, included in applied
+        size_t deferred{0};   ///< Left for the next frames
+        double seconds{0.};   ///< Time spent in apply()
+        double maxAge{0.};    ///< Longest wait of the deferred updates, in seconds
+        double meanAge{0.};   ///< Mean wait of the deferred updates, in seconds
+    };
+
+    explicit UpdateScheduler(const SchedulerSettings& settings = SchedulerSettings());
+    ~UpdateScheduler() override;
+    UpdateScheduler(const UpdateScheduler&) = delete;
+    UpdateScheduler& operator=(const UpdateScheduler&) = delete;
+
+    void setPosition(MultiShape* obj, const Ogre::Vector3& position);
+    void setOrientation(MultiShape* obj, const Ogre::Quaternion& orientation);
+    void setColor(MultiShape* obj, const Ogre::ColourValue& c);
+    void setColorPartly(MultiShape* obj, const Ogre::ColourValue& c);
+    void visible(MultiShape* obj, bool visible);
+
+    /**
+     * \brief Merge the written fields of an update, e.g. one drained from a ShapeCommandQueue, into the pending update
+     * of the object.
+     */
+    void schedule(MultiShape* obj, const ShapeUpdate& update);
+
+    /**
+     * \brief Drop the pending update of the object, e.g. before it is returned to a pool.
+     */
+    void remove(MultiShape* obj);
+
+    void clear();
+
+    /**
+     * \brief Apply pending updates within the budget. The eye position has to be in the frame of the objects' parent.
+     */
+    const FrameStatistics& apply(const Ogre::Vector3& eye);
+
+    /**
+     * \brief Apply all pending updates.
+     */
+    void flush();
+
+    size_t pending() const {
+        return pending_.size();
+    }
+
+    const FrameStatistics& lastFrame() const {
+        return lastFrame_;
+    }
+
+    const SchedulerSettings& settings() const {
+        return settings_;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Pending {
+        MultiShape* obj;
+        ShapeUpdate update;
+        Clock::time_point since; ///< Of the first write that is not applied yet
+    };
+
+    void objectDestroyed(MultiShape* obj) override;
+    ShapeUpdate& pendingUpdate(MultiShape* obj);
+
+    SchedulerSettings settings_;
+    std::vector<Pending> pending_;
+    std::unordered_map<const MultiShape*, size_t> pendingIndices_;
+    std::vector<std::pair<double, uint32_t>> order_; ///< Priority and index, reused between frames
+    std::vector<char> applied_;
+    FrameStatistics lastFrame_;
+};
+
+} // namespace rviz
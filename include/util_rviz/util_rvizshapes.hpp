@@ -31,21 +31,31 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <OGRE/OgreAny.h>
+#include <OGRE/OgreAxisAlignedBox.h>
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreEntity.h>
 #include <OGRE/OgreMaterial.h>
 #include <OGRE/OgreQuaternion.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreSceneNode.h>
 #include <OGRE/OgreSharedPtr.h>
+#include <OGRE/OgreSubEntity.h>
 #include <OGRE/OgreVector3.h>
 #include <rviz/ogre_helpers/object.h>
 #include <rviz/ogre_helpers/shape.h>
 
 #include "util_rviz.hpp"
+#include "util_rvizfootprint.hpp"
+#include "util_rvizmaterials.hpp"
 
 
 namespace Ogre {
@@ -61,11 +71,70 @@ class Entity;
 namespace rviz {
 typedef std::vector<std::shared_ptr<Shape>> shape_vector;
 
+/**
+ * \brief Geometric description of one primitive of a MultiShape.
+ * The transform matches the one of rviz::Shape: The offset is applied in the scaled frame of the primitive.
+ */
+struct ShapeDescription {
+    enum ColorGroup { Colored = 0, Black = 1 };
+
+    Shape::Type type;
+    Ogre::Vector3 scale;
+    Ogre::Vector3 position;
+    Ogre::Vector3 offset;
+    Ogre::Quaternion orientation;
+    ColorGroup group;
+};
+typedef std::vector<ShapeDescription> shape_description_vector;
+
+/**
+ * The last applied pose, scale, color and visibility are cached. Calls that would not change anything (within the
+ * change epsilon) return without touching Ogre.
+ */
 class MultiShape : public Object {
 public:
+    /**
+     * \brief Flags for the properties that were changed, see dirtyFlags().
+     */
+    enum DirtyFlag : uint32_t {
+        DirtyPosition = 1 << 0,
+        DirtyOrientation = 1 << 1,
+        DirtyScale = 1 << 2,
+        DirtyColor = 1 << 3,
+        DirtyVisibility = 1 << 4,
+        DirtyAll = DirtyPosition | DirtyOrientation | DirtyScale | DirtyColor | DirtyVisibility
+    };
+
+    /**
+     * \brief Levels of detail, see setLodLevel().
+     */
+    enum LodLevel { LodFull = 0, LodReduced = 1, LodBox = 2, LodHidden = 3 };
+
+    /**
+     * \brief Notified whenever a MultiShape is destroyed, e.g. to drop the pointers to it. See addDestructionListener().
+     */
+    class DestructionListener {
+    public:
+        virtual ~DestructionListener() = default;
+
+        /**
+         * \brief Called at the beginning of the destructor of MultiShape, when the parts of the object still exist.
+         * The destructors of derived classes have already run, so virtual methods of obj must not be called.
+         */
+        virtual void objectDestroyed(MultiShape* obj) = 0;
+    };
+
     MultiShape(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL);
     virtual ~MultiShape();
 
+    /**
+     * \brief Notify the listener whenever a MultiShape is destroyed, until it is removed again.
+     * Listeners have to be removed before they are destroyed. Like all Ogre objects, MultiShapes and their listeners may
+     * only be used from the render thread.
+     */
+    static void addDestructionListener(DestructionListener* listener);
+    static void removeDestructionListener(DestructionListener* listener);
+
     // overrides from rviz:Object
 
     /**
@@ -105,6 +174,37 @@ public:
      */
     virtual void setUserData(const Ogre::Any& data);
 
+    /**
+     * \brief Get the user data that was last set.
+     */
+    const Ogre::Any& getUserData() const {
+        return userData_;
+    }
+
+    /**
+     * \brief Use shared materials from the cache instead of the private materials of the shapes.
+     * Colors are then applied by swapping the entities to the cached material of that color. Pass NULL to switch
+     * back to the private materials. The current colors are kept in both cases.
+     */
+    void setMaterialCache(const std::shared_ptr<MaterialCache>& cache);
+
+    /**
+     * \brief Attach the root scene node of this object to a parent node (the root scene node if NULL).
+     * If it is already attached, it is detached from its current parent first.
+     */
+    void attach(Ogre::SceneNode* parent_node = NULL);
+
+    /**
+     * \brief Detach the root scene node of this object from its parent.
+     * The object is kept alive but is no longer part of the scene graph.
+     */
+    void detach();
+
+    /**
+     * \brief Hide this object and restore the pose, scale, colors and user data it had after construction.
+     */
+    virtual void reset();
+
     /**
      * \brief Get the position of the scene node for this object.
      *
@@ -137,6 +237,107 @@ public:
         return &shapes_;
     }
 
+    /**
+     * \brief Get the properties that were changed since the last call to clearDirtyFlags().
+     *
+     * @return A combination of DirtyFlag values.
+     */
+    uint32_t dirtyFlags() const {
+        return dirtyFlags_;
+    }
+
+    /**
+     * \brief Reset the dirty flags, e.g. once per frame after all changes have been processed.
+     */
+    void clearDirtyFlags() {
+        dirtyFlags_ = 0;
+    }
+
+    /**
+     * \brief Get a counter that is incremented whenever the pose, scale, color, visibility or level of detail changes.
+     * Unlike the dirty flags, it is not reset, so that several observers can track changes independently.
+     */
+    uint32_t revision() const {
+        return revision_;
+    }
+
+    /**
+     * \brief Set the tolerance below which a new pose, scale or color is considered unchanged.
+     * Each component is compared separately. Default: 1e-5.
+     */
+    void setChangeEpsilon(float epsilon) {
+        changeEpsilon_ = epsilon;
+    }
+
+    /**
+     * \brief Get the color that was last set, or NULL if no color was set since construction or reset().
+     */
+    const Ogre::ColourValue* getColor() const {
+        return colorMode_ == ColorMode::Unset ? NULL : &color_;
+    }
+
+    /**
+     * \brief Get whether the object was last set visible.
+     */
+    bool isVisible() const {
+        return visible_;
+    }
+
+    /**
+     * \brief Show this object in the given level of detail.
+     * LodReduced hides the parts of the black color group (e.g. the wheels), LodBox replaces all parts by a single box
+     * around them and LodHidden hides everything. Colors and user data are kept consistent across all levels.
+     * The level of detail is independent of visible().
+     */
+    void setLodLevel(LodLevel level);
+
+    LodLevel getLodLevel() const {
+        return lodLevel_;
+    }
+
+    /**
+     * \brief Get the bounding box of all parts of this object in the frame of its scene node (without scale).
+     */
+    Ogre::AxisAlignedBox getLocalBounds() const;
+
+    /**
+     * \brief Whether the geometry of this object is merged into a single entity.
+     * Baked objects have no shapes, all queries refer to the single entity and its materials.
+     */
+    bool isBaked() const {
+        return baked_;
+    }
+
+    /**
+     * \brief Whether the entities and materials of this object exist.
+     * Lazy objects (see ArchetypeShape) only record their state until they are made visible for the first time. Until
+     * then, and after dematerialize(), they have no shapes, entities or materials. Their scene node always exists and
+     * holds the pose and scale. In LodBox and LodHidden they are not materialized either, LodBox only creates the box.
+     */
+    bool isMaterialized() const {
+        return materialized_;
+    }
+
+    /**
+     * \brief Create the entities and materials of this object, with the recorded colors and user data.
+     * Called automatically when the object is made visible in LodFull or LodReduced.
+     */
+    void materialize();
+
+    /**
+     * \brief Destroy the entities and materials of this object (including the box of LodBox), keeping its state. They
+     * are created again when the object is made visible. Has no effect on objects that were not created from
+     * descriptions.
+     */
+    void dematerialize();
+
+    /**
+     * \brief Dematerialize the object if it has been hidden (visible(false)) for at least the given time.
+     *
+     * @return Whether the object was dematerialized.
+     */
+    bool dematerializeIfHidden(double seconds);
+
     /**
      * \brief Get a vector of all entities owned by this object.
      * Calls the shape's getEntity() method.
@@ -161,36 +362,469 @@ public:
      */
     virtual std::vector<Shape::Type> getTypes();
 
+    /**
+     * \brief Estimate the resources held by this object, see footprint::report() for all objects.
+     * Shared meshes are not included.
+     */
+    virtual Footprint footprint() const;
+
+    /**
+     * \brief Get the name under which this object is reported, e.g. "Car" for a SimpleCar.
+     */
+    virtual const char* archetypeName() const {
+        return "MultiShape";
+    }
+
+    /**
+     * \brief Call f(Ogre::Entity*) for every entity owned by this object.
+     * Unlike getEntities(), this does not allocate.
+     */
+    template <typename Function>
+    void forEachEntity(Function&& f) const {
+        for (const auto& s : shapes_) {
+            f(s->getEntity());
+        }
+        if (bakedEntity_) {
+            f(bakedEntity_);
+        }
+        if (lodProxy_) {
+            f(lodProxy_->getEntity());
+        }
+    }
+
+    /**
+     * \brief Call f(const Ogre::MaterialPtr&) for every material used by the entities of this object.
+     * Unlike getMaterials(), this neither allocates nor copies the material pointers.
+     */
+    template <typename Function>
+    void forEachMaterial(Function&& f) const {
+        forEachEntity([&f](Ogre::Entity* e) {
+            for (unsigned int i = 0; i < e->getNumSubEntities(); ++i) {
+                f(e->getSubEntity(i)->getMaterial());
+            }
+        });
+    }
+
+    /**
+     * \brief Call f(Shape::Type) for the type of every entity owned by this object.
+     * Unlike getTypes(), this does not allocate.
+     */
+    template <typename Function>
+    void forEachType(Function&& f) const {
+        for (const auto& s : shapes_) {
+            f(s->getType());
+        }
+        if (bakedEntity_) {
+            f(Shape::Mesh);
+        }
+        if (lodProxy_) {
+            f(lodProxy_->getType());
+        }
+    }
+
 protected:
+    /**
+     * \brief Create the geometry of this object from the given descriptions.
+     * If baked is false, one rviz::Shape is created per description. Otherwise all descriptions are merged into one
+     * mesh that is shared by all objects using the same bakedMeshName, and a single entity with one material per
+     * color group is attached to the scene node.
+     *
+     * @return The created shapes in the order of the descriptions (empty if baked).
+     */
+    shape_vector createShapes(const shape_description_vector& descriptions,
+                              const std::string& bakedMeshName,
+                              bool baked);
+
+    /**
+     * \brief Set the geometry of this object, see createShapes().
+     * If lazy, the object is hidden and its geometry is only created once it is made visible.
+     */
+    void defineShapes(const shape_description_vector& descriptions,
+                      const std::string& bakedMeshName,
+                      bool baked,
+                      bool lazy);
+
+    /**
+     * \brief Called after the shapes were created or destroyed by materialize() or dematerialize().
+     */
+    virtual void shapesChanged() {
+    }
+
+    /**
+     * \brief Set the color of all parts of this object that were created in the given color group.
+     */
+    void setGroupColor(ShapeDescription::ColorGroup group, const Ogre::ColourValue& c);
+
+    /**
+     * \brief Apply a color to all parts of this object (if allGroups) or to the parts of one color group.
+     * Does not update the color cache.
+     */
+    void applyColor(const Ogre::ColourValue& c, bool allGroups, ShapeDescription::ColorGroup group);
+
+    /**
+     * \brief Apply the cached color again, e.g. after the materials were exchanged.
+     */
+    void reapplyColor();
+
+    /**
+     * \brief Show and hide the parts of this object according to the level of detail.
+     * Has to be called whenever the scene node was made visible, as this shows all parts.
+     */
+    void applyLodVisibility();
+
+    /**
+     * \brief Materialize the parts that the level of detail shows.
+     */
+    void materializeLodLevel();
+
+    /**
+     * \brief Restore the colors this object had after construction.
+     */
+    virtual void resetColor();
+
+    enum class ColorMode { Unset, All, Partly };
+
+    /**
+     * \brief Update the cached color if applying c in the given mode would change anything.
+     *
+     * @return false if the color was already applied in this mode.
+     */
+    bool updateColorCache(const Ogre::ColourValue& c, ColorMode mode);
+
+    void markDirty(uint32_t flags) {
+        dirtyFlags_ |= flags;
+        ++revision_;
+    }
+
     Ogre::SceneNode* scene_node_;
     shape_vector shapes_;
+    shape_description_vector descriptions_; ///< Descriptions of the created shapes, in the order of shapes_
+    std::string bakedMeshName_;
+    bool baked_;
+    bool materialized_;
+    std::chrono::steady_clock::time_point hiddenSince_;
+    Ogre::Entity* bakedEntity_;
+    std::vector<Ogre::MaterialPtr> bakedMaterials_;
+    std::vector<ShapeDescription::ColorGroup> bakedGroups_;
+    std::shared_ptr<MaterialCache> materialCache_;
+    std::vector<MaterialCache::Handle> sharedMaterials_; ///< Indexed like shapes_, followed by the baked sub entities
+
+    float changeEpsilon_;
+    uint32_t dirtyFlags_;
+    uint32_t revision_;
+    bool visible_;
+    ColorMode colorMode_;
+    Ogre::ColourValue color_;
+
+    std::shared_ptr<Shape> lodProxy_; ///< Box for LodBox, created on first use
+    MaterialCache::Handle lodProxyMaterial_;
+    LodLevel lodLevel_;
+    Ogre::Any userData_;
+};
+
+/**
+ * \brief Compile-time description of one primitive, see ShapeDescription.
+ */
+struct PrimitiveDescriptor {
+    struct Vector {
+        float x, y, z;
+    };
+    struct Rotation {
+        float w, x, y, z;
+    };
+
+    Shape::Type type;
+    Vector scale;
+    Vector position;
+    Vector offset;
+    Rotation orientation;
+    ShapeDescription::ColorGroup group;
+
+    ShapeDescription toShapeDescription() const {
+        return ShapeDescription{type,
+                                Ogre::Vector3(scale.x, scale.y, scale.z),
+                                Ogre::Vector3(position.x, position.y, position.z),
+                                Ogre::Vector3(offset.x, offset.y, offset.z),
+                                Ogre::Quaternion(orientation.w, orientation.x, orientation.y, orientation.z),
+                                group};
+    }
 };
 
-class SimpleCar : public MultiShape {
+/**
+ * \brief Object built from a compile-time table of primitives.
+ * A descriptor provides a unique name() and a constexpr primitives() table, e.g.
+ * \code
+ * struct TruckDescriptor {
+ *     static const char* name() { return "Truck"; }
+ *     static constexpr std::array<PrimitiveDescriptor, 1> primitives() {
+ *         return {{{Shape::Cube, {8, 2.5, 3}, {0, 0, 1.5}, {0, 0, 0}, {1, 0, 0, 0}, ShapeDescription::Colored}}};
+ *     }
+ * };
+ * \endcode
+ * The table is converted once per descriptor, so constructing an object is a loop over the table.
+ * Lazy objects start hidden and create their entities and materials only when they are made visible for the first time,
+ * see MultiShape::isMaterialized().
+ */
+template <typename Descriptor>
+class ArchetypeShape : public MultiShape {
 public:
-    SimpleCar(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL);
+    ArchetypeShape(Ogre::SceneManager* scene_manager,
+                   Ogre::SceneNode* parent_node = NULL,
+                   bool baked = false,
+                   bool lazy = false)
+            : MultiShape(scene_manager, parent_node) {
+        defineShapes(descriptions(), std::string("UtilRvizBaked") + Descriptor::name(), baked, lazy);
+        util_rviz::stats::constructed(statsId());
+    }
+    ~ArchetypeShape() override {
+        util_rviz::stats::destroyed(statsId());
+    }
+
+    const char* archetypeName() const override {
+        return Descriptor::name();
+    }
+
+    /**
+     * \brief Get the descriptions of the primitives of this archetype.
+     */
+    static const shape_description_vector& descriptions() {
+        static const shape_description_vector descriptions = [] {
+            shape_description_vector d;
+            for (const auto& p : Descriptor::primitives()) {
+                d.push_back(p.toShapeDescription());
+            }
+            return d;
+        }();
+        return descriptions;
+    }
+
+private:
+    static size_t statsId() {
+        static const size_t id = util_rviz::stats::archetypeId(Descriptor::name());
+        return id;
+    }
+};
+
+namespace archetypes {
+constexpr PrimitiveDescriptor::Vector noOffset{0.f, 0.f, 0.f};
+constexpr PrimitiveDescriptor::Rotation noRotation{1.f, 0.f, 0.f, 0.f};
+// The primitive cylinder is aligned with the y axis, this rotates it upright: sqrt(0.5) around x
+constexpr PrimitiveDescriptor::Rotation upright{0.70710678f, 0.70710678f, 0.f, 0.f};
+
+constexpr float pedestrianHeight = 1.6f;
+constexpr float pedestrianWidth = 0.7f;
+constexpr PrimitiveDescriptor pedestrianCorpus{Shape::Cylinder,
+                                               {pedestrianWidth, pedestrianHeight, pedestrianWidth},
+                                               {0.f, 0.f, pedestrianHeight / 2.f},
+                                               noOffset,
+                                               upright,
+                                               ShapeDescription::Colored};
+constexpr PrimitiveDescriptor pedestrianHead{Shape::Sphere,
+                                             {pedestrianWidth, pedestrianWidth, pedestrianWidth},
+                                             {0.f, 0.f, pedestrianHeight + pedestrianWidth / 2.f},
+                                             noOffset,
+                                             noRotation,
+                                             ShapeDescription::Colored};
+
+// Wheel with the given diameter and width, placed at (x, y) on the ground. The offset is in the scaled frame.
+constexpr PrimitiveDescriptor wheel(float diameter, float width, float x, float y) {
+    return PrimitiveDescriptor{Shape::Cylinder,
+                               {diameter, width, diameter},
+                               {0.f, 0.f, diameter / 2.f},
+                               {x / diameter, y / width, 0.f},
+                               noRotation,
+                               ShapeDescription::Black};
+}
+} // namespace archetypes
+
+struct CarDescriptor {
+    static constexpr float wheelDiameter = 0.8f;
+    static constexpr float wheelWidth = 0.4f;
+    static constexpr float wheelBase = 2.8f;
+    static constexpr float bodyLength = 4.f;
+    static constexpr float bodyWidth = 1.8f;
+    static constexpr float bodyHeight = 0.8f;
+    static constexpr float cabinLength = 2.f;
+    static constexpr float cabinHeight = 0.8f;
+
+    static const char* name() {
+        return "SimpleCar";
+    }
+    // Black shapes first
+    static constexpr std::array<PrimitiveDescriptor, 6> primitives() {
+        return {{archetypes::wheel(wheelDiameter, wheelWidth, wheelBase / 2.f, -bodyWidth / 2.f),
+                 archetypes::wheel(wheelDiameter, wheelWidth, wheelBase / 2.f, bodyWidth / 2.f),
+                 archetypes::wheel(wheelDiameter, wheelWidth, -wheelBase / 2.f, -bodyWidth / 2.f),
+                 archetypes::wheel(wheelDiameter, wheelWidth, -wheelBase / 2.f, bodyWidth / 2.f),
+                 {Shape::Cylinder,
+                  {bodyLength, bodyWidth, bodyHeight},
+                  {0.f, 0.f, bodyHeight / 2.f + wheelDiameter / 2.f},
+                  archetypes::noOffset,
+                  archetypes::noRotation,
+                  ShapeDescription::Colored},
+                 {Shape::Cube,
+                  {cabinLength, bodyWidth, cabinHeight},
+                  {0.f, 0.f, bodyHeight + cabinHeight / 2.f + wheelDiameter / 2.f},
+                  archetypes::noOffset,
+                  archetypes::noRotation,
+                  ShapeDescription::Colored}}};
+    }
+};
+
+struct BikeDescriptor {
+    static constexpr float wheelDiameter = 1.4f;
+    static constexpr float wheelWidth = 0.7f;
+    static constexpr float wheelBase = 2.8f;
+    // (length, width, height)
+    static constexpr float frameLength = 3.f;
+    static constexpr float frameWidth = 0.6f;
+    static constexpr float frameHeight = 0.8f;
+
+    static const char* name() {
+        return "SimpleBike";
+    }
+    static constexpr std::array<PrimitiveDescriptor, 5> primitives() {
+        return {{{Shape::Cylinder,
+                  {frameLength, frameWidth, frameHeight},
+                  {0.f, 0.f, frameHeight / 2.f + wheelDiameter / 2.f},
+                  archetypes::noOffset,
+                  archetypes::noRotation,
+                  ShapeDescription::Colored},
+                 archetypes::wheel(wheelDiameter, wheelWidth, wheelBase / 2.f, 0.f),
+                 archetypes::wheel(wheelDiameter, wheelWidth, -wheelBase / 2.f, 0.f),
+                 archetypes::pedestrianCorpus,
+                 archetypes::pedestrianHead}};
+    }
+};
+
+struct PedestrianDescriptor {
+    static const char* name() {
+        return "SimplePedestrian";
+    }
+    static constexpr std::array<PrimitiveDescriptor, 2> primitives() {
+        return {{archetypes::pedestrianCorpus, archetypes::pedestrianHead}};
+    }
+};
+
+struct UnknownDescriptor {
+    static constexpr float size = 1.f;
+
+    static const char* name() {
+        return "SimpleUnknown";
+    }
+    static constexpr std::array<PrimitiveDescriptor, 1> primitives() {
+        return {{{Shape::Cube,
+                  {size, size, size},
+                  {0.f, 0.f, size / 2.f},
+                  archetypes::noOffset,
+                  archetypes::noRotation,
+                  ShapeDescription::Colored}}};
+    }
+};
+
+/**
+ * All archetypes can optionally be baked: Their primitives are merged into a mesh that is shared by all instances, so
+ * that each instance consists of a single entity. Colors behave the same way in both modes.
+ * All archetypes can optionally be lazy, see ArchetypeShape.
+ */
+class SimpleCar : public ArchetypeShape<CarDescriptor> {
+public:
+    SimpleCar(Ogre::SceneManager* scene_manager,
+              Ogre::SceneNode* parent_node = NULL,
+              bool baked = false,
+              bool lazy = false);
     void setColorPartly(float r, float g, float b, float a);
     void setColorPartly(const Ogre::ColourValue& c);
 
+    Footprint footprint() const override;
+
 protected:
+    /**
+     * \brief Rebuild shapes_ from blackShapes_ followed by coloredShapes_, e.g. after a subclass added shapes to them.
+     * Shapes that were not created from CarDescriptor are described by their type and pose with unit scale, so that
+     * they are colored and shown in the levels of detail like the other shapes of their group.
+     */
     void renewShapesVec();
+
+    void shapesChanged() override;
     shape_vector coloredShapes_;
     shape_vector blackShapes_;
 };
 
-class SimplePedestrian : public MultiShape {
+class SimplePedestrian : public ArchetypeShape<PedestrianDescriptor> {
 public:
-    SimplePedestrian(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL);
+    SimplePedestrian(Ogre::SceneManager* scene_manager,
+                     Ogre::SceneNode* parent_node = NULL,
+                     bool baked = false,
+                     bool lazy = false);
 };
 
-class SimpleBike : public MultiShape {
+class SimpleBike : public ArchetypeShape<BikeDescriptor> {
 public:
-    SimpleBike(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL);
+    SimpleBike(Ogre::SceneManager* scene_manager,
+               Ogre::SceneNode* parent_node = NULL,
+               bool baked = false,
+               bool lazy = false);
 };
 
-class SimpleUnknown : public MultiShape {
+class SimpleUnknown : public ArchetypeShape<UnknownDescriptor> {
 public:
-    SimpleUnknown(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node = NULL);
+    SimpleUnknown(Ogre::SceneManager* scene_manager,
+                  Ogre::SceneNode* parent_node = NULL,
+                  bool baked = false,
+                  bool lazy = false);
 };
 
+/**
+ * \brief The archetypes provided by this library.
+ */
+enum class Archetype : uint8_t { Car, Bike, Pedestrian, Unknown };
+
+/**
+ * \brief Create an object of the given archetype, e.g. a SimpleCar for Archetype::Car.
+ */
+std::unique_ptr<MultiShape> createArchetype(Archetype archetype,
+                                            Ogre::SceneManager* scene_manager,
+                                            Ogre::SceneNode* parent_node = NULL,
+                                            bool baked = false,
+                                            bool lazy = false);
+
+/**
+ * \brief Append the entities of all objects in [first, last) to entities.
+ * The iterators have to point to (smart) pointers to MultiShapes. The buffer is not cleared, so that its capacity can
+ * be reused between frames.
+ */
+template <typename Iterator>
+void collectEntities(Iterator first, Iterator last, std::vector<Ogre::Entity*>& entities) {
+    for (; first != last; ++first) {
+        (*first)->forEachEntity([&entities](Ogre::Entity* e) { entities.push_back(e); });
+    }
+}
+
+/**
+ * \brief Append the materials of all objects in [first, last) to materials, see collectEntities().
+ * Raw pointers are collected to avoid touching the reference counts of the materials.
+ */
+template <typename Iterator>
+void collectMaterials(Iterator first, Iterator last, std::vector<Ogre::Material*>& materials) {
+    for (; first != last; ++first) {
+        (*first)->forEachMaterial([&materials](const Ogre::MaterialPtr& m) { materials.push_back(m.get()); });
+    }
+}
+
+/**
+ * \brief Dematerialize all objects in [first, last) that have been hidden for at least the given time, see
+ * MultiShape::dematerializeIfHidden(). Meant to be called periodically, e.g. once per second.
+ *
+ * @return The number of dematerialized objects.
+ */
+template <typename Iterator>
+size_t dematerializeHidden(Iterator first, Iterator last, double seconds) {
+    size_t count = 0;
+    for (; first != last; ++first) {
+        count += (*first)->dematerializeIfHidden(seconds);
+    }
+    return count;
+}
+
 } // namespace rviz
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <OGRE/OgreFrustum.h>
+#include <OGRE/OgreNode.h>
+#include <OGRE/OgreVector2.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+/**
+ * \brief Loose uniform grid over MultiShapes on the XY plane.
+ * Objects are sorted into cells by the position of their scene node (getPosition(), i.e. in the frame of their parent
+ * node) and their bounding radius. All registered objects should share the same parent frame.
+ * The index does not observe the objects, tracking their poses is left to the caller: Call update() for an object
+ * after moving it (e.g. for the objects with MultiShape::DirtyPosition set), or updateAll() once per frame. Both only
+ * touch the grid if the object changed its cell. Until then, queries use the cell of the previous update.
+ */
+class SpatialIndex {
+public:
+    explicit SpatialIndex(float cellSize = 20.f);
+
+    /**
+     * \brief Register an object with the given bounding radius.
+     */
+    void insert(MultiShape* obj, float radius);
+
+    /**
+     * \brief Register an object, using the distance from its origin to the farthest corner of its local bounds (see
+     * MultiShape::getLocalBounds()) as radius.
+     */
+    void insert(MultiShape* obj);
+
+    void remove(MultiShape* obj);
+    void clear();
+
+    /**
+     * \brief Move the object to the cell of its current position.
+     */
+    void update(MultiShape* obj);
+
+    /**
+     * \brief Move all objects to the cells of their current positions.
+     */
+    void updateAll();
+
+    /**
+     * \brief Append all objects that overlap the rectangle [min, max] to result.
+     */
+    void queryRegion(const Ogre::Vector2& min, const Ogre::Vector2& max, std::vector<MultiShape*>& result) const;
+
+    /**
+     * \brief Append all objects whose bounding sphere intersects the frustum to result.
+     * frame is the parent node of the objects, used to transform them into world coordinates (NULL for the world).
+     */
+    void queryFrustum(const Ogre::Frustum& frustum, const Ogre::Node* frame, std::vector<MultiShape*>& result) const;
+
+    /**
+     * \brief Make all objects overlapping the rectangle [min, max] visible and hide all others.
+     */
+    void cullOutside(const Ogre::Vector2& min, const Ogre::Vector2& max);
+
+    size_t size() const {
+        return items_.size();
+    }
+
+    /**
+     * \brief Get the largest radius of the registered objects, by which all queries are extended.
+     */
+    float maxRadius() const {
+        return maxRadius_;
+    }
+
+private:
+    struct Item {
+        MultiShape* obj;
+        float radius;
+        int64_t cell;
+    };
+
+    int32_t cellCoordinate(float v) const;
+    int64_t cellOf(MultiShape* obj) const;
+    void removeFromCell(int64_t cell, size_t item);
+
+    template <typename Function>
+    void forEachCandidate(const Ogre::Vector2& min, const Ogre::Vector2& max, Function&& f) const;
+
+    float cellSize_;
+    float maxRadius_;
+    size_t maxRadiusCount_; ///< Number of objects with maxRadius_, it is only recomputed when the last one is removed
+    std::vector<Item> items_;
+    std::unordered_map<const MultiShape*, size_t> itemIndices_;
+    std::unordered_map<int64_t, std::vector<size_t>> cells_;
+};
+
+} // namespace rviz
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <OGRE/OgreEntity.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreStaticGeometry.h>
+#include <OGRE/OgreVector3.h>
+#include <ros/time.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+struct StaticBatchSettings {
+    double stationaryTime{5.0}; ///< Seconds without any change after which an object is batched
+    float cellSize{50.f};       ///< Edge length of the square regions that are rebuilt as a whole
+};
+
+/**
+ * \brief Moves stationary MultiShapes into Ogre::StaticGeometry, one per region of a grid on the XY plane.
+ * An object is batched once its revision() has not changed for stationaryTime, or on the next update() after
+ * setStationary(). Its entities are copied into the static geometry of its region and its scene node is detached from
+ * the scene graph, so that it no longer costs a node update and a draw call per part. As soon as it changes (pose,
+ * scale, color, visibility or level of detail), it is attached again and only its region is rebuilt.
+ * Objects with the same materials are drawn together, so batching pays off most with a shared MaterialCache.
+ * All changes are detected by update(), which has to be called every frame before rendering. Objects are removed
+ * automatically when they are destroyed.
+ */
+class StaticBatcher : private MultiShape::DestructionListener {
+public:
+    explicit StaticBatcher(Ogre::SceneManager* scene_manager,
+                           const StaticBatchSettings& settings = StaticBatchSettings());
+    ~StaticBatcher() override;
+    StaticBatcher(const StaticBatcher&) = delete;
+    StaticBatcher& operator=(const StaticBatcher&) = delete;
+
+    void add(MultiShape* obj);
+
+    /**
+     * \brief Stop tracking the object and attach it again, if it was batched.
+     */
+    void remove(MultiShape* obj);
+    void clear();
+
+    /**
+     * \brief Hint that the object will not change for a while, so that it is batched on the next update().
+     */
+    void setStationary(MultiShape* obj);
+
+    /**
+     * \brief Unbatch changed objects, batch stationary ones and rebuild the regions whose objects changed.
+     */
+    void update(const ros::Time& stamp);
+
+    bool isBatched(const MultiShape* obj) const;
+
+    size_t size() const {
+        return items_.size();
+    }
+    size_t batchedCount() const {
+        return batchedCount_;
+    }
+
+private:
+    struct Part {
+        Ogre::Entity* entity;
+        Ogre::Vector3 position;
+        Ogre::Quaternion orientation;
+        Ogre::Vector3 scale;
+    };
+
+    struct Item {
+        MultiShape* obj;
+        uint32_t revision;
+        ros::Time since;
+        bool hint;
+        bool batched;
+        int64_t cell;
+        Ogre::SceneNode* parent;
+        std::vector<Part> parts; ///< World transforms of the visible entities, taken when batching
+    };
+
+    struct Region {
+        Ogre::StaticGeometry* geometry;
+        std::vector<size_t> items;
+        bool dirty;
+    };
+
+    void objectDestroyed(MultiShape* obj) override;
+    void erase(MultiShape* obj, bool reattach);
+    bool batchable(MultiShape* obj) const;
+    void batch(size_t index);
+    void unbatch(size_t index, bool reattach = true);
+    void rebuild(Region& region);
+
+    Ogre::SceneManager* scene_manager_;
+    StaticBatchSettings settings_;
+    std::string name_;
+    size_t batchedCount_;
+    std::vector<Item> items_;
+    std::unordered_map<const MultiShape*, size_t> itemIndices_;
+    std::unordered_map<int64_t, Region> regions_;
+};
+
+} // namespace rviz
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace util_rviz {
+namespace stats {
+
+/**
+ * \brief Event counters of the update paths.
+ * Counts are aggregated per thread without synchronization and only summed up by snapshot(). Define
+ * UTIL_RVIZ_DISABLE_STATS to compile all counting away.
+ */
+enum Counter {
+    PositionApplied,
+    PositionRejectedNonFinite, ///< NaN or infinite
+    PositionRejectedNull,      ///< Counted for every quantity of an update of a NULL object
+    OrientationApplied,
+    OrientationRejectedNonFinite,
+    OrientationRejectedNull,
+    ScaleApplied,
+    ScaleRejectedNonFinite,
+    ScaleRejectedNull,
+    PosesApplied,  ///< Bulk updates by setPosesSafely, counted per object
+    PosesRejected, ///< Bulk updates by setPosesSafely, counted per object
+    ColorApplied,
+    ColorSkipped,       ///< The color was already set
+    CommandsQueued,     ///< See rviz::ShapeCommandQueue
+    CommandsOverflowed, ///< The ring of the queue was full, merged into its overflow buffer
+    CommandsSuperseded, ///< Overwritten by a later command for the same agent and field before being drained
+    CounterCount
+};
+
+/**
+ * \brief Latency histograms of the bulk updates, in nanoseconds.
+ */
+enum Histogram { SetPoses, AgentSceneSync, LodUpdate, SpatialIndexUpdate, ScheduledUpdates, HistogramCount };
+
+/** \brief Histogram bucket i counts durations in [2^i, 2^(i+1)) ns, the last bucket everything above. */
+constexpr size_t HistogramBuckets = 32;
+/** \brief Archetypes beyond this number are counted together in the last slot. */
+constexpr size_t MaxArchetypes = 16;
+
+struct HistogramSnapshot {
+    uint64_t count{0};
+    uint64_t totalNs{0};
+    std::array<uint64_t, HistogramBuckets> buckets{};
+
+    double meanNs() const {
+        return count ? double(totalNs) / count : 0.;
+    }
+    /**
+     * \brief Upper bound of the bucket that contains the given quantile (0..1).
+     */
+    uint64_t quantileNs(double q) const;
+};
+
+struct ArchetypeSnapshot {
+    std::string name;
+    uint64_t constructed{0};
+    uint64_t destroyed{0};
+};
+
+struct Snapshot {
+    std::array<uint64_t, CounterCount> counters{};
+    std::array<HistogramSnapshot, HistogramCount> histograms{};
+    std::vector<ArchetypeSnapshot> archetypes;
+};
+
+const char* name(Counter counter);
+const char* name(Histogram histogram);
+
+/**
+ * \brief Sum up the statistics of all threads, including the ones that have already finished.
+ */
+Snapshot snapshot();
+
+/**
+ * \brief Get the id under which objects of the named archetype are counted. Returns the same id for the same name.
+ */
+size_t archetypeId(const std::string& name);
+
+namespace detail {
+struct Block {
+    std::array<std::atomic<uint64_t>, CounterCount> counters;
+    std::array<std::array<std::atomic<uint64_t>, HistogramBuckets>, HistogramCount> buckets;
+    std::array<std::atomic<uint64_t>, HistogramCount> totalNs;
+    std::array<std::atomic<uint64_t>, MaxArchetypes> constructed;
+    std::array<std::atomic<uint64_t>, MaxArchetypes> destroyed;
+};
+
+// Registers the block of a thread and merges it into the totals when the thread finishes
+struct LocalBlock {
+    LocalBlock();
+    ~LocalBlock();
+    Block* block;
+};
+
+inline Block& localBlock() {
+    static thread_local LocalBlock local;
+    return *local.block;
+}
+
+// Only the owning thread writes, so there is no need for an atomic read-modify-write
+inline void bump(std::atomic<uint64_t>& value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+} // namespace detail
+
+inline void add(Counter counter, uint64_t n = 1) {
+#ifndef UTIL_RVIZ_DISABLE_STATS
+    detail::bump(detail::localBlock().counters[counter], n);
+#endif
+}
+
+inline void record(Histogram histogram, uint64_t ns) {
+#ifndef UTIL_RVIZ_DISABLE_STATS
+    const size_t bucket = ns ? std::min<size_t>(63 - __builtin_clzll(ns), HistogramBuckets - 1) : 0;
+    detail::Block& block = detail::localBlock();
+    detail::bump(block.buckets[histogram][bucket], 1);
+    detail::bump(block.totalNs[histogram], ns);
+#endif
+}
+
+inline void constructed(size_t archetype) {
+#ifndef UTIL_RVIZ_DISABLE_STATS
+    detail::bump(detail::localBlock().constructed[archetype], 1);
+#endif
+}
+
+inline void destroyed(size_t archetype) {
+#ifndef UTIL_RVIZ_DISABLE_STATS
+    detail::bump(detail::localBlock().destroyed[archetype], 1);
+#endif
+}
+
+/**
+ * \brief Records the lifetime of the timer in a histogram.
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram histogram) : histogram_(histogram) {
+#ifndef UTIL_RVIZ_DISABLE_STATS
+        start_ = std::chrono::steady_clock::now();
+#endif
+    }
+    ~ScopedTimer() {
+#ifndef UTIL_RVIZ_DISABLE_STATS
+        record(histogram_,
+               std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+#endif
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace stats
+} // namespace util_rviz
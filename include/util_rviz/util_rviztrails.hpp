@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <OGRE/OgreBillboardChain.h>
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreVector3.h>
+#include <ros/time.h>
+
+#include "util_rvizshapes.hpp"
+
+
+namespace rviz {
+
+struct TrailSettings {
+    size_t length{50};        ///< Maximum number of points per trail
+    float minDistance{0.5f};  ///< A point is added if the object moved at least this far...
+    double minInterval{0.1};  ///< ...or at least this many seconds passed since the last point
+    float width{0.2f};
+};
+
+/**
+ * \brief Trails of the recent positions of MultiShapes, drawn by a single BillboardChain.
+ * Every trail is one chain of the BillboardChain, which keeps its elements in a ring buffer: Adding a point retires
+ * the oldest one in constant time, no geometry is rebuilt on the CPU.
+ * Trails follow getPosition(), i.e. the objects have to share the parent node passed to the constructor. Positions are
+ * sampled by update(), usually once per frame. Fast objects are sampled by distance, slow or standing ones by time,
+ * so that the length of a trail also shows for how long an object stood still. The trail has the color of its object
+ * (white if no color was set). Trails of destroyed objects are removed automatically.
+ */
+class TrailSet : private MultiShape::DestructionListener {
+public:
+    static const size_t NoTrail = static_cast<size_t>(-1);
+
+    TrailSet(Ogre::SceneManager* scene_manager,
+             Ogre::SceneNode* parent_node = NULL,
+             size_t maxTrails = 1024,
+             const TrailSettings& settings = TrailSettings());
+    ~TrailSet() override;
+    TrailSet(const TrailSet&) = delete;
+    TrailSet& operator=(const TrailSet&) = delete;
+
+    /**
+     * \brief Start a trail for the object. Returns false if all maxTrails trails are in use.
+     */
+    bool add(MultiShape* obj);
+
+    /**
+     * \brief Remove the trail of the object, e.g. before it is returned to a pool.
+     */
+    void remove(MultiShape* obj);
+
+    /**
+     * \brief Remove the points of a trail, e.g. after the object jumped.
+     */
+    void clearTrail(MultiShape* obj);
+
+    void clear();
+
+    /**
+     * \brief Append the current positions of all objects that moved far enough, and update the colors.
+     */
+    void update(const ros::Time& stamp);
+
+    void setVisible(bool visible);
+
+    size_t size() const {
+        return trails_.size();
+    }
+    const TrailSettings& settings() const {
+        return settings_;
+    }
+
+    /**
+     * \brief Get the BillboardChain that draws all trails. The points of a trail are in its chain, see chainIndex().
+     */
+    const Ogre::BillboardChain* getBillboardChain() const {
+        return chain_;
+    }
+
+    /**
+     * \brief Get the index of the chain of the object's trail, or NoTrail if it has none.
+     */
+    size_t chainIndex(const MultiShape* obj) const;
+
+private:
+    struct Trail {
+        MultiShape* obj;
+        size_t chain;
+        Ogre::Vector3 lastPosition;
+        ros::Time lastStamp;
+        bool empty;
+        uint32_t color;
+    };
+
+    void objectDestroyed(MultiShape* obj) override;
+    void recolor(Trail& trail, const Ogre::ColourValue& c);
+
+    Ogre::SceneManager* scene_manager_;
+    Ogre::SceneNode* scene_node_;
+    Ogre::BillboardChain* chain_;
+    Ogre::MaterialPtr material_;
+    TrailSettings settings_;
+    std::vector<Trail> trails_;
+    std::unordered_map<const MultiShape*, size_t> trailIndices_;
+    std::vector<size_t> freeChains_;
+};
+
+} // namespace rviz
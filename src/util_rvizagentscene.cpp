@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizagentscene.hpp"
+
+#include <algorithm>
+
+namespace rviz {
+
+const AgentScene::Slot AgentScene::InvalidIndex;
+
+AgentScene::AgentScene(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node, bool baked)
+        : scene_manager_(scene_manager), parent_node_(parent_node), baked_(baked) {
+}
+
+AgentScene::Slot AgentScene::add(uint64_t id, Archetype archetype) {
+    Slot slot;
+    if (freeSlots_.empty()) {
+        slot = static_cast<Slot>(slotToIndex_.size());
+        slotToIndex_.push_back(InvalidIndex);
+    } else {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+    slotToIndex_[slot] = static_cast<uint32_t>(ids_.size());
+
+    ids_.push_back(id);
+    archetypes_.push_back(archetype);
+    positions_.push_back(Ogre::Vector3::ZERO);
+    orientations_.push_back(Ogre::Quaternion::IDENTITY);
+    scales_.push_back(Ogre::Vector3::UNIT_SCALE);
+    colors_.push_back(Ogre::ColourValue(1.0, 1.0, 1.0, 1.0));
+    colorPartly_.push_back(false);
+    colorSet_.push_back(false);
+    visible_.push_back(true);
+    // The color is only applied once it was set
+    dirty_.push_back(MultiShape::DirtyAll & ~MultiShape::DirtyColor);
+    shapes_.emplace_back();
+    indexToSlot_.push_back(slot);
+    return slot;
+}
+
+bool AgentScene::remove(Slot slot) {
+    // Removing a freed slot again would move another agent into the gap of the first removal
+    if (!contains(slot)) {
+        return false;
+    }
+    const size_t i = slotToIndex_[slot];
+    const size_t last = ids_.size() - 1;
+    if (i != last) {
+        // Move the last agent into the gap to keep the arrays dense
+        ids_[i] = ids_[last];
+        archetypes_[i] = archetypes_[last];
+        positions_[i] = positions_[last];
+        orientations_[i] = orientations_[last];
+        scales_[i] = scales_[last];
+        colors_[i] = colors_[last];
+        colorPartly_[i] = colorPartly_[last];
+        colorSet_[i] = colorSet_[last];
+        visible_[i] = visible_[last];
+        dirty_[i] = dirty_[last];
+        shapes_[i] = std::move(shapes_[last]);
+        indexToSlot_[i] = indexToSlot_[last];
+        slotToIndex_[indexToSlot_[i]] = static_cast<uint32_t>(i);
+    }
+    ids_.pop_back();
+    archetypes_.pop_back();
+    positions_.pop_back();
+    orientations_.pop_back();
+    scales_.pop_back();
+    colors_.pop_back();
+    colorPartly_.pop_back();
+    colorSet_.pop_back();
+    visible_.pop_back();
+    dirty_.pop_back();
+    shapes_.pop_back();
+    indexToSlot_.pop_back();
+
+    slotToIndex_[slot] = InvalidIndex;
+    freeSlots_.push_back(slot);
+    return true;
+}
+
+void AgentScene::setPosition(Slot slot, const Ogre::Vector3& position) {
+    const size_t i = index(slot);
+    positions_[i] = position;
+    dirty_[i] |= MultiShape::DirtyPosition;
+}
+
+void AgentScene::setOrientation(Slot slot, const Ogre::Quaternion& orientation) {
+    const size_t i = index(slot);
+    orientations_[i] = orientation;
+    dirty_[i] |= MultiShape::DirtyOrientation;
+}
+
+void AgentScene::setScale(Slot slot, const Ogre::Vector3& scale) {
+    const size_t i = index(slot);
+    scales_[i] = scale;
+    dirty_[i] |= MultiShape::DirtyScale;
+}
+
+void AgentScene::setColor(Slot slot, const Ogre::ColourValue& c) {
+    const size_t i = index(slot);
+    colors_[i] = c;
+    colorPartly_[i] = false;
+    colorSet_[i] = true;
+    dirty_[i] |= MultiShape::DirtyColor;
+}
+
+void AgentScene::setColorPartly(Slot slot, const Ogre::ColourValue& c) {
+    const size_t i = index(slot);
+    colors_[i] = c;
+    colorPartly_[i] = true;
+    colorSet_[i] = true;
+    dirty_[i] |= MultiShape::DirtyColor;
+}
+
+void AgentScene::setVisible(Slot slot, bool visible) {
+    const size_t i = index(slot);
+    visible_[i] = visible;
+    dirty_[i] |= MultiShape::DirtyVisibility;
+}
+
+void AgentScene::markAllDirty(uint32_t flags) {
+    for (auto& d : dirty_) {
+        d |= flags;
+    }
+    if (flags & MultiShape::DirtyColor) {
+        std::fill(colorSet_.begin(), colorSet_.end(), true);
+    }
+}
+
+void AgentScene::sync() {
+    util_rviz::stats::ScopedTimer timer(util_rviz::stats::AgentSceneSync);
+    for (size_t i = 0; i < ids_.size(); ++i) {
+        const uint32_t dirty = dirty_[i];
+        if (!dirty) {
+            continue;
+        }
+        dirty_[i] = 0;
+        if (!shapes_[i]) {
+            // Agents that start hidden only create their geometry once they are shown
+            shapes_[i] = createArchetype(archetypes_[i], scene_manager_, parent_node_, baked_, !visible_[i]);
+        }
+        MultiShape* shape = shapes_[i].get();
+        if (dirty & MultiShape::DirtyPosition) {
+            shape->setPosition(positions_[i]);
+        }
+        if (dirty & MultiShape::DirtyOrientation) {
+            shape->setOrientation(orientations_[i]);
+        }
+        if (dirty & MultiShape::DirtyScale) {
+            shape->setScale(scales_[i]);
+        }
+        if (dirty & MultiShape::DirtyColor) {
+            SimpleCar* car = colorPartly_[i] ? dynamic_cast<SimpleCar*>(shape) : NULL;
+            if (car) {
+                car->setColorPartly(colors_[i]);
+            } else {
+                shape->setColor(colors_[i]);
+            }
+        }
+        if (dirty & MultiShape::DirtyVisibility) {
+            shape->visible(visible_[i]);
+        }
+    }
+}
+
+} // namespace rviz
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizbaked.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <OGRE/OgreManualObject.h>
+#include <OGRE/OgreMeshManager.h>
+#include <OGRE/OgreResourceGroupManager.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSubMesh.h>
+
+namespace rviz {
+namespace baked {
+
+// The primitive meshes rviz::Shape uses, see rviz::Shape::createEntity()
+std::string primitiveMeshName(Shape::Type type) {
+    switch (type) {
+    case Shape::Cone:
+        return "rviz_cone.mesh";
+    case Shape::Cube:
+        return "rviz_cube.mesh";
+    case Shape::Cylinder:
+        return "rviz_cylinder.mesh";
+    case Shape::Sphere:
+        return "rviz_sphere.mesh";
+    default:
+        return "";
+    }
+}
+
+namespace {
+// Copies all triangles of the mesh into the current section of the manual object. Returns the new number of vertices
+// in the section.
+uint32_t appendPrimitive(Ogre::ManualObject* manual, const ShapeDescription& d, uint32_t vertexCount) {
+    Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().load(primitiveMeshName(d.type), "rviz");
+    for (unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i) {
+        Ogre::SubMesh* subMesh = mesh->getSubMesh(i);
+        Ogre::VertexData* vertexData = subMesh->useSharedVertices ? mesh->sharedVertexData : subMesh->vertexData;
+        const Ogre::VertexElement* posElem =
+            vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
+        const Ogre::VertexElement* normElem = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_NORMAL);
+        Ogre::HardwareVertexBufferSharedPtr posBuf = vertexData->vertexBufferBinding->getBuffer(posElem->getSource());
+        Ogre::HardwareVertexBufferSharedPtr normBuf = posBuf;
+        if (normElem && normElem->getSource() != posElem->getSource()) {
+            normBuf = vertexData->vertexBufferBinding->getBuffer(normElem->getSource());
+        }
+
+        unsigned char* posData = static_cast<unsigned char*>(posBuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+        unsigned char* normData = posData;
+        if (normBuf.get() != posBuf.get()) {
+            normData = static_cast<unsigned char*>(normBuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+        }
+        posData += vertexData->vertexStart * posBuf->getVertexSize();
+        normData += vertexData->vertexStart * normBuf->getVertexSize();
+
+        for (size_t v = 0; v < vertexData->vertexCount; ++v) {
+            float* p;
+            posElem->baseVertexPointerToElement(posData + v * posBuf->getVertexSize(), &p);
+            Ogre::Vector3 local(p[0], p[1], p[2]);
+            manual->position(d.position + d.orientation * (d.scale * (d.offset + local)));
+            if (normElem) {
+                float* n;
+                normElem->baseVertexPointerToElement(normData + v * normBuf->getVertexSize(), &n);
+                // Normals transform with the inverse scale
+                Ogre::Vector3 normal = Ogre::Vector3(n[0], n[1], n[2]) / d.scale;
+                manual->normal(d.orientation * normal.normalisedCopy());
+            }
+        }
+
+        if (normBuf.get() != posBuf.get()) {
+            normBuf->unlock();
+        }
+        posBuf->unlock();
+
+        Ogre::IndexData* indexData = subMesh->indexData;
+        Ogre::HardwareIndexBufferSharedPtr indexBuf = indexData->indexBuffer;
+        const bool use32Bit = indexBuf->getType() == Ogre::HardwareIndexBuffer::IT_32BIT;
+        void* indices = indexBuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY);
+        for (size_t j = indexData->indexStart; j < indexData->indexStart + indexData->indexCount; ++j) {
+            uint32_t index = use32Bit ? static_cast<uint32_t*>(indices)[j] : static_cast<uint16_t*>(indices)[j];
+            manual->index(vertexCount + index);
+        }
+        indexBuf->unlock();
+
+        vertexCount += static_cast<uint32_t>(vertexData->vertexCount);
+    }
+    return vertexCount;
+}
+} // namespace
+
+std::vector<ShapeDescription::ColorGroup> colorGroups(const shape_description_vector& descriptions) {
+    std::vector<ShapeDescription::ColorGroup> groups;
+    for (const auto& d : descriptions) {
+        if (std::find(groups.begin(), groups.end(), d.group) == groups.end()) {
+            groups.push_back(d.group);
+        }
+    }
+    std::sort(groups.begin(), groups.end());
+    return groups;
+}
+
+Ogre::MeshPtr getOrCreateMesh(Ogre::SceneManager* scene_manager,
+                              const std::string& name,
+                              const shape_description_vector& descriptions) {
+    Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().getByName(name, "rviz");
+    if (!mesh.isNull()) {
+        return mesh;
+    }
+
+    Ogre::ManualObject* manual = scene_manager->createManualObject(name + "Manual");
+    for (auto group : colorGroups(descriptions)) {
+        // The material is only a placeholder, every entity sets its own materials
+        manual->begin(
+            "BaseWhite", Ogre::RenderOperation::OT_TRIANGLE_LIST, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        uint32_t vertexCount = 0;
+        for (const auto& d : descriptions) {
+            if (d.group == group) {
+                vertexCount = appendPrimitive(manual, d, vertexCount);
+            }
+        }
+        manual->end();
+    }
+    mesh = manual->convertToMesh(name, "rviz");
+    scene_manager->destroyManualObject(manual);
+    return mesh;
+}
+
+} // namespace baked
+} // namespace rviz
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizcommands.hpp"
+
+namespace rviz {
+
+bool ShapeUpdate::setPosition(const Ogre::Vector3& p) {
+    const bool superseded = fields & Position;
+    fields |= Position;
+    position = p;
+    return superseded;
+}
+
+bool ShapeUpdate::setOrientation(const Ogre::Quaternion& q) {
+    const bool superseded = fields & Orientation;
+    fields |= Orientation;
+    orientation = q;
+    return superseded;
+}
+
+bool ShapeUpdate::setColor(const Ogre::ColourValue& c) {
+    // Recolors all parts, so an earlier setColorPartly() has no effect anymore
+    const bool superseded = fields & (Color | ColorPartly);
+    fields = (fields | Color) & ~ColorPartly;
+    color = c;
+    return superseded;
+}
+
+bool ShapeUpdate::setColorPartly(const Ogre::ColourValue& c) {
+    // An earlier setColor() stays, it still colors the parts that setColorPartly() leaves alone
+    const bool superseded = fields & ColorPartly;
+    fields |= ColorPartly;
+    colorPartly = c;
+    return superseded;
+}
+
+bool ShapeUpdate::setVisible(bool v) {
+    const bool superseded = fields & Visibility;
+    fields |= Visibility;
+    visible = v;
+    return superseded;
+}
+
+size_t ShapeUpdate::merge(const ShapeUpdate& later) {
+    size_t superseded = 0;
+    if (later.fields & Position) {
+        superseded += setPosition(later.position);
+    }
+    if (later.fields & Orientation) {
+        superseded += setOrientation(later.orientation);
+    }
+    // In the same order as applyTo()
+    if (later.fields & Color) {
+        superseded += setColor(later.color);
+    }
+    if (later.fields & ColorPartly) {
+        superseded += setColorPartly(later.colorPartly);
+    }
+    if (later.fields & Visibility) {
+        superseded += setVisible(later.visible);
+    }
+    return superseded;
+}
+
+void ShapeUpdate::applyTo(MultiShape& shape) const {
+    if (fields & Position) {
+        shape.setPosition(position);
+    }
+    if (fields & Orientation) {
+        shape.setOrientation(orientation);
+    }
+    if (fields & Color) {
+        shape.setColor(color);
+    }
+    if (fields & ColorPartly) {
+        SimpleCar* car = dynamic_cast<SimpleCar*>(&shape);
+        if (car) {
+            car->setColorPartly(colorPartly);
+        } else {
+            shape.setColor(colorPartly);
+        }
+    }
+    if (fields & Visibility) {
+        shape.visible(visible);
+    }
+}
+
+void ShapeUpdate::applyTo(AgentScene& scene, AgentScene::Slot slot) const {
+    if (fields & Position) {
+        scene.setPosition(slot, position);
+    }
+    if (fields & Orientation) {
+        scene.setOrientation(slot, orientation);
+    }
+    if (fields & Color) {
+        scene.setColor(slot, color);
+    }
+    if (fields & ColorPartly) {
+        scene.setColorPartly(slot, colorPartly);
+    }
+    if (fields & Visibility) {
+        scene.setVisible(slot, visible);
+    }
+}
+
+ShapeCommandQueue::ShapeCommandQueue(size_t capacity)
+        : enqueuePos_(0), queued_(0), dequeuePos_(0), superseded_(0), drained_(0), overflowing_(false),
+          overflowed_(0) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+void ShapeCommandQueue::setPosition(uint64_t id, const Ogre::Vector3& position) {
+    push(Command{id, ShapeUpdate::Position, false, {position.x, position.y, position.z, 0.f}});
+}
+
+void ShapeCommandQueue::setOrientation(uint64_t id, const Ogre::Quaternion& orientation) {
+    push(Command{id, ShapeUpdate::Orientation, false, {orientation.w, orientation.x, orientation.y, orientation.z}});
+}
+
+void ShapeCommandQueue::setColor(uint64_t id, const Ogre::ColourValue& c) {
+    push(Command{id, ShapeUpdate::Color, false, {c.r, c.g, c.b, c.a}});
+}
+
+void ShapeCommandQueue::setColorPartly(uint64_t id, const Ogre::ColourValue& c) {
+    push(Command{id, ShapeUpdate::ColorPartly, false, {c.r, c.g, c.b, c.a}});
+}
+
+void ShapeCommandQueue::visible(uint64_t id, bool visible) {
+    push(Command{id, ShapeUpdate::Visibility, visible, {0.f, 0.f, 0.f, 0.f}});
+}
+
+ShapeCommandQueue::Statistics ShapeCommandQueue::statistics() const {
+    return Statistics{queued_.load(std::memory_order_relaxed), overflowed_.load(std::memory_order_relaxed),
+                      superseded_.load(std::memory_order_relaxed), drained_.load(std::memory_order_relaxed)};
+}
+
+void ShapeCommandQueue::push(const Command& command) {
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    util_rviz::stats::add(util_rviz::stats::CommandsQueued);
+    // While overflowing, later commands must not overtake the ones in the overflow buffer
+    if (overflowing_.load(std::memory_order_acquire) || !pushToRing(command)) {
+        pushToOverflow(command);
+    }
+}
+
+bool ShapeCommandQueue::pushToRing(const Command& command) {
+    // Bounded queue after Dmitry Vyukov: a cell is free for position pos if its sequence equals pos and holds a command
+    // once its sequence is pos + 1
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells_[pos & mask_];
+        const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+    cell->command = command;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void ShapeCommandQueue::pushToOverflow(const Command& command) {
+    std::lock_guard<std::mutex> lock(overflowMutex_);
+    overflowing_.store(true, std::memory_order_release);
+    overflowed_.fetch_add(1, std::memory_order_relaxed);
+    util_rviz::stats::add(util_rviz::stats::CommandsOverflowed);
+    if (write(overflow_, overflowIndices_, command)) {
+        superseded_.fetch_add(1, std::memory_order_relaxed);
+        util_rviz::stats::add(util_rviz::stats::CommandsSuperseded);
+    }
+}
+
+bool ShapeCommandQueue::write(std::vector<ShapeUpdate>& updates, IdIndexMap& indices, const Command& c) {
+    uint32_t index = indices.find(c.id);
+    if (index == IdIndexMap::Missing) {
+        index = static_cast<uint32_t>(updates.size());
+        indices.insert(c.id, index);
+        updates.push_back(ShapeUpdate::none(c.id));
+    }
+    ShapeUpdate& u = updates[index];
+    switch (c.field) {
+    case ShapeUpdate::Position:
+        return u.setPosition(Ogre::Vector3(c.values[0], c.values[1], c.values[2]));
+    case ShapeUpdate::Orientation:
+        return u.setOrientation(Ogre::Quaternion(c.values[0], c.values[1], c.values[2], c.values[3]));
+    case ShapeUpdate::Color:
+        return u.setColor(Ogre::ColourValue(c.values[0], c.values[1], c.values[2], c.values[3]));
+    case ShapeUpdate::ColorPartly:
+        return u.setColorPartly(Ogre::ColourValue(c.values[0], c.values[1], c.values[2], c.values[3]));
+    case ShapeUpdate::Visibility:
+        return u.setVisible(c.visible);
+    }
+    return false;
+}
+
+void ShapeCommandQueue::collect() {
+    for (const auto& u : updates_) {
+        indices_.erase(u.id);
+    }
+    updates_.clear();
+
+    uint64_t superseded = 0;
+    // At most one queue length, so that busy producers cannot keep the render thread here
+    for (size_t n = 0; n <= mask_; ++n) {
+        Cell& cell = cells_[dequeuePos_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+            break;
+        }
+        const Command c = cell.command;
+        cell.sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+        ++dequeuePos_;
+        superseded += write(updates_, indices_, c);
+    }
+
+    // The overflow buffer holds the latest commands, so it can only be merged once everything before was read from
+    // the ring. Producers that claimed a cell but did not fill it yet keep it for the next call.
+    if (overflowing_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        if (enqueuePos_.load(std::memory_order_relaxed) == dequeuePos_) {
+            for (const auto& o : overflow_) {
+                uint32_t index = indices_.find(o.id);
+                if (index == IdIndexMap::Missing) {
+                    indices_.insert(o.id, static_cast<uint32_t>(updates_.size()));
+                    updates_.push_back(o);
+                } else {
+                    superseded += updates_[index].merge(o);
+                }
+                overflowIndices_.erase(o.id);
+            }
+            overflow_.clear();
+            overflowing_.store(false, std::memory_order_release);
+        }
+    }
+
+    superseded_.fetch_add(superseded, std::memory_order_relaxed);
+    drained_.fetch_add(updates_.size(), std::memory_order_relaxed);
+    util_rviz::stats::add(util_rviz::stats::CommandsSuperseded, superseded);
+}
+
+} // namespace rviz
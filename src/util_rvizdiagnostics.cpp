@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizdiagnostics.hpp"
+
+#include <cstdint>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+namespace util_rviz {
+
+namespace {
+void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, double value) {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = std::to_string(value);
+    status.values.push_back(kv);
+}
+
+void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, uint64_t value) {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = std::to_string(value);
+    status.values.push_back(kv);
+}
+
+uint64_t rejections(const stats::Snapshot& s) {
+    return s.counters[stats::PositionRejectedNonFinite] + s.counters[stats::PositionRejectedNull] +
+           s.counters[stats::OrientationRejectedNonFinite] + s.counters[stats::OrientationRejectedNull] +
+           s.counters[stats::ScaleRejectedNonFinite] + s.counters[stats::ScaleRejectedNull] +
+           s.counters[stats::PosesRejected];
+}
+} // namespace
+
+diagnostic_msgs::DiagnosticStatus diagnosticStatus(const stats::Snapshot& current,
+                                                   const stats::Snapshot& last,
+                                                   double elapsedSeconds,
+                                                   double warnRejectionsPerSecond) {
+    const double rejectionRate =
+        elapsedSeconds > 0. ? (rejections(current) - rejections(last)) / elapsedSeconds : 0.;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "util_rviz";
+    status.hardware_id = ros::this_node::getName();
+    if (rejectionRate > warnRejectionsPerSecond) {
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "Rejecting invalid pose or scale updates";
+    } else {
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
+
+    addValue(status, "rejections_per_second", rejectionRate);
+    for (size_t i = 0; i < stats::CounterCount; ++i) {
+        addValue(status, stats::name(stats::Counter(i)), current.counters[i]);
+    }
+    for (size_t i = 0; i < stats::HistogramCount; ++i) {
+        const std::string prefix = stats::name(stats::Histogram(i));
+        const stats::HistogramSnapshot& h = current.histograms[i];
+        addValue(status, prefix + "_count", h.count);
+        addValue(status, prefix + "_mean_us", h.meanNs() * 1e-3);
+        addValue(status, prefix + "_p99_us", h.quantileNs(0.99) * 1e-3);
+    }
+    for (const auto& a : current.archetypes) {
+        addValue(status, a.name + "_alive", a.constructed - a.destroyed);
+        addValue(status, a.name + "_constructed", a.constructed);
+    }
+    return status;
+}
+
+DiagnosticsPublisher::DiagnosticsPublisher(ros::NodeHandle& nh,
+                                           const ros::Duration& period,
+                                           double warnRejectionsPerSecond,
+                                           const std::string& topic)
+        : publisher_(nh.advertise<diagnostic_msgs::DiagnosticArray>(topic, 1)),
+          timer_(nh.createTimer(period, &DiagnosticsPublisher::publish, this)),
+          warnRejectionsPerSecond_(warnRejectionsPerSecond), last_(stats::snapshot()),
+          lastStamp_(ros::WallTime::now()) {
+}
+
+void DiagnosticsPublisher::publish(const ros::TimerEvent& event) {
+    const stats::Snapshot current = stats::snapshot();
+    const ros::WallTime now = ros::WallTime::now();
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = event.current_real;
+    msg.status.push_back(diagnosticStatus(current, last_, (now - lastStamp_).toSec(), warnRejectionsPerSecond_));
+    publisher_.publish(msg);
+
+    last_ = current;
+    lastStamp_ = now;
+}
+
+} // namespace util_rviz
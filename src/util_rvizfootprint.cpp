@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizfootprint.hpp"
+
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <OGRE/OgreEntity.h>
+#include <OGRE/OgreMesh.h>
+#include <OGRE/OgreVertexIndexData.h>
+
+#include "util_rvizshapes.hpp"
+
+namespace rviz {
+
+namespace {
+struct Registry {
+    std::vector<const MultiShape*> objects;
+    std::unordered_map<const MultiShape*, size_t> objectIndices;
+};
+
+Registry& registry() {
+    // Never destroyed, so that objects outliving static destruction can still unregister
+    static Registry* r = new Registry;
+    return *r;
+}
+
+void addBuffers(const Ogre::VertexData* data, FootprintReport& report) {
+    if (!data || !data->vertexBufferBinding) {
+        return;
+    }
+    for (unsigned short i = 0; i < data->vertexBufferBinding->getBufferCount(); ++i) {
+        const Ogre::HardwareVertexBufferSharedPtr& buffer = data->vertexBufferBinding->getBuffer(i);
+        if (!buffer.isNull()) {
+            report.vertexBytes += buffer->getSizeInBytes();
+        }
+    }
+}
+
+void addMesh(const Ogre::Mesh& mesh, FootprintReport& report) {
+    ++report.meshes;
+    addBuffers(mesh.sharedVertexData, report);
+    for (unsigned short i = 0; i < mesh.getNumSubMeshes(); ++i) {
+        const Ogre::SubMesh* subMesh = mesh.getSubMesh(i);
+        if (!subMesh->useSharedVertices) {
+            addBuffers(subMesh->vertexData, report);
+        }
+        if (subMesh->indexData && !subMesh->indexData->indexBuffer.isNull()) {
+            report.indexBytes += subMesh->indexData->indexBuffer->getSizeInBytes();
+        }
+    }
+}
+} // namespace
+
+Footprint& Footprint::operator+=(const Footprint& other) {
+    objects += other.objects;
+    heapBytes += other.heapBytes;
+    sceneNodes += other.sceneNodes;
+    entities += other.entities;
+    ownMaterials += other.ownMaterials;
+    sharedMaterials += other.sharedMaterials;
+    ogreBytes += other.ogreBytes;
+    return *this;
+}
+
+std::string FootprintReport::toString() const {
+    std::ostringstream ss;
+    auto line = [&ss](const std::string& name, const Footprint& f) {
+        ss << name << ": " << f.objects << " objects, " << f.sceneNodes << " scene nodes, " << f.entities
+           << " entities, " << f.ownMaterials << " own materials, " << f.sharedMaterials << " shared materials, "
+           << f.bytes() / 1024 << " KiB\n";
+    };
+    for (const auto& a : archetypes) {
+        line(a.first, a.second);
+    }
+    line("total", total);
+    ss << meshes << " meshes, " << (vertexBytes + indexBytes) / 1024 << " KiB vertex and index buffers\n";
+    ss << "overall: " << bytes() / 1024 << " KiB";
+    return ss.str();
+}
+
+namespace footprint {
+
+FootprintReport report() {
+    FootprintReport report;
+    std::unordered_set<const Ogre::Mesh*> meshes;
+    for (const MultiShape* obj : registry().objects) {
+        const Footprint f = obj->footprint();
+        report.total += f;
+        report.archetypes[obj->archetypeName()] += f;
+        obj->forEachEntity([&](Ogre::Entity* e) {
+            const Ogre::MeshPtr& mesh = e->getMesh();
+            if (!mesh.isNull() && meshes.insert(mesh.get()).second) {
+                addMesh(*mesh, report);
+            }
+        });
+    }
+    return report;
+}
+
+size_t objectCount() {
+    return registry().objects.size();
+}
+
+void registerObject(const MultiShape* obj) {
+    Registry& r = registry();
+    r.objectIndices[obj] = r.objects.size();
+    r.objects.push_back(obj);
+}
+
+void unregisterObject(const MultiShape* obj) {
+    Registry& r = registry();
+    auto it = r.objectIndices.find(obj);
+    if (it == r.objectIndices.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    r.objectIndices.erase(it);
+
+    // Fill the gap with the last object
+    if (index != r.objects.size() - 1) {
+        r.objects[index] = r.objects.back();
+        r.objectIndices[r.objects[index]] = index;
+    }
+    r.objects.pop_back();
+}
+
+} // namespace footprint
+} // namespace rviz
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizidindexmap.hpp"
+
+#include <algorithm>
+
+namespace rviz {
+
+const uint32_t IdIndexMap::Missing;
+
+IdIndexMap::IdIndexMap() : buckets_(16, Bucket{0, Missing}), size_(0) {
+}
+
+size_t IdIndexMap::bucketOf(uint64_t id) const {
+    // Finalizer of splitmix64, so that sequential ids spread over the buckets
+    id ^= id >> 30;
+    id *= 0xbf58476d1ce4e5b9ull;
+    id ^= id >> 27;
+    id *= 0x94d049bb133111ebull;
+    id ^= id >> 31;
+    return id & (buckets_.size() - 1);
+}
+
+uint32_t IdIndexMap::find(uint64_t id) const {
+    const size_t mask = buckets_.size() - 1;
+    for (size_t i = bucketOf(id);; i = (i + 1) & mask) {
+        const Bucket& b = buckets_[i];
+        if (b.value == Missing || b.id == id) {
+            return b.value;
+        }
+    }
+}
+
+void IdIndexMap::insert(uint64_t id, uint32_t value) {
+    const size_t mask = buckets_.size() - 1;
+    for (size_t i = bucketOf(id);; i = (i + 1) & mask) {
+        Bucket& b = buckets_[i];
+        if (b.value == Missing) {
+            // Keep the load factor below 1/2, overwriting an id does not count
+            if (2 * (size_ + 1) > buckets_.size()) {
+                grow();
+                insert(id, value);
+                return;
+            }
+            b = Bucket{id, value};
+            ++size_;
+            return;
+        }
+        if (b.id == id) {
+            b.value = value;
+            return;
+        }
+    }
+}
+
+void IdIndexMap::erase(uint64_t id) {
+    const size_t mask = buckets_.size() - 1;
+    size_t i = bucketOf(id);
+    for (;; i = (i + 1) & mask) {
+        if (buckets_[i].value == Missing) {
+            return;
+        }
+        if (buckets_[i].id == id) {
+            break;
+        }
+    }
+    // Shift back the following entries that would not be found across the gap anymore
+    for (size_t j = (i + 1) & mask; buckets_[j].value != Missing; j = (j + 1) & mask) {
+        const size_t home = bucketOf(buckets_[j].id);
+        const bool reachable = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!reachable) {
+            buckets_[i] = buckets_[j];
+            i = j;
+        }
+    }
+    buckets_[i].value = Missing;
+    --size_;
+}
+
+void IdIndexMap::clear() {
+    std::fill(buckets_.begin(), buckets_.end(), Bucket{0, Missing});
+    size_ = 0;
+}
+
+void IdIndexMap::grow() {
+    std::vector<Bucket> old(2 * buckets_.size(), Bucket{0, Missing});
+    old.swap(buckets_);
+    size_ = 0;
+    for (const Bucket& b : old) {
+        if (b.value != Missing) {
+            insert(b.id, b.value);
+        }
+    }
+}
+
+} // namespace rviz
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizlabels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include <OGRE/OgreFontManager.h>
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreTechnique.h>
+
+namespace rviz {
+
+LabelSet::LabelSet(Ogre::SceneManager* scene_manager, const LabelSettings& settings)
+        : scene_manager_(scene_manager), settings_(settings), glyphCount_(0) {
+    static uint32_t count = 0;
+    std::stringstream ss;
+    ss << "UtilRvizLabels" << count++;
+
+    font_ = Ogre::FontManager::getSingleton().getByName(settings_.font).staticCast<Ogre::Font>();
+    if (font_.isNull()) {
+        throw std::runtime_error("Font " + settings_.font + " not found");
+    }
+    font_->load();
+
+    // The glyph atlas of the font, colored and faded by the vertex colors of the billboards
+    material_ = font_->getMaterial()->clone(ss.str() + "Material");
+    material_->setReceiveShadows(false);
+    material_->setLightingEnabled(false);
+    material_->setDepthWriteEnabled(false);
+    material_->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+
+    // Labels are placed in world coordinates
+    scene_node_ = scene_manager_->getRootSceneNode()->createChildSceneNode();
+    billboards_ = scene_manager_->createBillboardSet(ss.str(), 256);
+    billboards_->setBillboardType(Ogre::BBT_POINT);
+    billboards_->setAutoextend(true);
+    billboards_->setCullIndividually(false);
+    billboards_->setMaterialName(material_->getName(), material_->getGroup());
+    scene_node_->attachObject(billboards_);
+    MultiShape::addDestructionListener(this);
+}
+
+LabelSet::~LabelSet() {
+    MultiShape::removeDestructionListener(this);
+    scene_manager_->destroyBillboardSet(billboards_);
+    Ogre::MaterialManager::getSingleton().remove(material_->getName());
+    scene_manager_->destroySceneNode(scene_node_);
+}
+
+void LabelSet::setText(MultiShape* obj, const std::string& text) {
+    auto it = labelIndices_.find(obj);
+    if (it == labelIndices_.end()) {
+        const float top = obj->getLocalBounds().getMaximum().z * obj->getRootNode()->getScale().z;
+        Label label{obj, text, top + settings_.margin, {}, {}, Ogre::Vector3::ZERO, 0.f, true};
+        labelIndices_[obj] = labels_.size();
+        labels_.push_back(label);
+        return;
+    }
+    Label& label = labels_[it->second];
+    if (label.text != text) {
+        label.text = text;
+        label.layoutDirty = true;
+    }
+}
+
+void LabelSet::setHeight(MultiShape* obj, float height) {
+    auto it = labelIndices_.find(obj);
+    if (it != labelIndices_.end()) {
+        labels_[it->second].height = height;
+    }
+}
+
+void LabelSet::remove(MultiShape* obj) {
+    auto it = labelIndices_.find(obj);
+    if (it == labelIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    labelIndices_.erase(it);
+    release(labels_[index]);
+
+    // Fill the gap with the last label
+    if (index != labels_.size() - 1) {
+        labels_[index] = std::move(labels_.back());
+        labelIndices_[labels_[index].obj] = index;
+    }
+    labels_.pop_back();
+}
+
+void LabelSet::objectDestroyed(MultiShape* obj) {
+    remove(obj);
+}
+
+void LabelSet::clear() {
+    billboards_->clear();
+    labels_.clear();
+    labelIndices_.clear();
+    freeGlyphs_.clear();
+    glyphCount_ = 0;
+}
+
+void LabelSet::update(const Ogre::Camera* camera) {
+    const Ogre::Vector3& eye = camera->getDerivedPosition();
+    const Ogre::Vector3 right = camera->getDerivedRight();
+    const bool turned = camera->getDerivedOrientation() != cameraOrientation_;
+    cameraOrientation_ = camera->getDerivedOrientation();
+    const float fadeRange = std::max(settings_.fadeEnd - settings_.fadeStart, 1e-3f);
+
+    bool changed = false;
+    for (auto& label : labels_) {
+        const Ogre::Vector3 anchor =
+            label.obj->getRootNode()->_getDerivedPosition() + Ogre::Vector3(0.f, 0.f, label.height);
+        const float distance = anchor.distance(eye);
+        if (!label.obj->isVisible() || distance >= settings_.fadeEnd) {
+            changed |= !label.glyphs.empty();
+            release(label);
+            continue;
+        }
+
+        bool moved = turned || anchor != label.anchor;
+        if (label.layoutDirty) {
+            layout(label);
+            moved = true;
+            label.alpha = -1.f; // Color the new glyphs
+        }
+        if (moved) {
+            label.anchor = anchor;
+            place(label, right);
+            changed = true;
+        }
+        const float alpha = std::min(1.f, (settings_.fadeEnd - distance) / fadeRange);
+        if (std::abs(alpha - label.alpha) > 1.f / 255) {
+            label.alpha = alpha;
+            Ogre::ColourValue c = settings_.color;
+            c.a *= alpha;
+            for (auto* g : label.glyphs) {
+                g->setColour(c);
+            }
+        }
+    }
+    if (changed) {
+        billboards_->_updateBounds();
+    }
+}
+
+void LabelSet::setVisible(bool visible) {
+    billboards_->setVisible(visible);
+}
+
+void LabelSet::layout(Label& label) {
+    label.layoutDirty = false;
+    // Space characters only advance, like in rviz::MovableText
+    auto glyphWidth = [this](unsigned char c) { return font_->getGlyphAspectRatio(c) * settings_.charHeight; };
+    label.offsets.clear();
+    layoutLine(label.text, glyphWidth('0'), glyphWidth, label.offsets);
+    const size_t glyphs = label.offsets.size();
+    if (glyphCount_ - label.glyphs.size() + glyphs > settings_.maxGlyphs) {
+        release(label);
+        return;
+    }
+
+    // Reuse the glyphs of the old text, only the difference is created or given back
+    while (label.glyphs.size() > glyphs) {
+        Ogre::Billboard* g = label.glyphs.back();
+        label.glyphs.pop_back();
+        g->setDimensions(0.f, 0.f);
+        freeGlyphs_.push_back(g);
+        --glyphCount_;
+    }
+    while (label.glyphs.size() < glyphs) {
+        if (freeGlyphs_.empty()) {
+            label.glyphs.push_back(billboards_->createBillboard(Ogre::Vector3::ZERO));
+        } else {
+            label.glyphs.push_back(freeGlyphs_.back());
+            freeGlyphs_.pop_back();
+        }
+        ++glyphCount_;
+    }
+
+    size_t i = 0;
+    for (char c : label.text) {
+        if (c == ' ') {
+            continue;
+        }
+        const Ogre::Font::CodePoint codePoint = static_cast<unsigned char>(c);
+        label.glyphs[i]->setTexcoordRect(font_->getGlyphTexCoords(codePoint));
+        label.glyphs[i]->setDimensions(glyphWidth(codePoint), settings_.charHeight);
+        ++i;
+    }
+}
+
+void LabelSet::place(Label& label, const Ogre::Vector3& right) {
+    for (size_t i = 0; i < label.glyphs.size(); ++i) {
+        label.glyphs[i]->setPosition(label.anchor + right * label.offsets[i]);
+    }
+}
+
+void LabelSet::release(Label& label) {
+    // Unused billboards are collapsed instead of removed, which would be linear in the number of billboards
+    for (auto* g : label.glyphs) {
+        g->setDimensions(0.f, 0.f);
+        freeGlyphs_.push_back(g);
+    }
+    glyphCount_ -= label.glyphs.size();
+    label.glyphs.clear();
+    label.offsets.clear();
+    label.layoutDirty = true;
+}
+
+} // namespace rviz
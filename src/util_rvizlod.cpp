@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizlod.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace rviz {
+
+LodSettings LodSettings::fromProjectedSize(const std::vector<float>& pixelSizes,
+                                           float radius,
+                                           float fovY,
+                                           float viewportHeight) {
+    // Pixels per meter at distance 1
+    const float focalLength = viewportHeight / (2.f * std::tan(fovY / 2.f));
+    LodSettings settings;
+    for (float pixels : pixelSizes) {
+        settings.distances.push_back(2.f * radius * focalLength / pixels);
+    }
+    return settings;
+}
+
+MultiShape::LodLevel selectLodLevel(float distance, MultiShape::LodLevel current, const LodSettings& settings) {
+    const int levels = static_cast<int>(settings.distances.size());
+    int level = std::min(static_cast<int>(current), levels);
+    while (level < levels && distance > settings.distances[level] * (1.f + settings.hysteresis)) {
+        ++level;
+    }
+    while (level > 0 && distance < settings.distances[level - 1] * (1.f - settings.hysteresis)) {
+        --level;
+    }
+    return static_cast<MultiShape::LodLevel>(std::min(level, static_cast<int>(MultiShape::LodHidden)));
+}
+
+} // namespace rviz
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizmaterials.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreTechnique.h>
+
+namespace rviz {
+namespace materials {
+
+Ogre::MaterialPtr createMaterial(const std::string& name) {
+    Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(name, "rviz");
+    material->setReceiveShadows(false);
+    material->getTechnique(0)->setLightingEnabled(true);
+    material->getTechnique(0)->setAmbient(0.5, 0.5, 0.5);
+    return material;
+}
+
+void applyColor(const Ogre::MaterialPtr& material, const Ogre::ColourValue& c) {
+    material->getTechnique(0)->setAmbient(c.r * 0.5, c.g * 0.5, c.b * 0.5);
+    material->getTechnique(0)->setDiffuse(c.r, c.g, c.b, c.a);
+    if (c.a < 0.9998) {
+        material->getTechnique(0)->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+        material->getTechnique(0)->setDepthWriteEnabled(false);
+    } else {
+        material->getTechnique(0)->setSceneBlending(Ogre::SBT_REPLACE);
+        material->getTechnique(0)->setDepthWriteEnabled(true);
+    }
+}
+
+} // namespace materials
+
+namespace {
+uint32_t quantise(float channel) {
+    // Also maps NaN to 0, converting it to an integer would be undefined
+    if (!(channel > 0.f)) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min(std::max(channel, 0.f), 1.f) * 255.f + 0.5f);
+}
+} // namespace
+
+MaterialCache::MaterialCache() : storage_(std::make_shared<Storage>()) {
+    static uint32_t count = 0;
+    std::stringstream ss;
+    ss << "UtilRvizMaterialCache" << count++ << "Color";
+    storage_->prefix = ss.str();
+}
+
+MaterialCache::Handle MaterialCache::get(const Ogre::ColourValue& c) {
+    const uint32_t k = key(c);
+    Handle handle = storage_->entries[k].lock();
+    if (handle) {
+        return handle;
+    }
+
+    std::stringstream ss;
+    ss << storage_->prefix << std::hex << std::setfill('0') << std::setw(8) << k;
+    Ogre::MaterialPtr material = materials::createMaterial(ss.str());
+    materials::applyColor(material,
+                      Ogre::ColourValue((k >> 24) / 255.f, ((k >> 16) & 0xff) / 255.f, ((k >> 8) & 0xff) / 255.f,
+                                        (k & 0xff) / 255.f));
+    handle = std::make_shared<const Entry>(storage_, k, material);
+    storage_->entries[k] = handle;
+    return handle;
+}
+
+size_t MaterialCache::size() const {
+    return storage_->entries.size();
+}
+
+uint32_t MaterialCache::key(const Ogre::ColourValue& c) {
+    return quantise(c.r) << 24 | quantise(c.g) << 16 | quantise(c.b) << 8 | quantise(c.a);
+}
+
+MaterialCache::Entry::Entry(const std::shared_ptr<Storage>& storage, uint32_t key, const Ogre::MaterialPtr& material)
+        : storage_(storage), key_(key), material_(material) {
+}
+
+MaterialCache::Entry::~Entry() {
+    std::shared_ptr<Storage> storage = storage_.lock();
+    if (storage) {
+        storage->entries.erase(key_);
+    }
+    Ogre::MaterialManager::getSingleton().remove(material_->getName());
+}
+
+} // namespace rviz
@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizpicking.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <OGRE/OgreSceneNode.h>
+
+#include "internal/util_rvizgrid.hpp"
+
+namespace rviz {
+
+PickingIndex::PickingIndex(float cellSize) : cellSize_(cellSize), query_(0) {
+    MultiShape::addDestructionListener(this);
+}
+
+PickingIndex::~PickingIndex() {
+    MultiShape::removeDestructionListener(this);
+}
+
+void PickingIndex::insert(MultiShape* obj) {
+    if (itemIndices_.count(obj)) {
+        return;
+    }
+    Item item;
+    item.obj = obj;
+    item.local = obj->getLocalBounds();
+    computeBox(item);
+    itemIndices_[obj] = items_.size();
+    items_.push_back(item);
+    visited_.push_back(0);
+    addToCells(items_.size() - 1);
+}
+
+void PickingIndex::remove(MultiShape* obj) {
+    auto it = itemIndices_.find(obj);
+    if (it == itemIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    itemIndices_.erase(it);
+    removeFromCells(index);
+
+    // Fill the gap with the last item
+    const size_t last = items_.size() - 1;
+    if (index != last) {
+        removeFromCells(last);
+        items_[index] = items_[last];
+        itemIndices_[items_[index].obj] = index;
+        addToCells(index);
+    }
+    items_.pop_back();
+    visited_.pop_back();
+}
+
+void PickingIndex::objectDestroyed(MultiShape* obj) {
+    remove(obj);
+}
+
+void PickingIndex::clear() {
+    items_.clear();
+    itemIndices_.clear();
+    cells_.clear();
+    visited_.clear();
+}
+
+void PickingIndex::update(MultiShape* obj, bool force) {
+    auto it = itemIndices_.find(obj);
+    if (it == itemIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    if (!force && items_[index].revision == obj->revision()) {
+        return;
+    }
+    Item updated = items_[index];
+    computeBox(updated);
+    const Item& item = items_[index];
+    if (updated.minX != item.minX || updated.minY != item.minY || updated.maxX != item.maxX ||
+        updated.maxY != item.maxY) {
+        removeFromCells(index);
+        items_[index] = updated;
+        addToCells(index);
+    } else {
+        items_[index] = updated;
+    }
+}
+
+void PickingIndex::updateAll(bool force) {
+    for (const auto& item : items_) {
+        update(item.obj, force);
+    }
+}
+
+bool PickingIndex::raycast(const Ogre::Ray& ray, Hit& hit, float maxDistance) const {
+    const Ogre::Ray normalized(ray.getOrigin(), ray.getDirection().normalisedCopy());
+    const Item* best = NULL;
+    float bestDistance = maxDistance;
+    ++query_;
+    forEachCellOnRay(normalized, maxDistance, [&](const std::vector<size_t>& items, float enter) {
+        // No object in this or later cells can be hit before the best hit so far
+        if (best && bestDistance <= enter) {
+            return false;
+        }
+        for (size_t i : items) {
+            float distance;
+            if (visited_[i] != query_ && intersect(items_[i], normalized, distance) && distance < bestDistance) {
+                best = &items_[i];
+                bestDistance = distance;
+            }
+            visited_[i] = query_;
+        }
+        return true;
+    });
+    if (!best) {
+        return false;
+    }
+    hit = Hit{best->obj, &best->obj->getUserData(), bestDistance};
+    return true;
+}
+
+void PickingIndex::raycastAll(const Ogre::Ray& ray, std::vector<Hit>& result, float maxDistance) const {
+    const Ogre::Ray normalized(ray.getOrigin(), ray.getDirection().normalisedCopy());
+    const size_t first = result.size();
+    ++query_;
+    forEachCellOnRay(normalized, maxDistance, [&](const std::vector<size_t>& items, float) {
+        for (size_t i : items) {
+            float distance;
+            if (visited_[i] != query_ && intersect(items_[i], normalized, distance) && distance <= maxDistance) {
+                result.push_back(Hit{items_[i].obj, &items_[i].obj->getUserData(), distance});
+            }
+            visited_[i] = query_;
+        }
+        return true;
+    });
+    std::sort(result.begin() + first, result.end(), [](const Hit& a, const Hit& b) { return a.distance < b.distance; });
+}
+
+void PickingIndex::querySelection(Ogre::Camera* camera,
+                                  float left,
+                                  float top,
+                                  float right,
+                                  float bottom,
+                                  std::vector<Hit>& result) const {
+    const Ogre::PlaneBoundedVolume volume = camera->getCameraToViewportBoxVolume(left, top, right, bottom, true);
+    const Ogre::Vector3& eye = camera->getDerivedPosition();
+    ++query_;
+    auto test = [&](size_t i) {
+        if (visited_[i] == query_) {
+            return;
+        }
+        visited_[i] = query_;
+        const Item& item = items_[i];
+        if (!pickable(item)) {
+            return;
+        }
+        const Ogre::Vector3 axes[3] = {item.orientation.xAxis() * item.halfSize.x,
+                                       item.orientation.yAxis() * item.halfSize.y,
+                                       item.orientation.zAxis() * item.halfSize.z};
+        for (const auto& plane : volume.planes) {
+            // Projected radius of the box onto the plane normal
+            const float radius = std::abs(plane.normal.dotProduct(axes[0])) +
+                                 std::abs(plane.normal.dotProduct(axes[1])) +
+                                 std::abs(plane.normal.dotProduct(axes[2]));
+            float distance = plane.getDistance(item.center);
+            if (volume.outside == Ogre::Plane::POSITIVE_SIDE) {
+                distance = -distance;
+            }
+            if (distance < -radius) {
+                return;
+            }
+        }
+        result.push_back(Hit{item.obj, &item.obj->getUserData(), item.center.distance(eye)});
+    };
+
+    int32_t minX, minY, maxX, maxY;
+    if (!selectionCells(camera, left, top, right, bottom, minX, minY, maxX, maxY)) {
+        // Without a far plane the selection is unbounded, all cells have to be tested
+        for (const auto& cell : cells_) {
+            std::for_each(cell.second.begin(), cell.second.end(), test);
+        }
+        return;
+    }
+
+    // Look up the cells of the selection, or walk the occupied cells if there are fewer of them
+    const uint64_t selected = (static_cast<uint64_t>(static_cast<int64_t>(maxX) - minX) + 1) *
+                              (static_cast<uint64_t>(static_cast<int64_t>(maxY) - minY) + 1);
+    if (selected <= cells_.size()) {
+        for (int32_t x = minX; x <= maxX; ++x) {
+            for (int32_t y = minY; y <= maxY; ++y) {
+                auto it = cells_.find(grid::cellKey(x, y));
+                if (it != cells_.end()) {
+                    std::for_each(it->second.begin(), it->second.end(), test);
+                }
+            }
+        }
+        return;
+    }
+    for (const auto& cell : cells_) {
+        const int32_t x = static_cast<int32_t>(static_cast<uint64_t>(cell.first) >> 32);
+        const int32_t y = static_cast<int32_t>(static_cast<uint32_t>(cell.first));
+        if (x >= minX && x <= maxX && y >= minY && y <= maxY) {
+            std::for_each(cell.second.begin(), cell.second.end(), test);
+        }
+    }
+}
+
+bool PickingIndex::selectionCells(Ogre::Camera* camera,
+                                  float left,
+                                  float top,
+                                  float right,
+                                  float bottom,
+                                  int32_t& minX,
+                                  int32_t& minY,
+                                  int32_t& maxX,
+                                  int32_t& maxY) const {
+    const float farDistance = camera->getFarClipDistance();
+    if (farDistance <= 0.f) {
+        return false;
+    }
+    // The selection is the frustum spanned by the rays through the corners of the rectangle, cut at the far plane
+    const Ogre::Vector3 forward = camera->getDerivedDirection();
+    const float corners[4][2] = {{left, top}, {right, top}, {left, bottom}, {right, bottom}};
+    float lowerX = std::numeric_limits<float>::max(), lowerY = lowerX;
+    float upperX = -std::numeric_limits<float>::max(), upperY = upperX;
+    for (const auto& corner : corners) {
+        const Ogre::Ray ray = camera->getCameraToViewportRay(corner[0], corner[1]);
+        const float cosine = ray.getDirection().dotProduct(forward);
+        if (cosine <= 0.f) {
+            return false;
+        }
+        for (const Ogre::Vector3& p : {ray.getOrigin(), ray.getPoint(farDistance / cosine)}) {
+            lowerX = std::min(lowerX, p.x);
+            lowerY = std::min(lowerY, p.y);
+            upperX = std::max(upperX, p.x);
+            upperY = std::max(upperY, p.y);
+        }
+    }
+    // Cell coordinates have to fit into int32_t
+    const float limit = 1e9f * cellSize_;
+    if (!(lowerX > -limit && lowerY > -limit && upperX < limit && upperY < limit)) {
+        return false;
+    }
+    minX = cellCoordinate(lowerX);
+    minY = cellCoordinate(lowerY);
+    maxX = cellCoordinate(upperX);
+    maxY = cellCoordinate(upperY);
+    return true;
+}
+
+int32_t PickingIndex::cellCoordinate(float v) const {
+    return grid::cellCoordinate(v, cellSize_);
+}
+
+void PickingIndex::computeBox(Item& item) {
+    Ogre::SceneNode* node = item.obj->getRootNode();
+    const Ogre::Vector3& scale = node->_getDerivedScale();
+    item.revision = item.obj->revision();
+    item.orientation = node->_getDerivedOrientation();
+    item.halfSize = item.local.isNull() ? Ogre::Vector3::ZERO : item.local.getHalfSize() * scale;
+    item.center = node->_getDerivedPosition() +
+                  item.orientation * (item.local.isNull() ? Ogre::Vector3::ZERO : item.local.getCenter() * scale);
+
+    // Extent of the rotated box on the XY plane
+    const float extentX = std::abs(item.orientation.xAxis().x) * item.halfSize.x +
+                          std::abs(item.orientation.yAxis().x) * item.halfSize.y +
+                          std::abs(item.orientation.zAxis().x) * item.halfSize.z;
+    const float extentY = std::abs(item.orientation.xAxis().y) * item.halfSize.x +
+                          std::abs(item.orientation.yAxis().y) * item.halfSize.y +
+                          std::abs(item.orientation.zAxis().y) * item.halfSize.z;
+    item.minX = cellCoordinate(item.center.x - extentX);
+    item.maxX = cellCoordinate(item.center.x + extentX);
+    item.minY = cellCoordinate(item.center.y - extentY);
+    item.maxY = cellCoordinate(item.center.y + extentY);
+}
+
+void PickingIndex::addToCells(size_t index) {
+    const Item& item = items_[index];
+    for (int32_t x = item.minX; x <= item.maxX; ++x) {
+        for (int32_t y = item.minY; y <= item.maxY; ++y) {
+            cells_[grid::cellKey(x, y)].push_back(index);
+        }
+    }
+}
+
+void PickingIndex::removeFromCells(size_t index) {
+    const Item& item = items_[index];
+    for (int32_t x = item.minX; x <= item.maxX; ++x) {
+        for (int32_t y = item.minY; y <= item.maxY; ++y) {
+            auto it = cells_.find(grid::cellKey(x, y));
+            if (it == cells_.end()) {
+                continue;
+            }
+            auto& indices = it->second;
+            indices.erase(std::remove(indices.begin(), indices.end(), index), indices.end());
+            if (indices.empty()) {
+                cells_.erase(it);
+            }
+        }
+    }
+}
+
+bool PickingIndex::pickable(const Item& item) const {
+    return item.obj->isVisible() && item.obj->getLodLevel() != MultiShape::LodHidden;
+}
+
+bool PickingIndex::intersect(const Item& item, const Ogre::Ray& ray, float& distance) const {
+    if (!pickable(item)) {
+        return false;
+    }
+    // Intersect in the frame of the box, where it is axis aligned
+    const Ogre::Quaternion inverse = item.orientation.Inverse();
+    const Ogre::Ray local(inverse * (ray.getOrigin() - item.center), inverse * ray.getDirection());
+    const std::pair<bool, Ogre::Real> hit = local.intersects(Ogre::AxisAlignedBox(-item.halfSize, item.halfSize));
+    distance = hit.second;
+    return hit.first;
+}
+
+template <typename Function>
+void PickingIndex::forEachCellOnRay(const Ogre::Ray& ray, float maxDistance, Function&& f) const {
+    // Walk the cells crossed by the projection of the ray onto the XY plane (2D DDA)
+    const Ogre::Vector3& o = ray.getOrigin();
+    const Ogre::Vector3& d = ray.getDirection();
+    const float infinity = std::numeric_limits<float>::infinity();
+    int32_t x = cellCoordinate(o.x);
+    int32_t y = cellCoordinate(o.y);
+    const int32_t stepX = d.x > 0 ? 1 : -1;
+    const int32_t stepY = d.y > 0 ? 1 : -1;
+    const float deltaX = d.x != 0 ? cellSize_ / std::abs(d.x) : infinity;
+    const float deltaY = d.y != 0 ? cellSize_ / std::abs(d.y) : infinity;
+    float nextX = d.x != 0 ? ((x + (stepX > 0)) * cellSize_ - o.x) / d.x : infinity;
+    float nextY = d.y != 0 ? ((y + (stepY > 0)) * cellSize_ - o.y) / d.y : infinity;
+
+    float enter = 0.f;
+    while (enter <= maxDistance) {
+        auto it = cells_.find(grid::cellKey(x, y));
+        if (it != cells_.end() && !f(it->second, enter)) {
+            return;
+        }
+        if (nextX < nextY) {
+            enter = nextX;
+            nextX += deltaX;
+            x += stepX;
+        } else {
+            enter = nextY;
+            nextY += deltaY;
+            y += stepY;
+        }
+    }
+}
+
+} // namespace rviz
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizprewarm.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreMeshManager.h>
+
+#include "util_rvizbaked.hpp"
+
+namespace util_rviz {
+
+namespace {
+class StepTimer {
+public:
+    StepTimer(PrewarmResult& result, const char* name)
+            : result_(result), name_(name), start_(std::chrono::steady_clock::now()) {
+    }
+    ~StepTimer() {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+        result_.steps.push_back(PrewarmResult::Step{name_, elapsed.count()});
+    }
+
+private:
+    PrewarmResult& result_;
+    const char* name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+template <typename Descriptor>
+void bakeMesh(Ogre::SceneManager* scene_manager) {
+    // Same name as used by ArchetypeShape, so that the instances find the mesh
+    rviz::baked::getOrCreateMesh(scene_manager, std::string("UtilRvizBaked") + Descriptor::name(),
+                                 rviz::ArchetypeShape<Descriptor>::descriptions());
+}
+} // namespace
+
+double PrewarmResult::totalSeconds() const {
+    double total = 0.;
+    for (const auto& s : steps) {
+        total += s.seconds;
+    }
+    return total;
+}
+
+std::string PrewarmResult::toString() const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    for (const auto& s : steps) {
+        ss << s.name << ": " << s.seconds * 1e3 << " ms, ";
+    }
+    ss << "total: " << totalSeconds() * 1e3 << " ms";
+    return ss.str();
+}
+
+PrewarmResult prewarm(Ogre::SceneManager* scene_manager, const PrewarmOptions& options) {
+    PrewarmResult result;
+    {
+        StepTimer timer(result, "meshes");
+        std::set<rviz::Shape::Type> types;
+        for (const auto* descriptions : {&rviz::SimpleCar::descriptions(), &rviz::SimpleBike::descriptions(),
+                                         &rviz::SimplePedestrian::descriptions(),
+                                         &rviz::SimpleUnknown::descriptions()}) {
+            for (const auto& d : *descriptions) {
+                types.insert(d.type);
+            }
+        }
+        for (auto type : types) {
+            const std::string name = rviz::baked::primitiveMeshName(type);
+            if (!name.empty()) {
+                Ogre::MeshManager::getSingleton().load(name, "rviz");
+            }
+        }
+    }
+    if (options.baked) {
+        StepTimer timer(result, "baked meshes");
+        bakeMesh<rviz::CarDescriptor>(scene_manager);
+        bakeMesh<rviz::BikeDescriptor>(scene_manager);
+        bakeMesh<rviz::PedestrianDescriptor>(scene_manager);
+        bakeMesh<rviz::UnknownDescriptor>(scene_manager);
+    }
+    {
+        StepTimer timer(result, "materials");
+        // Loading a material set up like those of rviz::Shape loads the programs and textures it refers to
+        Ogre::MaterialPtr base = rviz::materials::createMaterial("UtilRvizPrewarmMaterial");
+        base->load();
+        Ogre::MaterialManager::getSingleton().remove(base->getName());
+        if (options.materialCache) {
+            for (const auto& c : options.colors) {
+                result.materials.push_back(options.materialCache->get(c));
+                result.materials.back()->material()->load();
+            }
+        }
+    }
+    if (options.instancesPerArchetype > 0) {
+        StepTimer timer(result, "instances");
+        for (auto archetype : {rviz::Archetype::Car, rviz::Archetype::Bike, rviz::Archetype::Pedestrian,
+                               rviz::Archetype::Unknown}) {
+            for (size_t i = 0; i < options.instancesPerArchetype; ++i) {
+                result.instances.push_back(
+                    rviz::createArchetype(archetype, scene_manager, options.parent_node, options.baked));
+                result.instances.back()->visible(false);
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace util_rviz
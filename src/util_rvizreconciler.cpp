@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizreconciler.hpp"
+
+namespace rviz {
+
+Reconciler::Reconciler(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node, bool baked)
+        : parent_node_(parent_node), frame_(0) {
+    const size_t spareLimit = 64;
+    pools_.reserve(4);
+    for (Archetype archetype : {Archetype::Car, Archetype::Bike, Archetype::Pedestrian, Archetype::Unknown}) {
+        pools_.emplace_back(scene_manager, 0, spareLimit, [archetype, baked](Ogre::SceneManager* s) {
+            return createArchetype(archetype, s, NULL, baked);
+        });
+    }
+}
+
+Reconciler::Result Reconciler::apply(const AgentState* agents, size_t count) {
+    Result result{0, 0, 0, 0};
+    ++frame_;
+    for (size_t i = 0; i < count; ++i) {
+        const AgentState& agent = agents[i];
+        const uint32_t index = indices_.find(agent.id);
+        if (index == IdIndexMap::Missing) {
+            Entry entry{agent, acquire(agent.archetype), frame_};
+            entry.shape->setPosition(agent.position);
+            entry.shape->setOrientation(agent.orientation);
+            applyColor(*entry.shape, agent);
+            indices_.insert(agent.id, static_cast<uint32_t>(entries_.size()));
+            entries_.push_back(std::move(entry));
+            ++result.added;
+            continue;
+        }
+
+        Entry& entry = entries_[index];
+        entry.frame = frame_;
+        bool changed = false;
+        if (entry.state.archetype != agent.archetype) {
+            retype(entry, agent.archetype);
+            ++result.retyped;
+            changed = true;
+        }
+        if (changed || entry.state.position != agent.position) {
+            entry.shape->setPosition(agent.position);
+            changed = true;
+        }
+        if (changed || entry.state.orientation != agent.orientation) {
+            entry.shape->setOrientation(agent.orientation);
+            changed = true;
+        }
+        if (changed || entry.state.color != agent.color || entry.state.colorPartly != agent.colorPartly) {
+            applyColor(*entry.shape, agent);
+            changed = true;
+        }
+        if (changed) {
+            entry.state = agent;
+            ++result.updated;
+        }
+    }
+
+    // Remove the objects that were not listed, filling the gaps with the last entries
+    for (size_t i = 0; i < entries_.size();) {
+        if (entries_[i].frame == frame_) {
+            ++i;
+            continue;
+        }
+        indices_.erase(entries_[i].state.id);
+        // Returns the object to its pool, unless it is still referenced elsewhere
+        entries_[i].shape.reset();
+        if (i != entries_.size() - 1) {
+            entries_[i] = std::move(entries_.back());
+            indices_.insert(entries_[i].state.id, static_cast<uint32_t>(i));
+        }
+        entries_.pop_back();
+        ++result.removed;
+    }
+    return result;
+}
+
+std::shared_ptr<MultiShape> Reconciler::find(uint64_t id) const {
+    const uint32_t index = indices_.find(id);
+    return index == IdIndexMap::Missing ? nullptr : entries_[index].shape;
+}
+
+void Reconciler::clear() {
+    entries_.clear();
+    indices_.clear();
+    for (auto& pool : pools_) {
+        pool.clear();
+    }
+}
+
+void Reconciler::setSpareLimit(size_t limit) {
+    for (auto& pool : pools_) {
+        pool.setHighWaterMark(limit);
+    }
+}
+
+std::shared_ptr<MultiShape> Reconciler::acquire(Archetype archetype) {
+    return pools_[static_cast<size_t>(archetype)].acquire(parent_node_);
+}
+
+void Reconciler::applyColor(MultiShape& shape, const AgentState& agent) {
+    SimpleCar* car = agent.colorPartly ? dynamic_cast<SimpleCar*>(&shape) : NULL;
+    if (car) {
+        car->setColorPartly(agent.color);
+    } else {
+        shape.setColor(agent.color);
+    }
+}
+
+void Reconciler::retype(Entry& entry, Archetype archetype) {
+    // Only the entry is kept, the object has to be of the class of the new archetype
+    std::shared_ptr<MultiShape> shape = acquire(archetype);
+    MultiShape& old = *entry.shape;
+    shape->setScale(old.getRootNode()->getScale());
+    shape->setUserData(old.getUserData());
+    shape->visible(old.isVisible());
+    entry.shape = std::move(shape);
+    entry.state.archetype = archetype;
+}
+
+} // namespace rviz
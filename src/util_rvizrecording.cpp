@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizrecording.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rviz {
+
+namespace {
+const char magic[8] = {'U', 'R', 'V', 'Z', 'R', 'E', 'C', '1'};
+const uint32_t version = 2; // Version 1 had no AgentRecord::colorSet
+
+recording::AgentRecord makeRecord(const AgentScene& scene, size_t i) {
+    recording::AgentRecord r;
+    std::memset(&r, 0, sizeof(r));
+    r.id = scene.ids()[i];
+    const Ogre::Vector3& p = scene.positions()[i];
+    const Ogre::Quaternion& q = scene.orientations()[i];
+    const Ogre::Vector3& s = scene.scales()[i];
+    const Ogre::ColourValue& c = scene.colors()[i];
+    r.position[0] = p.x;
+    r.position[1] = p.y;
+    r.position[2] = p.z;
+    r.orientation[0] = q.w;
+    r.orientation[1] = q.x;
+    r.orientation[2] = q.y;
+    r.orientation[3] = q.z;
+    r.scale[0] = s.x;
+    r.scale[1] = s.y;
+    r.scale[2] = s.z;
+    r.color[0] = c.r;
+    r.color[1] = c.g;
+    r.color[2] = c.b;
+    r.color[3] = c.a;
+    r.archetype = static_cast<uint8_t>(scene.archetypes()[i]);
+    r.visible = scene.visibilities()[i];
+    r.colorPartly = scene.colorsPartly()[i];
+    r.colorSet = scene.colorsSet()[i];
+    return r;
+}
+
+template <typename T>
+void append(std::vector<char>& buffer, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+} // namespace
+
+SceneRecorder::SceneRecorder(const std::string& path, uint32_t keyframeInterval)
+        : file_(std::fopen(path.c_str(), "wb")), keyframeInterval_(std::max<uint32_t>(keyframeInterval, 1)),
+          frameCount_(0) {
+    if (!file_) {
+        throw std::runtime_error("Could not open " + path + " for recording.");
+    }
+    recording::FileHeader header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.keyframeInterval = keyframeInterval_;
+    std::fwrite(&header, sizeof(header), 1, file_);
+}
+
+SceneRecorder::~SceneRecorder() {
+    std::fclose(file_);
+}
+
+void SceneRecorder::record(const ros::Time& stamp, const AgentScene& scene) {
+    const bool keyframe = frameCount_ % keyframeInterval_ == 0;
+    const uint64_t frame = frameCount_++;
+
+    buffer_.clear();
+    buffer_.resize(sizeof(recording::FrameHeader));
+    uint32_t records = 0;
+    for (size_t i = 0; i < scene.size(); ++i) {
+        const recording::AgentRecord r = makeRecord(scene, i);
+        auto it = previous_.find(r.id);
+        const bool changed = it == previous_.end() || std::memcmp(&it->second.record, &r, sizeof(r)) != 0;
+        if (it == previous_.end()) {
+            it = previous_.emplace(r.id, Previous{r, frame}).first;
+        }
+        it->second.record = r;
+        it->second.frame = frame;
+        if (keyframe || changed) {
+            append(buffer_, r);
+            ++records;
+        }
+    }
+
+    // Agents that were not seen in this frame were removed
+    removed_.clear();
+    for (auto it = previous_.begin(); it != previous_.end();) {
+        if (it->second.frame != frame) {
+            removed_.push_back(it->first);
+            it = previous_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (!keyframe) {
+        for (uint64_t id : removed_) {
+            append(buffer_, id);
+        }
+    }
+
+    recording::FrameHeader header;
+    header.stamp = stamp.toNSec();
+    header.flags = keyframe ? static_cast<uint32_t>(recording::FrameHeader::Keyframe) : 0;
+    header.records = records;
+    header.removed = keyframe ? 0 : static_cast<uint32_t>(removed_.size());
+    header.reserved = 0;
+    std::memcpy(buffer_.data(), &header, sizeof(header));
+    if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+        throw std::runtime_error("Could not write recording.");
+    }
+}
+
+void SceneRecorder::flush() {
+    std::fflush(file_);
+}
+
+ScenePlayer::ScenePlayer(const std::string& path, AgentScene& scene)
+        : scene_(scene), data_(NULL), size_(0), current_(-1) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open recording " + path + ".");
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(recording::FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Could not read recording " + path + ".");
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    void* mapped = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Could not map recording " + path + ".");
+    }
+    data_ = static_cast<const char*>(mapped);
+
+    const recording::FileHeader* fileHeader = reinterpret_cast<const recording::FileHeader*>(data_);
+    if (std::memcmp(fileHeader->magic, magic, sizeof(magic)) != 0 || fileHeader->version != version) {
+        ::munmap(const_cast<char*>(data_), size_);
+        throw std::runtime_error(path + " is not a recording of this version.");
+    }
+
+    // Index the frames, a truncated last frame (e.g. after a crash) is ignored
+    size_t offset = sizeof(recording::FileHeader);
+    size_t keyframe = 0;
+    while (offset + sizeof(recording::FrameHeader) <= size_) {
+        const recording::FrameHeader* h = reinterpret_cast<const recording::FrameHeader*>(data_ + offset);
+        const size_t frameSize = sizeof(recording::FrameHeader) + h->records * sizeof(recording::AgentRecord) +
+                                 h->removed * sizeof(uint64_t);
+        if (offset + frameSize > size_) {
+            break;
+        }
+        if (h->flags & recording::FrameHeader::Keyframe) {
+            keyframe = frames_.size();
+        }
+        frames_.push_back(offset);
+        keyframes_.push_back(keyframe);
+        offset += frameSize;
+    }
+}
+
+ScenePlayer::~ScenePlayer() {
+    ::munmap(const_cast<char*>(data_), size_);
+}
+
+ros::Time ScenePlayer::frameStamp(size_t frame) const {
+    ros::Time stamp;
+    stamp.fromNSec(header(frame).stamp);
+    return stamp;
+}
+
+const recording::FrameHeader& ScenePlayer::header(size_t frame) const {
+    return *reinterpret_cast<const recording::FrameHeader*>(data_ + frames_[frame]);
+}
+
+void ScenePlayer::seek(const ros::Time& stamp) {
+    if (frames_.empty()) {
+        return;
+    }
+    // Binary search on the frame stamps
+    const uint64_t ns = stamp.toNSec();
+    auto it = std::upper_bound(frames_.begin(), frames_.end(), ns, [this](uint64_t t, size_t offset) {
+        return t < reinterpret_cast<const recording::FrameHeader*>(data_ + offset)->stamp;
+    });
+    const int64_t target = it == frames_.begin() ? 0 : (it - frames_.begin()) - 1;
+    if (target == current_) {
+        return;
+    }
+
+    const size_t keyframe = keyframes_[target];
+    if (current_ >= static_cast<int64_t>(keyframe) && current_ < target) {
+        // Forward within the frames of a keyframe: The deltas are exactly the differences
+        for (int64_t f = current_ + 1; f <= target; ++f) {
+            applyFrame(f, state_, true);
+        }
+        current_ = target;
+        return;
+    }
+
+    State state;
+    for (size_t f = keyframe; f <= static_cast<size_t>(target); ++f) {
+        applyFrame(f, state, false);
+    }
+    for (auto i = state_.begin(); i != state_.end();) {
+        if (!state.count(i->first)) {
+            removeAgent(i->first);
+            i = state_.erase(i);
+        } else {
+            ++i;
+        }
+    }
+    for (const auto& entry : state) {
+        auto previous = state_.find(entry.first);
+        if (previous == state_.end() ||
+            std::memcmp(&previous->second, &entry.second, sizeof(recording::AgentRecord)) != 0) {
+            applyRecord(entry.second);
+        }
+    }
+    state_.swap(state);
+    current_ = target;
+}
+
+void ScenePlayer::applyFrame(size_t frame, State& state, bool toScene) {
+    const recording::FrameHeader& h = header(frame);
+    const recording::AgentRecord* records = reinterpret_cast<const recording::AgentRecord*>(&h + 1);
+    const uint64_t* removed = reinterpret_cast<const uint64_t*>(records + h.records);
+    if (h.flags & recording::FrameHeader::Keyframe) {
+        state.clear();
+    }
+    for (uint32_t i = 0; i < h.records; ++i) {
+        state[records[i].id] = records[i];
+        if (toScene) {
+            applyRecord(records[i]);
+        }
+    }
+    for (uint32_t i = 0; i < h.removed; ++i) {
+        state.erase(removed[i]);
+        if (toScene) {
+            removeAgent(removed[i]);
+        }
+    }
+}
+
+void ScenePlayer::applyRecord(const recording::AgentRecord& r) {
+    const Archetype archetype = static_cast<Archetype>(r.archetype);
+    auto it = slots_.find(r.id);
+    // A color cannot be unset, so an agent that lost its color (i.e. the id was reused) is recreated
+    if (it != slots_.end() && (scene_.archetypes()[scene_.index(it->second)] != archetype ||
+                               (scene_.colorsSet()[scene_.index(it->second)] && !r.colorSet))) {
+        removeAgent(r.id);
+        it = slots_.end();
+    }
+    if (it == slots_.end()) {
+        it = slots_.emplace(r.id, scene_.add(r.id, archetype)).first;
+    }
+    const AgentScene::Slot slot = it->second;
+    scene_.setPosition(slot, Ogre::Vector3(r.position[0], r.position[1], r.position[2]));
+    scene_.setOrientation(slot,
+                          Ogre::Quaternion(r.orientation[0], r.orientation[1], r.orientation[2], r.orientation[3]));
+    scene_.setScale(slot, Ogre::Vector3(r.scale[0], r.scale[1], r.scale[2]));
+    // Agents without a color keep the default colors of their shape
+    if (r.colorSet) {
+        const Ogre::ColourValue c(r.color[0], r.color[1], r.color[2], r.color[3]);
+        if (r.colorPartly) {
+            scene_.setColorPartly(slot, c);
+        } else {
+            scene_.setColor(slot, c);
+        }
+    }
+    scene_.setVisible(slot, r.visible);
+}
+
+void ScenePlayer::removeAgent(uint64_t id) {
+    auto it = slots_.find(id);
+    if (it != slots_.end()) {
+        scene_.remove(it->second);
+        slots_.erase(it);
+    }
+}
+
+} // namespace rviz
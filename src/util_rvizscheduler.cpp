@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizscheduler.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include "util_rvizstats.hpp"
+
+namespace rviz {
+
+UpdateScheduler::UpdateScheduler(const SchedulerSettings& settings) : settings_(settings) {
+    MultiShape::addDestructionListener(this);
+}
+
+UpdateScheduler::~UpdateScheduler() {
+    MultiShape::removeDestructionListener(this);
+}
+
+void UpdateScheduler::setPosition(MultiShape* obj, const Ogre::Vector3& position) {
+    pendingUpdate(obj).setPosition(position);
+}
+
+void UpdateScheduler::setOrientation(MultiShape* obj, const Ogre::Quaternion& orientation) {
+    pendingUpdate(obj).setOrientation(orientation);
+}
+
+void UpdateScheduler::setColor(MultiShape* obj, const Ogre::ColourValue& c) {
+    pendingUpdate(obj).setColor(c);
+}
+
+void UpdateScheduler::setColorPartly(MultiShape* obj, const Ogre::ColourValue& c) {
+    pendingUpdate(obj).setColorPartly(c);
+}
+
+void UpdateScheduler::visible(MultiShape* obj, bool visible) {
+    pendingUpdate(obj).setVisible(visible);
+}
+
+void UpdateScheduler::schedule(MultiShape* obj, const ShapeUpdate& update) {
+    pendingUpdate(obj).merge(update);
+}
+
+void UpdateScheduler::remove(MultiShape* obj) {
+    auto it = pendingIndices_.find(obj);
+    if (it == pendingIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    pendingIndices_.erase(it);
+
+    // Fill the gap with the last update
+    if (index != pending_.size() - 1) {
+        pending_[index] = pending_.back();
+        pendingIndices_[pending_[index].obj] = index;
+    }
+    pending_.pop_back();
+}
+
+void UpdateScheduler::objectDestroyed(MultiShape* obj) {
+    remove(obj);
+}
+
+void UpdateScheduler::clear() {
+    pending_.clear();
+    pendingIndices_.clear();
+}
+
+const UpdateScheduler::FrameStatistics& UpdateScheduler::apply(const Ogre::Vector3& eye) {
+    util_rviz::stats::ScopedTimer timer(util_rviz::stats::ScheduledUpdates);
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline =
+        start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings_.budget));
+    FrameStatistics frame;
+
+    // Overdue updates are applied right away, the others are ordered by their distance, shrunk by their age
+    order_.clear();
+    applied_.assign(pending_.size(), 0);
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        const Pending& p = pending_[i];
+        const double age = std::chrono::duration<double>(start - p.since).count();
+        if (age >= settings_.maxAge) {
+            p.update.applyTo(*p.obj);
+            applied_[i] = 1;
+            ++frame.applied;
+            ++frame.overdue;
+            continue;
+        }
+        const Ogre::Vector3& position =
+            p.update.fields & ShapeUpdate::Position ? p.update.position : p.obj->getPosition();
+        order_.emplace_back(eye.distance(position) / (1. + age / settings_.ageScale), static_cast<uint32_t>(i));
+    }
+
+    // A heap, as usually only the front of the order fits into the budget
+    typedef std::pair<double, uint32_t> Entry;
+    std::make_heap(order_.begin(), order_.end(), std::greater<Entry>());
+    while (!order_.empty()) {
+        // Reading the clock is not free, so it is only checked every few updates
+        if (frame.applied >= settings_.minPerFrame && frame.applied % 8 == 0 && Clock::now() >= deadline) {
+            break;
+        }
+        std::pop_heap(order_.begin(), order_.end(), std::greater<Entry>());
+        const uint32_t i = order_.back().second;
+        order_.pop_back();
+        pending_[i].update.applyTo(*pending_[i].obj);
+        applied_[i] = 1;
+        ++frame.applied;
+    }
+
+    // Keep the deferred updates
+    size_t kept = 0;
+    double totalAge = 0.;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (applied_[i]) {
+            pendingIndices_.erase(pending_[i].obj);
+            continue;
+        }
+        const double age = std::chrono::duration<double>(start - pending_[i].since).count();
+        totalAge += age;
+        frame.maxAge = std::max(frame.maxAge, age);
+        if (kept != i) {
+            pending_[kept] = pending_[i];
+            pendingIndices_[pending_[kept].obj] = kept;
+        }
+        ++kept;
+    }
+    pending_.resize(kept);
+    frame.deferred = kept;
+    frame.meanAge = kept ? totalAge / kept : 0.;
+    frame.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    lastFrame_ = frame;
+    return lastFrame_;
+}
+
+void UpdateScheduler::flush() {
+    for (const auto& p : pending_) {
+        p.update.applyTo(*p.obj);
+    }
+    clear();
+}
+
+ShapeUpdate& UpdateScheduler::pendingUpdate(MultiShape* obj) {
+    auto it = pendingIndices_.find(obj);
+    if (it != pendingIndices_.end()) {
+        return pending_[it->second].update;
+    }
+    pendingIndices_[obj] = pending_.size();
+    pending_.push_back(Pending{obj, ShapeUpdate::none(), Clock::now()});
+    return pending_.back().update;
+}
+
+} // namespace rviz
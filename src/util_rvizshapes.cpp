@@ -30,44 +30,202 @@
 
 #include "util_rvizshapes.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+
+#include <OGRE/OgreEntity.h>
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreSubEntity.h>
+#include <OGRE/OgreTechnique.h>
+
+#include "util_rvizbaked.hpp"
+
 namespace rviz {
 
-MultiShape::MultiShape(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node) : Object(scene_manager) {
+namespace {
+std::vector<MultiShape::DestructionListener*>& destructionListeners() {
+    // Never destroyed, so that objects outliving static destruction can still be destroyed
+    static auto* listeners = new std::vector<MultiShape::DestructionListener*>;
+    return *listeners;
+}
+} // namespace
+
+MultiShape::MultiShape(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node)
+        : Object(scene_manager), baked_(false), materialized_(true), bakedEntity_(NULL), changeEpsilon_(1e-5f),
+          dirtyFlags_(0), revision_(0), visible_(true), colorMode_(ColorMode::Unset), lodLevel_(LodFull) {
     if (!parent_node) {
         parent_node = scene_manager_->getRootSceneNode();
     }
     scene_node_ = parent_node->createChildSceneNode();
+    footprint::registerObject(this);
 }
 
 
 MultiShape::~MultiShape() {
+    for (DestructionListener* listener : destructionListeners()) {
+        listener->objectDestroyed(this);
+    }
+    footprint::unregisterObject(this);
+    if (bakedEntity_) {
+        scene_manager_->destroyEntity(bakedEntity_);
+        for (const auto& m : bakedMaterials_) {
+            Ogre::MaterialManager::getSingleton().remove(m->getName());
+        }
+    }
     scene_manager_->destroySceneNode(scene_node_->getName());
 }
+void MultiShape::addDestructionListener(DestructionListener* listener) {
+    destructionListeners().push_back(listener);
+}
+void MultiShape::removeDestructionListener(DestructionListener* listener) {
+    auto& listeners = destructionListeners();
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+}
 void MultiShape::visible(bool vis) {
+    if (vis == visible_) {
+        return;
+    }
     scene_node_->setVisible(vis);
+    visible_ = vis;
+    markDirty(DirtyVisibility);
+    if (vis) {
+        materializeLodLevel();
+        applyLodVisibility();
+    } else {
+        hiddenSince_ = std::chrono::steady_clock::now();
+    }
 }
 void MultiShape::setColor(float r, float g, float b, float a) {
     MultiShape::setColor(Ogre::ColourValue(r, g, b, a));
 }
 
 void MultiShape::setColor(const Ogre::ColourValue& c) {
-    for (auto s : shapes_) {
-        s->setColor(c);
+    if (!updateColorCache(c, ColorMode::All)) {
+        util_rviz::stats::add(util_rviz::stats::ColorSkipped);
+        return;
     }
+    util_rviz::stats::add(util_rviz::stats::ColorApplied);
+    applyColor(c, true, ShapeDescription::Colored);
 }
 void MultiShape::setPosition(const Ogre::Vector3& position) {
-    util_rviz::setPositionSafely(scene_node_, position);
+    if (scene_node_->getPosition().positionEquals(position, changeEpsilon_)) {
+        return;
+    }
+    if (util_rviz::setPositionSafely(scene_node_, position)) {
+        markDirty(DirtyPosition);
+    }
 }
 void MultiShape::setOrientation(const Ogre::Quaternion& orientation) {
-    util_rviz::setOrientationSafely(scene_node_, orientation);
+    const Ogre::Quaternion& current = scene_node_->getOrientation();
+    if (std::abs(current.w - orientation.w) <= changeEpsilon_ && std::abs(current.x - orientation.x) <= changeEpsilon_ &&
+        std::abs(current.y - orientation.y) <= changeEpsilon_ && std::abs(current.z - orientation.z) <= changeEpsilon_) {
+        return;
+    }
+    if (util_rviz::setOrientationSafely(scene_node_, orientation)) {
+        markDirty(DirtyOrientation);
+    }
 }
 void MultiShape::setScale(const Ogre::Vector3& scale) {
-    scene_node_->setScale(scale);
+    if (scene_node_->getScale().positionEquals(scale, changeEpsilon_)) {
+        return;
+    }
+    if (util_rviz::setScaleSafely(scene_node_, scale)) {
+        markDirty(DirtyScale);
+    }
 }
 void MultiShape::setUserData(const Ogre::Any& data) {
+    userData_ = data;
     for (auto s : shapes_) {
         s->setUserData(data);
     }
+    if (bakedEntity_) {
+        bakedEntity_->getUserObjectBindings().setUserAny(data);
+    }
+    if (lodProxy_) {
+        lodProxy_->setUserData(data);
+    }
+}
+void MultiShape::attach(Ogre::SceneNode* parent_node) {
+    detach();
+    if (!parent_node) {
+        parent_node = scene_manager_->getRootSceneNode();
+    }
+    parent_node->addChild(scene_node_);
+}
+void MultiShape::detach() {
+    if (scene_node_->getParent()) {
+        scene_node_->getParent()->removeChild(scene_node_);
+    }
+}
+void MultiShape::reset() {
+    visible(false);
+    scene_node_->setPosition(Ogre::Vector3::ZERO);
+    scene_node_->setOrientation(Ogre::Quaternion::IDENTITY);
+    scene_node_->setScale(Ogre::Vector3::UNIT_SCALE);
+    setUserData(Ogre::Any());
+    resetColor();
+    setLodLevel(LodFull);
+    dirtyFlags_ = DirtyAll;
+    ++revision_;
+}
+void MultiShape::setLodLevel(LodLevel level) {
+    if (level == lodLevel_) {
+        return;
+    }
+    lodLevel_ = level;
+    ++revision_;
+    if (visible_) {
+        materializeLodLevel();
+        applyLodVisibility();
+    }
+}
+void MultiShape::materializeLodLevel() {
+    // The box is created by applyLodVisibility(), it does not need the parts. LodReduced only hides the detail parts,
+    // as switching between LodFull and LodReduced is frequent and hiding is cheaper than creating them again.
+    if (lodLevel_ <= LodReduced) {
+        materialize();
+    }
+}
+void MultiShape::applyLodVisibility() {
+    const bool showMain = lodLevel_ <= LodReduced;
+    const bool showDetail = lodLevel_ == LodFull;
+    for (size_t i = 0; i < shapes_.size(); ++i) {
+        const bool detail = i < descriptions_.size() && descriptions_[i].group == ShapeDescription::Black;
+        shapes_[i]->getEntity()->setVisible(detail ? showDetail : showMain);
+    }
+    for (size_t i = 0; i < bakedGroups_.size(); ++i) {
+        bakedEntity_->getSubEntity(i)->setVisible(bakedGroups_[i] == ShapeDescription::Black ? showDetail : showMain);
+    }
+
+    if (lodLevel_ == LodBox && !lodProxy_ && !descriptions_.empty()) {
+        Ogre::AxisAlignedBox bounds = getLocalBounds();
+        lodProxy_ = std::make_shared<rviz::Shape>(Shape::Cube, scene_manager_, scene_node_);
+        lodProxy_->setScale(bounds.getSize());
+        lodProxy_->setPosition(bounds.getCenter());
+        lodProxy_->setUserData(userData_);
+        if (colorMode_ == ColorMode::Unset) {
+            applyColor(Ogre::ColourValue(1.0, 1.0, 1.0, 1.0), false, ShapeDescription::Colored);
+        } else {
+            applyColor(color_, false, ShapeDescription::Colored);
+        }
+    }
+    if (lodProxy_) {
+        lodProxy_->getEntity()->setVisible(lodLevel_ == LodBox);
+    }
+}
+Ogre::AxisAlignedBox MultiShape::getLocalBounds() const {
+    // The primitive meshes fit into the unit cube
+    Ogre::AxisAlignedBox bounds;
+    for (const auto& d : descriptions_) {
+        for (int corner = 0; corner < 8; ++corner) {
+            Ogre::Vector3 local(corner & 1 ? 0.5 : -0.5, corner & 2 ? 0.5 : -0.5, corner & 4 ? 0.5 : -0.5);
+            bounds.merge(d.position + d.orientation * (d.scale * (d.offset + local)));
+        }
+    }
+    return bounds;
 }
 const Ogre::Vector3& MultiShape::getPosition() {
     return scene_node_->getPosition();
@@ -77,89 +235,315 @@ const Ogre::Quaternion& MultiShape::getOrientation() {
 }
 std::vector<Ogre::Entity*> MultiShape::getEntities() {
     std::vector<Ogre::Entity*> entities;
-    for (auto s : shapes_) {
-        entities.push_back(s->getEntity());
-    }
+    entities.reserve(shapes_.size() + 1);
+    forEachEntity([&entities](Ogre::Entity* e) { entities.push_back(e); });
     return entities;
 }
+Footprint MultiShape::footprint() const {
+    // A material with one technique and one pass, as created by rviz::Shape and for baked objects
+    const size_t materialBytes = sizeof(Ogre::Material) + sizeof(Ogre::Technique) + sizeof(Ogre::Pass);
+    // Shapes are created with make_shared, so the control block (vtable and two counts) shares their allocation
+    const size_t shapeBytes = sizeof(Shape) + 2 * sizeof(void*);
+
+    Footprint f;
+    f.objects = 1;
+    f.heapBytes = sizeof(MultiShape) + shapes_.capacity() * sizeof(shape_vector::value_type) +
+                  descriptions_.capacity() * sizeof(ShapeDescription) + bakedMeshName_.capacity() +
+                  bakedMaterials_.capacity() * sizeof(Ogre::MaterialPtr) +
+                  bakedGroups_.capacity() * sizeof(ShapeDescription::ColorGroup) +
+                  sharedMaterials_.capacity() * sizeof(MaterialCache::Handle);
+    // The node of the object and the scene and offset nodes of every rviz::Shape
+    f.sceneNodes = 1;
+    const size_t shapes = shapes_.size() + (lodProxy_ ? 1 : 0);
+    f.heapBytes += shapes * shapeBytes;
+    f.sceneNodes += 2 * shapes;
+    f.ownMaterials = shapes + bakedMaterials_.size();
+    for (const auto& m : sharedMaterials_) {
+        f.sharedMaterials += m ? 1 : 0;
+    }
+    f.sharedMaterials += lodProxyMaterial_ ? 1 : 0;
+
+    size_t subEntities = 0;
+    forEachEntity([&](Ogre::Entity* e) {
+        ++f.entities;
+        subEntities += e->getNumSubEntities();
+    });
+    f.ogreBytes = f.sceneNodes * sizeof(Ogre::SceneNode) + f.entities * sizeof(Ogre::Entity) +
+                  subEntities * sizeof(Ogre::SubEntity) + f.ownMaterials * materialBytes;
+    return f;
+}
+
 std::vector<Ogre::MaterialPtr> MultiShape::getMaterials() {
     std::vector<Ogre::MaterialPtr> materials;
+    if (materialCache_) {
+        // The shapes' own materials are not in use
+        forEachMaterial([&materials](const Ogre::MaterialPtr& m) { materials.push_back(m); });
+        return materials;
+    }
     for (auto s : shapes_) {
         materials.push_back(s->getMaterial());
     }
+    materials.insert(materials.end(), bakedMaterials_.begin(), bakedMaterials_.end());
+    // Like forEachEntity(), which includes the entity of the box proxy
+    if (lodProxy_) {
+        materials.push_back(lodProxy_->getMaterial());
+    }
     return materials;
 }
 std::vector<Shape::Type> MultiShape::getTypes() {
     std::vector<Shape::Type> types;
-    for (auto s : shapes_) {
-        types.push_back(s->getType());
-    }
+    types.reserve(shapes_.size() + 1);
+    forEachType([&types](Shape::Type t) { types.push_back(t); });
     return types;
 }
 
-SimpleCar::SimpleCar(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node)
-        : MultiShape(scene_manager, parent_node) {
-
-    // BEGIN: Definition of Objects geometric visual appearance
-    float wheelDiameter = 0.8;
-    float wheelWidth = 0.4;
-    Ogre::Vector3 wheelScale(wheelDiameter, wheelWidth, wheelDiameter);
-    Ogre::Vector3 wheelPosition(0.0, 0.0, wheelScale.z / 2.0);
-
-    std::shared_ptr<rviz::Shape> lower_cube =
-        std::make_shared<rviz::Shape>(Shape::Cylinder, scene_manager_, scene_node_);
-    Ogre::Vector3 lowerCubeScale(4, 1.8, 0.8);
-    lower_cube->setScale(lowerCubeScale);
-    Ogre::Vector3 lowerCubePosition(0, 0, lowerCubeScale.z / 2.0 + wheelScale.z / 2.0);
-    lower_cube->setPosition(lowerCubePosition);
-    coloredShapes_.push_back(lower_cube);
-
-    std::shared_ptr<rviz::Shape> upper_cube =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cube, scene_manager_, scene_node_);
-    Ogre::Vector3 upperCubeScale(2, 1.8, 0.8);
-    upper_cube->setScale(upperCubeScale);
-    Ogre::Vector3 upperCubePosition(0, 0, lowerCubeScale.z + upperCubeScale.z / 2.0 + wheelScale.z / 2.0);
-    upper_cube->setPosition(upperCubePosition);
-    coloredShapes_.push_back(upper_cube);
-
-    std::shared_ptr<rviz::Shape> wheel_fr =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
-    wheel_fr->setPosition(wheelPosition);
-    wheel_fr->setColor(0.0, 0.0, 0.0, 1.0);
-    wheel_fr->setScale(wheelScale);
-    Ogre::Vector3 wheelFROffset(1.4 / wheelScale.x, -lowerCubeScale.y / 2.0 / wheelScale.y, 0.0);
-    wheel_fr->setOffset(wheelFROffset);
-    blackShapes_.push_back(wheel_fr);
-
-    std::shared_ptr<rviz::Shape> wheel_fl =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
-    wheel_fl->setPosition(wheelPosition);
-    wheel_fl->setColor(0.0, 0.0, 0.0, 1.0);
-    wheel_fl->setScale(wheelScale);
-    Ogre::Vector3 wheelFLOffset(1.4 / wheelScale.x, lowerCubeScale.y / 2.0 / wheelScale.y, 0.0);
-    wheel_fl->setOffset(wheelFLOffset);
-    blackShapes_.push_back(wheel_fl);
-
-    std::shared_ptr<rviz::Shape> wheel_br =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
-    wheel_br->setPosition(wheelPosition);
-    wheel_br->setColor(0.0, 0.0, 0.0, 1.0);
-    wheel_br->setScale(wheelScale);
-    Ogre::Vector3 wheelBROffset(-1.4 / wheelScale.x, -lowerCubeScale.y / 2.0 / wheelScale.y, 0.0);
-    wheel_br->setOffset(wheelBROffset);
-    blackShapes_.push_back(wheel_br);
-
-    std::shared_ptr<rviz::Shape> wheel_bl =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
-    wheel_bl->setPosition(wheelPosition);
-    wheel_bl->setColor(0.0, 0.0, 0.0, 1.0);
-    wheel_bl->setScale(wheelScale);
-    Ogre::Vector3 wheelBLOffset(-1.4 / wheelScale.x, lowerCubeScale.y / 2.0 / wheelScale.y, 0.0);
-    wheel_bl->setOffset(wheelBLOffset);
-    blackShapes_.push_back(wheel_bl);
-    // END: Definition of Objects geometric visual appearance
-
-    renewShapesVec();
+void MultiShape::materialize() {
+    if (materialized_) {
+        return;
+    }
+    materialized_ = true;
+    shapes_ = createShapes(descriptions_, bakedMeshName_, baked_);
+    shapesChanged();
+
+    // The new parts have the default colors and no user data
+    reapplyColor();
+    if (!userData_.isEmpty()) {
+        setUserData(userData_);
+    }
+}
+
+void MultiShape::dematerialize() {
+    if ((!materialized_ && !lodProxy_) || descriptions_.empty()) {
+        return;
+    }
+    materialized_ = false;
+    shapes_.clear();
+    sharedMaterials_.clear();
+    lodProxy_.reset();
+    lodProxyMaterial_.reset();
+    if (bakedEntity_) {
+        scene_manager_->destroyEntity(bakedEntity_);
+        bakedEntity_ = NULL;
+        for (const auto& m : bakedMaterials_) {
+            Ogre::MaterialManager::getSingleton().remove(m->getName());
+        }
+        bakedMaterials_.clear();
+        bakedGroups_.clear();
+    }
+    shapesChanged();
+}
+
+bool MultiShape::dematerializeIfHidden(double seconds) {
+    if (visible_ || (!materialized_ && !lodProxy_) ||
+        std::chrono::steady_clock::now() - hiddenSince_ < std::chrono::duration<double>(seconds)) {
+        return false;
+    }
+    dematerialize();
+    return !materialized_ && !lodProxy_;
+}
+
+void MultiShape::defineShapes(const shape_description_vector& descriptions,
+                              const std::string& bakedMeshName,
+                              bool baked,
+                              bool lazy) {
+    descriptions_ = descriptions;
+    bakedMeshName_ = bakedMeshName;
+    baked_ = baked;
+    if (lazy) {
+        visible(false);
+        dirtyFlags_ &= ~DirtyVisibility;
+        materialized_ = false;
+    } else {
+        shapes_ = createShapes(descriptions, bakedMeshName, baked);
+    }
+}
+
+shape_vector MultiShape::createShapes(const shape_description_vector& descriptions,
+                                      const std::string& bakedMeshName,
+                                      bool baked) {
+    descriptions_ = descriptions;
+    baked_ = baked;
+    shape_vector shapes;
+    if (!baked) {
+        for (const auto& d : descriptions) {
+            std::shared_ptr<rviz::Shape> shape = std::make_shared<rviz::Shape>(d.type, scene_manager_, scene_node_);
+            shape->setScale(d.scale);
+            shape->setPosition(d.position);
+            shape->setOffset(d.offset);
+            shape->setOrientation(d.orientation);
+            if (d.group == ShapeDescription::Black) {
+                shape->setColor(0.0, 0.0, 0.0, 1.0);
+            }
+            shapes.push_back(shape);
+        }
+        return shapes;
+    }
+
+    static uint32_t count = 0;
+    std::stringstream ss;
+    ss << "UtilRvizBaked" << count++;
+    Ogre::MeshPtr mesh = baked::getOrCreateMesh(scene_manager_, bakedMeshName, descriptions);
+    bakedEntity_ = scene_manager_->createEntity(ss.str(), mesh->getName(), "rviz");
+    scene_node_->attachObject(bakedEntity_);
+
+    // The submeshes of the baked mesh are ordered by color group
+    bakedGroups_ = baked::colorGroups(descriptions);
+    for (size_t i = 0; i < bakedGroups_.size(); ++i) {
+        std::stringstream materialName;
+        materialName << ss.str() << "Material" << i;
+        Ogre::MaterialPtr material = materials::createMaterial(materialName.str());
+        if (bakedGroups_[i] == ShapeDescription::Black) {
+            materials::applyColor(material, Ogre::ColourValue(0.0, 0.0, 0.0, 1.0));
+        }
+        bakedEntity_->getSubEntity(i)->setMaterial(material);
+        bakedMaterials_.push_back(material);
+    }
+    return shapes;
+}
+
+void MultiShape::setGroupColor(ShapeDescription::ColorGroup group, const Ogre::ColourValue& c) {
+    applyColor(c, false, group);
+}
+
+void MultiShape::applyColor(const Ogre::ColourValue& c, bool allGroups, ShapeDescription::ColorGroup group) {
+    MaterialCache::Handle material;
+    if (materialCache_) {
+        material = materialCache_->get(c);
+        sharedMaterials_.resize(shapes_.size() + bakedGroups_.size());
+    }
+    for (size_t i = 0; i < shapes_.size(); ++i) {
+        if (!allGroups && (i >= descriptions_.size() || descriptions_[i].group != group)) {
+            continue;
+        }
+        if (material) {
+            shapes_[i]->getEntity()->setMaterial(material->material());
+            sharedMaterials_[i] = material;
+        } else {
+            shapes_[i]->setColor(c);
+        }
+    }
+    for (size_t i = 0; i < bakedGroups_.size(); ++i) {
+        if (!allGroups && bakedGroups_[i] != group) {
+            continue;
+        }
+        if (material) {
+            bakedEntity_->getSubEntity(i)->setMaterial(material->material());
+            sharedMaterials_[shapes_.size() + i] = material;
+        } else {
+            materials::applyColor(bakedMaterials_[i], c);
+        }
+    }
+    if (lodProxy_ && (allGroups || group == ShapeDescription::Colored)) {
+        if (material) {
+            lodProxy_->getEntity()->setMaterial(material->material());
+            lodProxyMaterial_ = material;
+        } else {
+            lodProxy_->setColor(c);
+        }
+    }
+}
+
+void MultiShape::reapplyColor() {
+    switch (colorMode_) {
+    case ColorMode::Unset:
+        resetColor();
+        break;
+    case ColorMode::All:
+        applyColor(color_, true, ShapeDescription::Colored);
+        break;
+    case ColorMode::Partly:
+        setGroupColor(ShapeDescription::Colored, color_);
+        setGroupColor(ShapeDescription::Black, Ogre::ColourValue(0.0, 0.0, 0.0, color_.a));
+        break;
+    }
+}
+
+void MultiShape::setMaterialCache(const std::shared_ptr<MaterialCache>& cache) {
+    if (cache == materialCache_) {
+        return;
+    }
+    materialCache_ = cache;
+    if (!materialCache_) {
+        // Back to the private materials, which still have to be colored
+        for (auto s : shapes_) {
+            s->getEntity()->setMaterial(s->getMaterial());
+        }
+        for (size_t i = 0; i < bakedMaterials_.size(); ++i) {
+            bakedEntity_->getSubEntity(i)->setMaterial(bakedMaterials_[i]);
+        }
+        if (lodProxy_) {
+            lodProxy_->getEntity()->setMaterial(lodProxy_->getMaterial());
+        }
+    }
+    reapplyColor();
+    if (!materialCache_) {
+        sharedMaterials_.clear();
+        lodProxyMaterial_.reset();
+    }
+}
+
+void MultiShape::resetColor() {
+    setGroupColor(ShapeDescription::Colored, Ogre::ColourValue(1.0, 1.0, 1.0, 1.0));
+    setGroupColor(ShapeDescription::Black, Ogre::ColourValue(0.0, 0.0, 0.0, 1.0));
+    colorMode_ = ColorMode::Unset;
+}
+
+bool MultiShape::updateColorCache(const Ogre::ColourValue& c, ColorMode mode) {
+    if (mode == colorMode_ && std::abs(c.r - color_.r) <= changeEpsilon_ &&
+        std::abs(c.g - color_.g) <= changeEpsilon_ && std::abs(c.b - color_.b) <= changeEpsilon_ &&
+        std::abs(c.a - color_.a) <= changeEpsilon_) {
+        return false;
+    }
+    colorMode_ = mode;
+    color_ = c;
+    markDirty(DirtyColor);
+    return true;
+}
+
+SimpleCar::SimpleCar(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node, bool baked, bool lazy)
+        : ArchetypeShape<CarDescriptor>(scene_manager, parent_node, baked, lazy) {
+    shapesChanged();
+}
+
+void SimpleCar::shapesChanged() {
+    coloredShapes_.clear();
+    blackShapes_.clear();
+    for (size_t i = 0; i < shapes_.size(); ++i) {
+        if (descriptions_[i].group == ShapeDescription::Black) {
+            blackShapes_.push_back(shapes_[i]);
+        } else {
+            coloredShapes_.push_back(shapes_[i]);
+        }
+    }
+}
+
+void SimpleCar::renewShapesVec() {
+    // The descriptions have to stay indexed like the shapes
+    shape_vector shapes;
+    shape_description_vector descriptions;
+    auto add = [&](const std::shared_ptr<Shape>& s, ShapeDescription::ColorGroup group) {
+        const size_t i = std::find(shapes_.begin(), shapes_.end(), s) - shapes_.begin();
+        if (i < descriptions_.size()) {
+            descriptions.push_back(descriptions_[i]);
+        } else {
+            descriptions.push_back(ShapeDescription{s->getType(),
+                                                    Ogre::Vector3::UNIT_SCALE,
+                                                    s->getPosition(),
+                                                    Ogre::Vector3::ZERO,
+                                                    s->getOrientation(),
+                                                    group});
+        }
+        descriptions.back().group = group;
+        shapes.push_back(s);
+    };
+    for (const auto& s : blackShapes_) {
+        add(s, ShapeDescription::Black);
+    }
+    for (const auto& s : coloredShapes_) {
+        add(s, ShapeDescription::Colored);
+    }
+    shapes_.swap(shapes);
+    descriptions_.swap(descriptions);
 }
 
 void SimpleCar::setColorPartly(float r, float g, float b, float a) {
@@ -167,109 +551,53 @@ void SimpleCar::setColorPartly(float r, float g, float b, float a) {
 }
 
 void SimpleCar::setColorPartly(const Ogre::ColourValue& c) {
-    for (auto s : coloredShapes_) {
-        s->setColor(c);
-    }
-    for (auto s : blackShapes_) {
-        s->setColor(Ogre::ColourValue(0.0, 0.0, 0.0, c.a));
+    if (!updateColorCache(c, ColorMode::Partly)) {
+        util_rviz::stats::add(util_rviz::stats::ColorSkipped);
+        return;
     }
-    renewShapesVec();
+    util_rviz::stats::add(util_rviz::stats::ColorApplied);
+    reapplyColor();
 }
 
-void SimpleCar::renewShapesVec() {
-    shapes_.clear();
-    auto iter = shapes_.begin();
-    shapes_.insert(iter, blackShapes_.begin(), blackShapes_.end());
-    iter = shapes_.end();
-    shapes_.insert(iter, coloredShapes_.begin(), coloredShapes_.end());
-}
-
-SimplePedestrian::SimplePedestrian(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node)
-        : MultiShape(scene_manager, parent_node) {
-
-    float corpusHeight = 1.6;
-    float pedestrianWidth = 0.7;
-
-    std::shared_ptr<rviz::Shape> corpus = std::make_shared<rviz::Shape>(Shape::Cylinder, scene_manager_, scene_node_);
-    Ogre::Vector3 corpusScale(pedestrianWidth, corpusHeight, pedestrianWidth);
-    corpus->setScale(corpusScale);
-    Ogre::Vector3 corpusPosition(0, 0, corpusHeight / 2.0);
-    corpus->setPosition(corpusPosition);
-    Ogre::Quaternion corpusOrientation(std::sqrt(0.5), std::sqrt(0.5), 0, 0);
-    corpus->setOrientation(corpusOrientation);
-    shapes_.push_back(corpus);
-
-    std::shared_ptr<rviz::Shape> head = std::make_shared<rviz::Shape>(Shape::Sphere, scene_manager_, scene_node_);
-    Ogre::Vector3 sphereScale(pedestrianWidth, pedestrianWidth, pedestrianWidth);
-    head->setScale(sphereScale);
-    Ogre::Vector3 spherePosition(0, 0, corpusHeight + pedestrianWidth / 2.0);
-    head->setPosition(spherePosition);
-    shapes_.push_back(head);
-}
-
-SimpleBike::SimpleBike(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node)
-        : MultiShape(scene_manager, parent_node) {
-
-    float wheelDiameter = 1.4;
-    float wheelWidth = 0.7;
-    Ogre::Vector3 wheelScale(wheelDiameter, wheelWidth, wheelDiameter);
-    Ogre::Vector3 wheelPosition(0.0, 0.0, wheelScale.z / 2.0);
-
-    std::shared_ptr<rviz::Shape> lower_cube =
-        std::make_shared<rviz::Shape>(Shape::Cylinder, scene_manager_, scene_node_);
-    // (length, width, height)
-    Ogre::Vector3 lowerCubeScale(3, 0.6, 0.8);
-    lower_cube->setScale(lowerCubeScale);
-    Ogre::Vector3 lowerCubePosition(0, 0, lowerCubeScale.z / 2.0 + wheelScale.z / 2.0);
-    lower_cube->setPosition(lowerCubePosition);
-    shapes_.push_back(lower_cube);
-
-    std::shared_ptr<rviz::Shape> wheel_f =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
-    wheel_f->setPosition(wheelPosition);
-    wheel_f->setColor(0.0, 0.0, 0.0, 1.0);
-    wheel_f->setScale(wheelScale);
-    Ogre::Vector3 wheelFOffset(1.4 / wheelScale.x, 0.0, 0.0);
-    wheel_f->setOffset(wheelFOffset);
-    shapes_.push_back(wheel_f);
-
-    std::shared_ptr<rviz::Shape> wheel_b =
-        std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
-    wheel_b->setPosition(wheelPosition);
-    wheel_b->setColor(0.0, 0.0, 0.0, 1.0);
-    wheel_b->setScale(wheelScale);
-    Ogre::Vector3 wheelBOffset(-1.4 / wheelScale.x, 0.0, 0.0);
-    wheel_b->setOffset(wheelBOffset);
-    shapes_.push_back(wheel_b);
-
-    float corpusHeight = 1.6;
-    float pedestrianWidth = 0.7;
-
-    std::shared_ptr<rviz::Shape> corpus = std::make_shared<rviz::Shape>(Shape::Cylinder, scene_manager_, scene_node_);
-    Ogre::Vector3 corpusScale(pedestrianWidth, corpusHeight, pedestrianWidth);
-    corpus->setScale(corpusScale);
-    Ogre::Vector3 corpusPosition(0, 0, corpusHeight / 2.0);
-    corpus->setPosition(corpusPosition);
-    Ogre::Quaternion corpusOrientation(std::sqrt(0.5), std::sqrt(0.5), 0, 0);
-    corpus->setOrientation(corpusOrientation);
-    shapes_.push_back(corpus);
-
-    std::shared_ptr<rviz::Shape> head = std::make_shared<rviz::Shape>(Shape::Sphere, scene_manager_, scene_node_);
-    Ogre::Vector3 sphereScale(pedestrianWidth, pedestrianWidth, pedestrianWidth);
-    head->setScale(sphereScale);
-    Ogre::Vector3 spherePosition(0, 0, corpusHeight + pedestrianWidth / 2.0);
-    head->setPosition(spherePosition);
-    shapes_.push_back(head);
-}
-
-SimpleUnknown::SimpleUnknown(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node)
-        : MultiShape(scene_manager, parent_node) {
-    std::shared_ptr<rviz::Shape> cube = std::make_shared<rviz::Shape>(rviz::Shape::Cube, scene_manager_, scene_node_);
-    Ogre::Vector3 cubeScale(1.0, 1.0, 1.0);
-    cube->setScale(cubeScale);
-    Ogre::Vector3 cubePosition(0.0, 0.0, cubeScale.z / 2.0);
-    cube->setPosition(cubePosition);
-    shapes_.push_back(cube);
+Footprint SimpleCar::footprint() const {
+    // The shapes are referenced by shapes_ as well as by coloredShapes_ and blackShapes_
+    Footprint f = MultiShape::footprint();
+    f.heapBytes += sizeof(SimpleCar) - sizeof(MultiShape) +
+                   (coloredShapes_.capacity() + blackShapes_.capacity()) * sizeof(shape_vector::value_type);
+    return f;
+}
+
+SimplePedestrian::SimplePedestrian(Ogre::SceneManager* scene_manager,
+                                   Ogre::SceneNode* parent_node,
+                                   bool baked,
+                                   bool lazy)
+        : ArchetypeShape<PedestrianDescriptor>(scene_manager, parent_node, baked, lazy) {
+}
+
+SimpleBike::SimpleBike(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node, bool baked, bool lazy)
+        : ArchetypeShape<BikeDescriptor>(scene_manager, parent_node, baked, lazy) {
+}
+
+SimpleUnknown::SimpleUnknown(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node, bool baked, bool lazy)
+        : ArchetypeShape<UnknownDescriptor>(scene_manager, parent_node, baked, lazy) {
+}
+
+std::unique_ptr<MultiShape> createArchetype(Archetype archetype,
+                                            Ogre::SceneManager* scene_manager,
+                                            Ogre::SceneNode* parent_node,
+                                            bool baked,
+                                            bool lazy) {
+    switch (archetype) {
+    case Archetype::Car:
+        return std::unique_ptr<MultiShape>(new SimpleCar(scene_manager, parent_node, baked, lazy));
+    case Archetype::Bike:
+        return std::unique_ptr<MultiShape>(new SimpleBike(scene_manager, parent_node, baked, lazy));
+    case Archetype::Pedestrian:
+        return std::unique_ptr<MultiShape>(new SimplePedestrian(scene_manager, parent_node, baked, lazy));
+    case Archetype::Unknown:
+    default:
+        return std::unique_ptr<MultiShape>(new SimpleUnknown(scene_manager, parent_node, baked, lazy));
+    }
 }
 
 } // end namespace rviz
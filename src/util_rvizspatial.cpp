@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizspatial.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <OGRE/OgreAxisAlignedBox.h>
+#include <OGRE/OgreMatrix4.h>
+
+#include "internal/util_rvizgrid.hpp"
+
+namespace rviz {
+
+SpatialIndex::SpatialIndex(float cellSize) : cellSize_(cellSize), maxRadius_(0.f), maxRadiusCount_(0) {
+}
+
+void SpatialIndex::insert(MultiShape* obj, float radius) {
+    if (itemIndices_.count(obj)) {
+        remove(obj);
+    }
+    Item item{obj, radius, cellOf(obj)};
+    if (radius > maxRadius_ || items_.empty()) {
+        maxRadius_ = radius;
+        maxRadiusCount_ = 0;
+    }
+    maxRadiusCount_ += radius == maxRadius_;
+    itemIndices_[obj] = items_.size();
+    cells_[item.cell].push_back(items_.size());
+    items_.push_back(item);
+}
+
+void SpatialIndex::insert(MultiShape* obj) {
+    // The spheres are centered at the origin of the objects, which need not be the center of their bounds
+    const Ogre::AxisAlignedBox bounds = obj->getLocalBounds();
+    if (bounds.isNull()) {
+        insert(obj, 0.f);
+        return;
+    }
+    const Ogre::Vector3& min = bounds.getMinimum();
+    const Ogre::Vector3& max = bounds.getMaximum();
+    const Ogre::Vector3 farthest(std::max(std::abs(min.x), std::abs(max.x)), std::max(std::abs(min.y), std::abs(max.y)),
+                                 std::max(std::abs(min.z), std::abs(max.z)));
+    insert(obj, (farthest * obj->getRootNode()->getScale()).length());
+}
+
+void SpatialIndex::remove(MultiShape* obj) {
+    auto it = itemIndices_.find(obj);
+    if (it == itemIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    itemIndices_.erase(it);
+    removeFromCell(items_[index].cell, index);
+    const float radius = items_[index].radius;
+
+    // Fill the gap with the last item
+    const size_t last = items_.size() - 1;
+    if (index != last) {
+        items_[index] = items_[last];
+        itemIndices_[items_[index].obj] = index;
+        for (auto& i : cells_[items_[index].cell]) {
+            if (i == last) {
+                i = index;
+                break;
+            }
+        }
+    }
+    items_.pop_back();
+
+    // Otherwise every query would stay extended by the radius of an object that is long gone
+    if (radius == maxRadius_ && --maxRadiusCount_ == 0) {
+        maxRadius_ = 0.f;
+        for (const Item& item : items_) {
+            if (item.radius > maxRadius_ || maxRadiusCount_ == 0) {
+                maxRadius_ = item.radius;
+                maxRadiusCount_ = 0;
+            }
+            maxRadiusCount_ += item.radius == maxRadius_;
+        }
+    }
+}
+
+void SpatialIndex::clear() {
+    items_.clear();
+    itemIndices_.clear();
+    cells_.clear();
+    maxRadius_ = 0.f;
+    maxRadiusCount_ = 0;
+}
+
+void SpatialIndex::update(MultiShape* obj) {
+    auto it = itemIndices_.find(obj);
+    if (it == itemIndices_.end()) {
+        return;
+    }
+    Item& item = items_[it->second];
+    const int64_t cell = cellOf(obj);
+    if (cell != item.cell) {
+        removeFromCell(item.cell, it->second);
+        item.cell = cell;
+        cells_[cell].push_back(it->second);
+    }
+}
+
+void SpatialIndex::updateAll() {
+    util_rviz::stats::ScopedTimer timer(util_rviz::stats::SpatialIndexUpdate);
+    for (size_t i = 0; i < items_.size(); ++i) {
+        const int64_t cell = cellOf(items_[i].obj);
+        if (cell != items_[i].cell) {
+            removeFromCell(items_[i].cell, i);
+            items_[i].cell = cell;
+            cells_[cell].push_back(i);
+        }
+    }
+}
+
+void SpatialIndex::queryRegion(const Ogre::Vector2& min,
+                               const Ogre::Vector2& max,
+                               std::vector<MultiShape*>& result) const {
+    forEachCandidate(min, max, [&](const Item& item) {
+        const Ogre::Vector3& p = item.obj->getPosition();
+        if (p.x + item.radius >= min.x && p.x - item.radius <= max.x && p.y + item.radius >= min.y &&
+            p.y - item.radius <= max.y) {
+            result.push_back(item.obj);
+        }
+    });
+}
+
+void SpatialIndex::queryFrustum(const Ogre::Frustum& frustum,
+                                const Ogre::Node* frame,
+                                std::vector<MultiShape*>& result) const {
+    // Bounds of the frustum on the XY plane of the frame
+    const Ogre::Vector3* corners = frustum.getWorldSpaceCorners();
+    Ogre::Matrix4 worldToFrame;
+    Ogre::Matrix4 frameToWorld;
+    if (frame) {
+        frameToWorld = frame->_getFullTransform();
+        worldToFrame = frameToWorld.inverseAffine();
+    }
+    Ogre::AxisAlignedBox bounds;
+    for (int i = 0; i < 8; ++i) {
+        bounds.merge(frame ? worldToFrame * corners[i] : corners[i]);
+    }
+    const Ogre::Vector2 min(bounds.getMinimum().x, bounds.getMinimum().y);
+    const Ogre::Vector2 max(bounds.getMaximum().x, bounds.getMaximum().y);
+
+    forEachCandidate(min, max, [&](const Item& item) {
+        const Ogre::Vector3& p = item.obj->getPosition();
+        if (frustum.isVisible(Ogre::Sphere(frame ? frameToWorld * p : p, item.radius))) {
+            result.push_back(item.obj);
+        }
+    });
+}
+
+void SpatialIndex::cullOutside(const Ogre::Vector2& min, const Ogre::Vector2& max) {
+    const int32_t minX = cellCoordinate(min.x - maxRadius_);
+    const int32_t maxX = cellCoordinate(max.x + maxRadius_);
+    const int32_t minY = cellCoordinate(min.y - maxRadius_);
+    const int32_t maxY = cellCoordinate(max.y + maxRadius_);
+    for (const auto& cell : cells_) {
+        const int32_t x = static_cast<int32_t>(cell.first >> 32);
+        const int32_t y = static_cast<int32_t>(cell.first & 0xffffffff);
+        const bool candidate = x >= minX && x <= maxX && y >= minY && y <= maxY;
+        for (size_t i : cell.second) {
+            const Item& item = items_[i];
+            bool inside = false;
+            if (candidate) {
+                const Ogre::Vector3& p = item.obj->getPosition();
+                inside = p.x + item.radius >= min.x && p.x - item.radius <= max.x && p.y + item.radius >= min.y &&
+                         p.y - item.radius <= max.y;
+            }
+            // Cheap for unchanged objects, as MultiShape caches its visibility
+            item.obj->visible(inside);
+        }
+    }
+}
+
+int32_t SpatialIndex::cellCoordinate(float v) const {
+    return grid::cellCoordinate(v, cellSize_);
+}
+
+int64_t SpatialIndex::cellOf(MultiShape* obj) const {
+    const Ogre::Vector3& p = obj->getPosition();
+    return grid::cellKey(cellCoordinate(p.x), cellCoordinate(p.y));
+}
+
+void SpatialIndex::removeFromCell(int64_t cell, size_t item) {
+    auto it = cells_.find(cell);
+    if (it == cells_.end()) {
+        return;
+    }
+    std::vector<size_t>& items = it->second;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i] == item) {
+            items[i] = items.back();
+            items.pop_back();
+            break;
+        }
+    }
+    if (items.empty()) {
+        cells_.erase(it);
+    }
+}
+
+template <typename Function>
+void SpatialIndex::forEachCandidate(const Ogre::Vector2& min, const Ogre::Vector2& max, Function&& f) const {
+    // Objects are sorted in by their center, so the region has to be extended by the largest radius
+    const int64_t minX = cellCoordinate(min.x - maxRadius_);
+    const int64_t maxX = cellCoordinate(max.x + maxRadius_);
+    const int64_t minY = cellCoordinate(min.y - maxRadius_);
+    const int64_t maxY = cellCoordinate(max.y + maxRadius_);
+
+    if ((maxX - minX + 1) * (maxY - minY + 1) > static_cast<int64_t>(cells_.size())) {
+        // Cheaper to visit the occupied cells
+        for (const auto& cell : cells_) {
+            const int32_t x = static_cast<int32_t>(cell.first >> 32);
+            const int32_t y = static_cast<int32_t>(cell.first & 0xffffffff);
+            if (x >= minX && x <= maxX && y >= minY && y <= maxY) {
+                for (size_t i : cell.second) {
+                    f(items_[i]);
+                }
+            }
+        }
+        return;
+    }
+    for (int64_t x = minX; x <= maxX; ++x) {
+        for (int64_t y = minY; y <= maxY; ++y) {
+            auto it = cells_.find(grid::cellKey(static_cast<int32_t>(x), static_cast<int32_t>(y)));
+            if (it != cells_.end()) {
+                for (size_t i : it->second) {
+                    f(items_[i]);
+                }
+            }
+        }
+    }
+}
+
+} // namespace rviz
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizstatic.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include "internal/util_rvizgrid.hpp"
+
+namespace rviz {
+
+StaticBatcher::StaticBatcher(Ogre::SceneManager* scene_manager, const StaticBatchSettings& settings)
+        : scene_manager_(scene_manager), settings_(settings), batchedCount_(0) {
+    static uint32_t count = 0;
+    std::stringstream ss;
+    ss << "UtilRvizStatic" << count++;
+    name_ = ss.str();
+    MultiShape::addDestructionListener(this);
+}
+
+StaticBatcher::~StaticBatcher() {
+    MultiShape::removeDestructionListener(this);
+    clear();
+}
+
+void StaticBatcher::add(MultiShape* obj) {
+    if (itemIndices_.count(obj)) {
+        return;
+    }
+    itemIndices_[obj] = items_.size();
+    items_.push_back(Item{obj, obj->revision(), ros::Time(), false, false, 0, NULL, {}});
+}
+
+void StaticBatcher::remove(MultiShape* obj) {
+    erase(obj, true);
+}
+
+void StaticBatcher::objectDestroyed(MultiShape* obj) {
+    // The scene node of the object is about to be destroyed, there is no point in attaching it again
+    erase(obj, false);
+}
+
+void StaticBatcher::erase(MultiShape* obj, bool reattach) {
+    auto it = itemIndices_.find(obj);
+    if (it == itemIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    const bool batched = items_[index].batched;
+    const int64_t cell = items_[index].cell;
+    if (batched) {
+        unbatch(index, reattach);
+    }
+    itemIndices_.erase(it);
+
+    // Fill the gap with the last item
+    const size_t last = items_.size() - 1;
+    if (index != last) {
+        items_[index] = std::move(items_[last]);
+        itemIndices_[items_[index].obj] = index;
+        if (items_[index].batched) {
+            for (auto& i : regions_[items_[index].cell].items) {
+                if (i == last) {
+                    i = index;
+                    break;
+                }
+            }
+        }
+    }
+    items_.pop_back();
+    if (batched) {
+        rebuild(regions_[cell]);
+    }
+}
+
+void StaticBatcher::clear() {
+    for (size_t i = 0; i < items_.size(); ++i) {
+        if (items_[i].batched) {
+            items_[i].obj->attach(items_[i].parent);
+        }
+    }
+    for (auto& region : regions_) {
+        scene_manager_->destroyStaticGeometry(region.second.geometry);
+    }
+    items_.clear();
+    itemIndices_.clear();
+    regions_.clear();
+    batchedCount_ = 0;
+}
+
+void StaticBatcher::setStationary(MultiShape* obj) {
+    auto it = itemIndices_.find(obj);
+    if (it != itemIndices_.end()) {
+        items_[it->second].hint = true;
+    }
+}
+
+void StaticBatcher::update(const ros::Time& stamp) {
+    for (size_t i = 0; i < items_.size(); ++i) {
+        Item& item = items_[i];
+        const uint32_t revision = item.obj->revision();
+        if (revision != item.revision) {
+            item.revision = revision;
+            item.since = stamp;
+            item.hint = false;
+            if (item.batched) {
+                unbatch(i);
+            }
+            continue;
+        }
+        if (item.since.isZero()) {
+            item.since = stamp;
+        }
+        if (!item.batched && (item.hint || (stamp - item.since).toSec() >= settings_.stationaryTime) &&
+            batchable(item.obj)) {
+            batch(i);
+        }
+    }
+    for (auto& region : regions_) {
+        if (region.second.dirty) {
+            rebuild(region.second);
+        }
+    }
+}
+
+bool StaticBatcher::isBatched(const MultiShape* obj) const {
+    auto it = itemIndices_.find(obj);
+    return it != itemIndices_.end() && items_[it->second].batched;
+}
+
+bool StaticBatcher::batchable(MultiShape* obj) const {
+    // In LodBox, only the box exists
+    return obj->isVisible() && (obj->isMaterialized() || obj->getLodLevel() == MultiShape::LodBox) &&
+           obj->getLodLevel() != MultiShape::LodHidden &&
+           obj->getRootNode()->getParentSceneNode();
+}
+
+void StaticBatcher::batch(size_t index) {
+    Item& item = items_[index];
+    Ogre::SceneNode* node = item.obj->getRootNode();
+    item.parts.clear();
+    item.obj->forEachEntity([&item](Ogre::Entity* e) {
+        if (e->getVisible()) {
+            Ogre::SceneNode* n = e->getParentSceneNode();
+            item.parts.push_back(
+                Part{e, n->_getDerivedPosition(), n->_getDerivedOrientation(), n->_getDerivedScale()});
+        }
+    });
+    item.cell = grid::cellKey(node->_getDerivedPosition(), settings_.cellSize);
+    item.parent = node->getParentSceneNode();
+    item.obj->detach();
+    item.batched = true;
+    ++batchedCount_;
+
+    Region& region = regions_[item.cell];
+    if (!region.geometry) {
+        std::stringstream ss;
+        ss << name_ << "Cell" << item.cell;
+        region.geometry = scene_manager_->createStaticGeometry(ss.str());
+        region.geometry->setCastShadows(false);
+        // One Ogre region per grid cell
+        region.geometry->setRegionDimensions(Ogre::Vector3(settings_.cellSize, settings_.cellSize, 1e6));
+    }
+    region.items.push_back(index);
+    region.dirty = true;
+}
+
+void StaticBatcher::unbatch(size_t index, bool reattach) {
+    Item& item = items_[index];
+    if (reattach) {
+        item.obj->attach(item.parent);
+    }
+    item.batched = false;
+    item.parts.clear();
+    --batchedCount_;
+
+    Region& region = regions_[item.cell];
+    region.items.erase(std::remove(region.items.begin(), region.items.end(), index), region.items.end());
+    region.dirty = true;
+}
+
+void StaticBatcher::rebuild(Region& region) {
+    region.dirty = false;
+    region.geometry->reset();
+    if (region.items.empty()) {
+        return;
+    }
+    for (size_t i : region.items) {
+        for (const Part& p : items_[i].parts) {
+            region.geometry->addEntity(p.entity, p.position, p.orientation, p.scale);
+        }
+    }
+    region.geometry->build();
+}
+
+} // namespace rviz
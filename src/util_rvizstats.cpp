@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rvizstats.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace util_rviz {
+namespace stats {
+
+namespace {
+struct Registry {
+    std::mutex mutex;
+    std::vector<detail::Block*> blocks;
+    detail::Block finished{}; // Sum of all threads that have finished
+    std::vector<std::string> archetypes;
+};
+
+// Never destroyed, threads may finish after static destruction
+Registry& registry() {
+    static Registry* r = new Registry;
+    return *r;
+}
+
+void accumulate(const detail::Block& block, Snapshot& s) {
+    for (size_t i = 0; i < CounterCount; ++i) {
+        s.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t h = 0; h < HistogramCount; ++h) {
+        for (size_t b = 0; b < HistogramBuckets; ++b) {
+            const uint64_t n = block.buckets[h][b].load(std::memory_order_relaxed);
+            s.histograms[h].buckets[b] += n;
+            s.histograms[h].count += n;
+        }
+        s.histograms[h].totalNs += block.totalNs[h].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < s.archetypes.size(); ++i) {
+        s.archetypes[i].constructed += block.constructed[i].load(std::memory_order_relaxed);
+        s.archetypes[i].destroyed += block.destroyed[i].load(std::memory_order_relaxed);
+    }
+}
+
+void merge(std::atomic<uint64_t>& to, const std::atomic<uint64_t>& from) {
+    detail::bump(to, from.load(std::memory_order_relaxed));
+}
+} // namespace
+
+namespace detail {
+LocalBlock::LocalBlock() : block(new Block{}) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.blocks.push_back(block);
+}
+
+LocalBlock::~LocalBlock() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (size_t i = 0; i < CounterCount; ++i) {
+        merge(r.finished.counters[i], block->counters[i]);
+    }
+    for (size_t h = 0; h < HistogramCount; ++h) {
+        for (size_t b = 0; b < HistogramBuckets; ++b) {
+            merge(r.finished.buckets[h][b], block->buckets[h][b]);
+        }
+        merge(r.finished.totalNs[h], block->totalNs[h]);
+    }
+    for (size_t i = 0; i < MaxArchetypes; ++i) {
+        merge(r.finished.constructed[i], block->constructed[i]);
+        merge(r.finished.destroyed[i], block->destroyed[i]);
+    }
+    r.blocks.erase(std::remove(r.blocks.begin(), r.blocks.end(), block), r.blocks.end());
+    delete block;
+}
+} // namespace detail
+
+uint64_t HistogramSnapshot::quantileNs(double q) const {
+    const uint64_t rank = uint64_t(q * count);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HistogramBuckets; ++b) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return uint64_t(1) << (b + 1);
+        }
+    }
+    return uint64_t(1) << HistogramBuckets;
+}
+
+const char* name(Counter counter) {
+    static const char* names[CounterCount] = {"position_applied",
+                                              "position_rejected_non_finite",
+                                              "position_rejected_null",
+                                              "orientation_applied",
+                                              "orientation_rejected_non_finite",
+                                              "orientation_rejected_null",
+                                              "scale_applied",
+                                              "scale_rejected_non_finite",
+                                              "scale_rejected_null",
+                                              "poses_applied",
+                                              "poses_rejected",
+                                              "color_applied",
+                                              "color_skipped",
+                                              "commands_queued",
+                                              "commands_overflowed",
+                                              "commands_superseded"};
+    return names[counter];
+}
+
+const char* name(Histogram histogram) {
+    static const char* names[HistogramCount] = {
+        "set_poses", "agent_scene_sync", "lod_update", "spatial_index_update", "scheduled_updates"};
+    return names[histogram];
+}
+
+Snapshot snapshot() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    Snapshot s;
+    for (const auto& a : r.archetypes) {
+        s.archetypes.push_back(ArchetypeSnapshot{a, 0, 0});
+    }
+    accumulate(r.finished, s);
+    for (const detail::Block* block : r.blocks) {
+        accumulate(*block, s);
+    }
+    return s;
+}
+
+size_t archetypeId(const std::string& name) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto it = std::find(r.archetypes.begin(), r.archetypes.end(), name);
+    if (it != r.archetypes.end()) {
+        return it - r.archetypes.begin();
+    }
+    if (r.archetypes.size() + 1 < MaxArchetypes) {
+        r.archetypes.push_back(name);
+        return r.archetypes.size() - 1;
+    }
+    if (r.archetypes.size() + 1 == MaxArchetypes) {
+        r.archetypes.push_back("Other");
+    }
+    return MaxArchetypes - 1;
+}
+
+} // namespace stats
+} // namespace util_rviz
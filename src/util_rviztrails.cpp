@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_rviztrails.hpp"
+
+#include <sstream>
+
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreTechnique.h>
+
+#include "util_rvizmaterials.hpp"
+
+namespace rviz {
+
+const size_t TrailSet::NoTrail;
+
+namespace {
+const Ogre::ColourValue& colorOf(const MultiShape* obj) {
+    const Ogre::ColourValue* c = obj->getColor();
+    return c ? *c : Ogre::ColourValue::White;
+}
+} // namespace
+
+TrailSet::TrailSet(Ogre::SceneManager* scene_manager,
+                   Ogre::SceneNode* parent_node,
+                   size_t maxTrails,
+                   const TrailSettings& settings)
+        : scene_manager_(scene_manager), settings_(settings) {
+    static uint32_t count = 0;
+    std::stringstream ss;
+    ss << "UtilRvizTrails" << count++;
+
+    if (!parent_node) {
+        parent_node = scene_manager_->getRootSceneNode();
+    }
+    scene_node_ = parent_node->createChildSceneNode();
+
+    // Unlit, colored by the vertex colors of the chain elements
+    material_ = Ogre::MaterialManager::getSingleton().create(ss.str() + "Material", "rviz");
+    material_->setReceiveShadows(false);
+    material_->getTechnique(0)->setLightingEnabled(false);
+    material_->getTechnique(0)->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+    material_->getTechnique(0)->setDepthWriteEnabled(false);
+    material_->getTechnique(0)->setCullingMode(Ogre::CULL_NONE);
+
+    chain_ = scene_manager_->createBillboardChain(ss.str());
+    chain_->setNumberOfChains(maxTrails);
+    chain_->setMaxChainElements(settings_.length);
+    chain_->setUseTextureCoords(false);
+    chain_->setUseVertexColours(true);
+    chain_->setDynamic(true);
+    chain_->setMaterialName(material_->getName(), "rviz");
+    scene_node_->attachObject(chain_);
+
+    freeChains_.reserve(maxTrails);
+    for (size_t i = maxTrails; i > 0; --i) {
+        freeChains_.push_back(i - 1);
+    }
+    MultiShape::addDestructionListener(this);
+}
+
+TrailSet::~TrailSet() {
+    MultiShape::removeDestructionListener(this);
+    scene_manager_->destroyBillboardChain(chain_);
+    Ogre::MaterialManager::getSingleton().remove(material_->getName());
+    scene_manager_->destroySceneNode(scene_node_);
+}
+
+bool TrailSet::add(MultiShape* obj) {
+    if (trailIndices_.count(obj)) {
+        return true;
+    }
+    if (freeChains_.empty()) {
+        return false;
+    }
+    Trail trail{obj, freeChains_.back(), Ogre::Vector3::ZERO, ros::Time(), true, 0};
+    freeChains_.pop_back();
+    trailIndices_[obj] = trails_.size();
+    trails_.push_back(trail);
+    return true;
+}
+
+void TrailSet::remove(MultiShape* obj) {
+    auto it = trailIndices_.find(obj);
+    if (it == trailIndices_.end()) {
+        return;
+    }
+    const size_t index = it->second;
+    trailIndices_.erase(it);
+    chain_->clearChain(trails_[index].chain);
+    freeChains_.push_back(trails_[index].chain);
+
+    // Fill the gap with the last trail
+    if (index != trails_.size() - 1) {
+        trails_[index] = trails_.back();
+        trailIndices_[trails_[index].obj] = index;
+    }
+    trails_.pop_back();
+}
+
+size_t TrailSet::chainIndex(const MultiShape* obj) const {
+    auto it = trailIndices_.find(obj);
+    return it == trailIndices_.end() ? NoTrail : trails_[it->second].chain;
+}
+
+void TrailSet::objectDestroyed(MultiShape* obj) {
+    remove(obj);
+}
+
+void TrailSet::clearTrail(MultiShape* obj) {
+    auto it = trailIndices_.find(obj);
+    if (it != trailIndices_.end()) {
+        chain_->clearChain(trails_[it->second].chain);
+        trails_[it->second].empty = true;
+    }
+}
+
+void TrailSet::clear() {
+    for (const auto& trail : trails_) {
+        freeChains_.push_back(trail.chain);
+    }
+    trails_.clear();
+    trailIndices_.clear();
+    chain_->clearAllChains();
+}
+
+void TrailSet::update(const ros::Time& stamp) {
+    const float minDistanceSquared = settings_.minDistance * settings_.minDistance;
+    for (auto& trail : trails_) {
+        const Ogre::ColourValue& c = colorOf(trail.obj);
+        const Ogre::Vector3& position = trail.obj->getPosition();
+        if (!trail.empty) {
+            // A color change touches all points of the trail, but that is rare compared to moving
+            if (MaterialCache::key(c) != trail.color) {
+                recolor(trail, c);
+            }
+            if (position.squaredDistance(trail.lastPosition) < minDistanceSquared &&
+                (stamp - trail.lastStamp).toSec() < settings_.minInterval) {
+                continue;
+            }
+        }
+        chain_->addChainElement(
+            trail.chain, Ogre::BillboardChain::Element(position, settings_.width, 0.f, c, Ogre::Quaternion::IDENTITY));
+        trail.lastPosition = position;
+        trail.lastStamp = stamp;
+        trail.color = MaterialCache::key(c);
+        trail.empty = false;
+    }
+}
+
+void TrailSet::setVisible(bool visible) {
+    scene_node_->setVisible(visible);
+}
+
+void TrailSet::recolor(Trail& trail, const Ogre::ColourValue& c) {
+    const size_t count = chain_->getNumChainElements(trail.chain);
+    for (size_t i = 0; i < count; ++i) {
+        Ogre::BillboardChain::Element element = chain_->getChainElement(trail.chain, i);
+        element.colour = c;
+        chain_->updateChainElement(trail.chain, i, element);
+    }
+    trail.color = MaterialCache::key(c);
+}
+
+} // namespace rviz
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2017
+ * FZI Forschungszentrum Informatik, Karlsruhe, Germany (www.fzi.de)
+ * KIT, Institute of Measurement and Control, Karlsruhe, Germany (www.mrt.kit.edu)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Ogre without a window for the unit tests and the benchmark. Ogre compiles materials against the capabilities of the
+ * active render system, so a render system that renders nothing is installed. Meshes are loaded into software buffers
+ * by the DefaultHardwareBufferManager, so that entities and materials can be created as usual.
+ */
+
+#pragma once
+
+#include <OGRE/OgreDefaultHardwareBufferManager.h>
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreRenderSystem.h>
+#include <OGRE/OgreRenderSystemCapabilities.h>
+#include <OGRE/OgreResourceGroupManager.h>
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreSceneManager.h>
+#include <ros/package.h>
+
+namespace util_rviz_test {
+
+class NullRenderSystem : public Ogre::RenderSystem {
+public:
+    NullRenderSystem() {
+        mRealCapabilities = createRenderSystemCapabilities();
+        mCurrentCapabilities = mRealCapabilities;
+    }
+    ~NullRenderSystem() override {
+        OGRE_DELETE mRealCapabilities;
+        mRealCapabilities = mCurrentCapabilities = 0;
+    }
+
+    const Ogre::String& getName() const override {
+        static const Ogre::String name = "Null Rendering Subsystem";
+        return name;
+    }
+    Ogre::ConfigOptionMap& getConfigOptions() override {
+        return mOptions;
+    }
+    void setConfigOption(const Ogre::String&, const Ogre::String&) override {
+    }
+    Ogre::String validateConfigOptions() override {
+        return Ogre::String();
+    }
+
+    Ogre::RenderSystemCapabilities* createRenderSystemCapabilities() const override {
+        auto caps = OGRE_NEW Ogre::RenderSystemCapabilities();
+        caps->setRenderSystemName(getName());
+        caps->setCapability(Ogre::RSC_FIXED_FUNCTION);
+        caps->setNumTextureUnits(8);
+        caps->setNumVertexBlendMatrices(1);
+        return caps;
+    }
+
+    Ogre::HardwareOcclusionQuery* createHardwareOcclusionQuery() override {
+        return 0;
+    }
+    void reinitialise() override {
+    }
+    Ogre::RenderWindow* _createRenderWindow(const Ogre::String&,
+                                            unsigned int,
+                                            unsigned int,
+                                            bool,
+                                            const Ogre::NameValuePairList*) override {
+        return 0;
+    }
+    Ogre::MultiRenderTarget* createMultiRenderTarget(const Ogre::String&) override {
+        return 0;
+    }
+    Ogre::DepthBuffer* _createDepthBufferFor(Ogre::RenderTarget*) override {
+        return 0;
+    }
+    Ogre::String getErrorDescription(long) const override {
+        return Ogre::String();
+    }
+
+    void setAmbientLight(float, float, float) override {
+    }
+    void setShadingType(Ogre::ShadeOptions) override {
+    }
+    void setLightingEnabled(bool) override {
+    }
+    void _useLights(const Ogre::LightList&, unsigned short) override {
+    }
+    void _setWorldMatrix(const Ogre::Matrix4&) override {
+    }
+    void _setViewMatrix(const Ogre::Matrix4&) override {
+    }
+    void _setProjectionMatrix(const Ogre::Matrix4&) override {
+    }
+    void _setSurfaceParams(const Ogre::ColourValue&,
+                           const Ogre::ColourValue&,
+                           const Ogre::ColourValue&,
+                           const Ogre::ColourValue&,
+                           Ogre::Real,
+                           Ogre::TrackVertexColourType) override {
+    }
+    void _setPointSpritesEnabled(bool) override {
+    }
+    void _setPointParameters(Ogre::Real, bool, Ogre::Real, Ogre::Real, Ogre::Real, Ogre::Real, Ogre::Real) override {
+    }
+
+    void _setTexture(size_t, bool, const Ogre::TexturePtr&) override {
+    }
+    void _setTextureCoordSet(size_t, size_t) override {
+    }
+    void _setTextureCoordCalculation(size_t, Ogre::TexCoordCalcMethod, const Ogre::Frustum*) override {
+    }
+    void _setTextureBlendMode(size_t, const Ogre::LayerBlendModeEx&) override {
+    }
+    void _setTextureUnitFiltering(size_t, Ogre::FilterType, Ogre::FilterOptions) override {
+    }
+    void _setTextureLayerAnisotropy(size_t, unsigned int) override {
+    }
+    void _setTextureAddressingMode(size_t, const Ogre::TextureUnitState::UVWAddressingMode&) override {
+    }
+    void _setTextureBorderColour(size_t, const Ogre::ColourValue&) override {
+    }
+    void _setTextureMipmapBias(size_t, float) override {
+    }
+    void _setTextureMatrix(size_t, const Ogre::Matrix4&) override {
+    }
+
+    void _setSceneBlending(Ogre::SceneBlendFactor, Ogre::SceneBlendFactor, Ogre::SceneBlendOperation) override {
+    }
+    void _setSeparateSceneBlending(Ogre::SceneBlendFactor,
+                                   Ogre::SceneBlendFactor,
+                                   Ogre::SceneBlendFactor,
+                                   Ogre::SceneBlendFactor,
+                                   Ogre::SceneBlendOperation,
+                                   Ogre::SceneBlendOperation) override {
+    }
+    void _setAlphaRejectSettings(Ogre::CompareFunction, unsigned char, bool) override {
+    }
+
+    void _beginFrame() override {
+    }
+    void _endFrame() override {
+    }
+    void _setViewport(Ogre::Viewport*) override {
+    }
+    void _setRenderTarget(Ogre::RenderTarget*) override {
+    }
+    void _setCullingMode(Ogre::CullingMode) override {
+    }
+    void _setDepthBufferParams(bool, bool, Ogre::CompareFunction) override {
+    }
+    void _setDepthBufferCheckEnabled(bool) override {
+    }
+    void _setDepthBufferWriteEnabled(bool) override {
+    }
+    void _setDepthBufferFunction(Ogre::CompareFunction) override {
+    }
+    void _setColourBufferWriteEnabled(bool, bool, bool, bool) override {
+    }
+    void _setDepthBias(float, float) override {
+    }
+    void _setFog(Ogre::FogMode, const Ogre::ColourValue&, Ogre::Real, Ogre::Real, Ogre::Real) override {
+    }
+    void _setPolygonMode(Ogre::PolygonMode) override {
+    }
+
+    Ogre::VertexElementType getColourVertexElementType() const override {
+        return Ogre::VET_COLOUR_ABGR;
+    }
+    void _convertProjectionMatrix(const Ogre::Matrix4& matrix, Ogre::Matrix4& dest, bool) override {
+        dest = matrix;
+    }
+    void _makeProjectionMatrix(const Ogre::Radian&, Ogre::Real, Ogre::Real, Ogre::Real, Ogre::Matrix4& dest, bool)
+        override {
+        dest = Ogre::Matrix4::IDENTITY;
+    }
+    void _makeProjectionMatrix(Ogre::Real,
+                               Ogre::Real,
+                               Ogre::Real,
+                               Ogre::Real,
+                               Ogre::Real,
+                               Ogre::Real,
+                               Ogre::Matrix4& dest,
+                               bool) override {
+        dest = Ogre::Matrix4::IDENTITY;
+    }
+    void _makeOrthoMatrix(const Ogre::Radian&, Ogre::Real, Ogre::Real, Ogre::Real, Ogre::Matrix4& dest, bool)
+        override {
+        dest = Ogre::Matrix4::IDENTITY;
+    }
+    void _applyObliqueDepthProjection(Ogre::Matrix4&, const Ogre::Plane&, bool) override {
+    }
+
+    void setStencilCheckEnabled(bool) override {
+    }
+    void setStencilBufferParams(Ogre::CompareFunction,
+                                Ogre::uint32,
+                                Ogre::uint32,
+                                Ogre::uint32,
+                                Ogre::StencilOperation,
+                                Ogre::StencilOperation,
+                                Ogre::StencilOperation,
+                                bool) override {
+    }
+    void setVertexDeclaration(Ogre::VertexDeclaration*) override {
+    }
+    void setVertexBufferBinding(Ogre::VertexBufferBinding*) override {
+    }
+    void setNormaliseNormals(bool) override {
+    }
+    void bindGpuProgramParameters(Ogre::GpuProgramType, Ogre::GpuProgramParametersSharedPtr, Ogre::uint16) override {
+    }
+    void bindGpuProgramPassIterationParameters(Ogre::GpuProgramType) override {
+    }
+    void setScissorTest(bool, size_t, size_t, size_t, size_t) override {
+    }
+    void clearFrameBuffer(unsigned int, const Ogre::ColourValue&, Ogre::Real, unsigned short) override {
+    }
+
+    Ogre::Real getHorizontalTexelOffset() override {
+        return 0;
+    }
+    Ogre::Real getVerticalTexelOffset() override {
+        return 0;
+    }
+    Ogre::Real getMinimumDepthInputValue() override {
+        return -1;
+    }
+    Ogre::Real getMaximumDepthInputValue() override {
+        return 1;
+    }
+    bool hasAnisotropicMipMapFilter() const override {
+        return false;
+    }
+
+    void registerThread() override {
+    }
+    void unregisterThread() override {
+    }
+    void preExtraThreadsStarted() override {
+    }
+    void postExtraThreadsStarted() override {
+    }
+    unsigned int getDisplayMonitorCount() const override {
+        return 0;
+    }
+    void beginProfileEvent(const Ogre::String&) override {
+    }
+    void endProfileEvent() override {
+    }
+    void markProfileEvent(const Ogre::String&) override {
+    }
+
+protected:
+    void setClipPlanesImpl(const Ogre::PlaneList&) override {
+    }
+    void initialiseFromRenderSystemCapabilities(Ogre::RenderSystemCapabilities*, Ogre::RenderTarget*) override {
+    }
+};
+
+/**
+ * \brief Install a NullRenderSystem in root, load the primitive meshes of rviz and create a scene manager.
+ */
+inline Ogre::SceneManager* createHeadlessSceneManager(Ogre::Root& root) {
+    root.setRenderSystem(new NullRenderSystem());
+    // Keeps meshes in system memory, so that nothing is uploaded to a GPU
+    new Ogre::DefaultHardwareBufferManager();
+    Ogre::MaterialManager::getSingleton().initialise();
+    Ogre::ResourceGroupManager& resources = Ogre::ResourceGroupManager::getSingleton();
+    resources.createResourceGroup("rviz");
+    resources.addResourceLocation(ros::package::getPath("rviz") + "/ogre_media/models", "FileSystem", "rviz");
+    resources.initialiseResourceGroup("rviz");
+    return root.createSceneManager(Ogre::ST_GENERIC);
+}
+
+} // namespace util_rviz_test
@@ -32,10 +32,1761 @@
 //	  ASSERT_FLOAT_EQ((10.0f + 2.0f) * 3.0f, 10.0f * 3.0f + 2.0f * 3.0f)
 //}
 //=======================================================================================================================================================
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <thread>
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreMesh.h>
+#include <OGRE/OgrePass.h>
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreTechnique.h>
 #include "gtest/gtest.h"
+#include "util_rviz/util_rviz.hpp"
+#include "util_rviz/util_rvizdiagnostics.hpp"
+#include "util_rviz/util_rvizfootprint.hpp"
+#include "util_rviz/util_rvizinterpolation.hpp"
+#include "util_rviz/util_rvizlabels.hpp"
+#include "util_rviz/util_rvizcommands.hpp"
+#include "util_rviz/util_rvizlod.hpp"
+#include "util_rviz/util_rvizmaterials.hpp"
+#include "util_rviz/util_rvizpicking.hpp"
+#include "util_rviz/util_rvizpool.hpp"
+#include "util_rviz/util_rvizreconciler.hpp"
+#include "util_rviz/util_rvizrecording.hpp"
+#include "util_rviz/util_rvizscheduler.hpp"
+#include "util_rviz/util_rvizspatial.hpp"
+#include "util_rviz/util_rvizstatic.hpp"
+#include "util_rviz/util_rvizstats.hpp"
+#include "util_rviz/util_rviztrails.hpp"
+#include "headless_ogre.hpp"
 
-// A google test function (uncomment the next function, add code and
-// change the names TestGroupName and TestName)
-// TEST(TestGroupName, TestName) {
-// TODO: Add your test code here
-//}
+namespace {
+struct Settable {
+    void setPosition(const Ogre::Vector3& p) {
+        position = p;
+        ++updates;
+    }
+    void setOrientation(const Ogre::Quaternion& q) {
+        orientation = q;
+    }
+    void setScale(const Ogre::Vector3& s) {
+        scale = s;
+    }
+    Ogre::Vector3 position{0, 0, 0};
+    Ogre::Quaternion orientation;
+    Ogre::Vector3 scale{1, 1, 1};
+    int updates{0};
+    int references{0};
+};
+
+void intrusive_ptr_add_ref(Settable* s) {
+    ++s->references;
+}
+void intrusive_ptr_release(Settable* s) {
+    if (--s->references == 0) {
+        delete s;
+    }
+}
+
+// Owns a Settable through a handle of the given kind, the weak pointers through an additional shared pointer
+template <typename Handle>
+struct HandleFactory;
+template <>
+struct HandleFactory<Settable*> {
+    Settable object;
+    Settable* handle{&object};
+};
+template <typename T>
+struct HandleFactory<std::shared_ptr<T>> {
+    std::shared_ptr<T> handle{new Settable};
+};
+template <typename T>
+struct HandleFactory<std::unique_ptr<T>> {
+    std::unique_ptr<T> handle{new Settable};
+};
+template <typename T>
+struct HandleFactory<std::weak_ptr<T>> {
+    std::shared_ptr<T> owner{new Settable};
+    std::weak_ptr<T> handle{owner};
+};
+template <typename T>
+struct HandleFactory<boost::shared_ptr<T>> {
+    boost::shared_ptr<T> handle{new Settable};
+};
+template <typename T>
+struct HandleFactory<boost::scoped_ptr<T>> {
+    boost::scoped_ptr<T> handle{new Settable};
+};
+template <typename T>
+struct HandleFactory<boost::weak_ptr<T>> {
+    boost::shared_ptr<T> owner{new Settable};
+    boost::weak_ptr<T> handle{owner};
+};
+template <typename T>
+struct HandleFactory<boost::intrusive_ptr<T>> {
+    boost::intrusive_ptr<T> handle{new Settable};
+};
+
+template <typename Handle>
+class SafeSetters : public ::testing::Test {};
+using HandleTypes = ::testing::Types<Settable*,
+                                     std::shared_ptr<Settable>,
+                                     std::unique_ptr<Settable>,
+                                     std::weak_ptr<Settable>,
+                                     boost::shared_ptr<Settable>,
+                                     boost::scoped_ptr<Settable>,
+                                     boost::weak_ptr<Settable>,
+                                     boost::intrusive_ptr<Settable>>;
+TYPED_TEST_CASE(SafeSetters, HandleTypes);
+
+// Stands in for a MultiShape in MultiShapePool
+struct PooledShape {
+    explicit PooledShape(Ogre::SceneManager*) {
+        ++created;
+    }
+    void reset() {
+        ++resets;
+        shown = false;
+        tag = 0;
+    }
+    void detach() {
+        attached = false;
+    }
+    void attach(Ogre::SceneNode*) {
+        attached = true;
+    }
+    void visible(bool v) {
+        shown = v;
+    }
+    static int created;
+    int resets{0};
+    int tag{0};
+    bool attached{true};
+    bool shown{true};
+};
+int PooledShape::created = 0;
+
+// Headless, but with the meshes and materials rviz::Shape needs
+Ogre::SceneManager* sceneManager() {
+    static Ogre::Root root("", "", "");
+    static Ogre::SceneManager* scene_manager = util_rviz_test::createHeadlessSceneManager(root);
+    return scene_manager;
+}
+
+const Ogre::ColourValue& diffuse(const Ogre::MaterialPtr& material) {
+    return material->getTechnique(0)->getPass(0)->getDiffuse();
+}
+
+std::vector<rviz::MultiShape*> sorted(std::vector<rviz::MultiShape*> objects) {
+    std::sort(objects.begin(), objects.end());
+    return objects;
+}
+} // namespace
+
+TEST(UtilRviz, finiteMask) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> values(37, 1.f);
+    values[0] = nan;
+    values[5] = -inf;
+    values[17] = inf;
+    values[36] = nan;
+    std::vector<uint8_t> mask(values.size());
+    util_rviz::finiteMask(values.data(), values.size(), mask.data());
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(std::isfinite(values[i]), mask[i] == 1) << "at index " << i;
+    }
+}
+
+TEST(UtilRviz, setPosesSafely) {
+    std::vector<Settable> objects(4);
+    std::vector<Settable*> pointers{&objects[0], nullptr, &objects[2], &objects[3]};
+    std::vector<Ogre::Vector3> positions(4, Ogre::Vector3(1, 2, 3));
+    std::vector<Ogre::Quaternion> orientations(4, Ogre::Quaternion(1, 0, 0, 0));
+    positions[2].y = std::numeric_limits<float>::quiet_NaN();
+    orientations.pop_back();
+
+    // Filled with the rejected indices, the previous content is dropped
+    std::vector<size_t> rejected{7};
+    EXPECT_EQ(3u, util_rviz::setPosesSafely(pointers, positions, orientations, &rejected));
+    EXPECT_EQ(std::vector<size_t>({1, 2, 3}), rejected);
+    EXPECT_EQ(1, objects[0].updates);
+    EXPECT_EQ(Ogre::Vector3(1, 2, 3), objects[0].position);
+    EXPECT_EQ(0, objects[2].updates);
+    EXPECT_EQ(0, objects[3].updates);
+
+    // Without a buffer only the rejected entries are counted
+    EXPECT_EQ(2u, util_rviz::setPosesSafely(pointers.data(), positions.data(), orientations.data(), 3));
+    EXPECT_EQ(2, objects[0].updates);
+}
+
+TEST(UtilRviz, selectLodLevelHysteresis) {
+    rviz::LodSettings settings;
+    settings.distances = {10, 20, 30};
+    settings.hysteresis = 0.1f;
+    EXPECT_EQ(rviz::MultiShape::LodFull, rviz::selectLodLevel(5, rviz::MultiShape::LodFull, settings));
+    EXPECT_EQ(rviz::MultiShape::LodFull, rviz::selectLodLevel(10.5, rviz::MultiShape::LodFull, settings));
+    EXPECT_EQ(rviz::MultiShape::LodReduced, rviz::selectLodLevel(11.5, rviz::MultiShape::LodFull, settings));
+    EXPECT_EQ(rviz::MultiShape::LodReduced, rviz::selectLodLevel(9.5, rviz::MultiShape::LodReduced, settings));
+    EXPECT_EQ(rviz::MultiShape::LodFull, rviz::selectLodLevel(8.5, rviz::MultiShape::LodReduced, settings));
+    EXPECT_EQ(rviz::MultiShape::LodHidden, rviz::selectLodLevel(100, rviz::MultiShape::LodFull, settings));
+    EXPECT_EQ(rviz::MultiShape::LodFull, rviz::selectLodLevel(1, rviz::MultiShape::LodHidden, settings));
+}
+
+TEST(UtilRviz, statsCountRejectionsByReason) {
+    using namespace util_rviz;
+    const stats::Snapshot before = stats::snapshot();
+    Settable object;
+    Settable* null = nullptr;
+    setPositionSafely(object, Ogre::Vector3(1, 2, 3));
+    setPositionSafely(null, Ogre::Vector3(1, 2, 3));
+    setPoseSafely(null, Ogre::Vector3(1, 2, 3), Ogre::Quaternion::IDENTITY);
+    setTransformSafely(null, Ogre::Vector3(1, 2, 3), Ogre::Quaternion::IDENTITY, Ogre::Vector3(1, 1, 1));
+    setScaleSafely(object, Ogre::Vector3(std::numeric_limits<float>::infinity(), 1, 1));
+    std::thread([&object] {
+        setPositionSafely(object, Ogre::Vector3(std::numeric_limits<float>::quiet_NaN(), 0, 0));
+        setOrientationSafely(object, Ogre::Quaternion(std::numeric_limits<float>::quiet_NaN(), 0, 0, 0));
+    }).join();
+    const stats::Snapshot after = stats::snapshot();
+
+    auto diff = [&](stats::Counter c) { return after.counters[c] - before.counters[c]; };
+    EXPECT_EQ(1u, diff(stats::PositionApplied));
+    EXPECT_EQ(3u, diff(stats::PositionRejectedNull));
+    EXPECT_EQ(2u, diff(stats::OrientationRejectedNull));
+    EXPECT_EQ(1u, diff(stats::ScaleRejectedNull));
+    EXPECT_EQ(1u, diff(stats::PositionRejectedNonFinite));
+    EXPECT_EQ(1u, diff(stats::OrientationRejectedNonFinite));
+    EXPECT_EQ(1u, diff(stats::ScaleRejectedNonFinite));
+    EXPECT_EQ(0u, diff(stats::OrientationApplied));
+}
+
+TYPED_TEST(SafeSetters, everyPointerKind) {
+    using namespace util_rviz;
+    static_assert(is_pointer_type<TypeParam>::value, "Handle has to be a pointer type");
+    HandleFactory<TypeParam> factory;
+    const TypeParam& constHandle = factory.handle;
+    auto object = ptr(factory.handle);
+    ASSERT_TRUE(object);
+
+    EXPECT_TRUE(setPositionSafely(factory.handle, Ogre::Vector3(1, 2, 3)));
+    EXPECT_TRUE(setOrientationSafely(constHandle, Ogre::Quaternion(0, 1, 0, 0)));
+    EXPECT_TRUE(setScaleSafely(factory.handle, Ogre::Vector3(2, 2, 2)));
+    EXPECT_EQ(Ogre::Vector3(1, 2, 3), object->position);
+    EXPECT_EQ(Ogre::Quaternion(0, 1, 0, 0), object->orientation);
+    EXPECT_EQ(Ogre::Vector3(2, 2, 2), object->scale);
+
+    EXPECT_TRUE(
+        setTransformSafely(constHandle, Ogre::Vector3(4, 5, 6), Ogre::Quaternion::IDENTITY, Ogre::Vector3(3, 3, 3)));
+    EXPECT_EQ(Ogre::Vector3(4, 5, 6), object->position);
+    EXPECT_EQ(Ogre::Quaternion::IDENTITY, object->orientation);
+    EXPECT_EQ(Ogre::Vector3(3, 3, 3), object->scale);
+
+    const Ogre::Vector3 nan(std::numeric_limits<float>::quiet_NaN(), 0, 0);
+    EXPECT_FALSE(setPoseSafely<validation::Skip>(factory.handle, nan, Ogre::Quaternion(0, 0, 1, 0)));
+    EXPECT_EQ(Ogre::Vector3(4, 5, 6), object->position);
+    EXPECT_EQ(Ogre::Quaternion::IDENTITY, object->orientation);
+}
+
+TEST(UtilRviz, diagnosticStatusReportsCountersAndRejectionRate) {
+    namespace stats = util_rviz::stats;
+    stats::Snapshot last;
+    stats::Snapshot current;
+    current.counters[stats::PositionApplied] = 123;
+    last.counters[stats::PosesRejected] = 4;
+    current.counters[stats::PosesRejected] = 10;
+    current.histograms[stats::SetPoses].count = 2;
+    current.histograms[stats::SetPoses].totalNs = 3000;
+    current.archetypes.push_back(stats::ArchetypeSnapshot{"SimpleCar", 5, 2});
+
+    const diagnostic_msgs::DiagnosticStatus status = util_rviz::diagnosticStatus(current, last, 2., 1.);
+    std::map<std::string, std::string> values;
+    for (const auto& kv : status.values) {
+        EXPECT_TRUE(values.emplace(kv.key, kv.value).second) << kv.key;
+    }
+    EXPECT_EQ(1 + stats::CounterCount + 3 * stats::HistogramCount + 2, values.size());
+    for (size_t i = 0; i < stats::CounterCount; ++i) {
+        EXPECT_EQ(1u, values.count(stats::name(stats::Counter(i)))) << stats::name(stats::Counter(i));
+    }
+    for (size_t i = 0; i < stats::HistogramCount; ++i) {
+        const std::string prefix = stats::name(stats::Histogram(i));
+        EXPECT_EQ(1u, values.count(prefix + "_count")) << prefix;
+        EXPECT_EQ(1u, values.count(prefix + "_mean_us")) << prefix;
+        EXPECT_EQ(1u, values.count(prefix + "_p99_us")) << prefix;
+    }
+
+    // Counters are integers
+    EXPECT_EQ("123", values[stats::name(stats::PositionApplied)]);
+    EXPECT_EQ("2", values[std::string(stats::name(stats::SetPoses)) + "_count"]);
+    EXPECT_EQ("3", values["SimpleCar_alive"]);
+    EXPECT_EQ("5", values["SimpleCar_constructed"]);
+    EXPECT_DOUBLE_EQ(1.5, std::stod(values[std::string(stats::name(stats::SetPoses)) + "_mean_us"]));
+
+    // 6 rejections within 2 s
+    EXPECT_DOUBLE_EQ(3., std::stod(values["rejections_per_second"]));
+    EXPECT_EQ(diagnostic_msgs::DiagnosticStatus::WARN, status.level);
+    EXPECT_EQ(diagnostic_msgs::DiagnosticStatus::OK, util_rviz::diagnosticStatus(current, last, 10., 1.).level);
+    EXPECT_EQ(diagnostic_msgs::DiagnosticStatus::OK, util_rviz::diagnosticStatus(current, last, 0., 1.).level);
+}
+
+TEST(UtilRviz, safeSettersRejectNull) {
+    using namespace util_rviz;
+    std::shared_ptr<Settable> null;
+    std::weak_ptr<Settable> expired = std::make_shared<Settable>();
+    EXPECT_FALSE(setPositionSafely<validation::Skip>(null, Ogre::Vector3(1, 2, 3)));
+    EXPECT_FALSE(setPoseSafely<validation::Skip>(expired, Ogre::Vector3(1, 2, 3), Ogre::Quaternion::IDENTITY));
+    EXPECT_THROW(setScaleSafely<validation::Throw>(null, Ogre::Vector3(1, 2, 3)), std::invalid_argument);
+}
+
+TEST(UtilRviz, validationPolicies) {
+    using namespace util_rviz;
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+    const Ogre::Quaternion rotated(0, 0, 1, 0);
+    Settable object;
+
+    // Partial policies apply the valid parts
+    EXPECT_FALSE(setPoseSafely<validation::CountOnly>(object, Ogre::Vector3(1, 2, 3), Ogre::Quaternion(nan, 0, 0, 0)));
+    EXPECT_EQ(Ogre::Vector3(0, 0, 0), object.position);
+    EXPECT_FALSE(setPoseSafely<validation::LastValid>(object, Ogre::Vector3(1, 2, 3), Ogre::Quaternion(nan, 0, 0, 0)));
+    EXPECT_EQ(Ogre::Vector3(1, 2, 3), object.position);
+
+    EXPECT_TRUE(setTransformSafely<validation::Clamp>(
+        object, Ogre::Vector3(nan, -inf, 4), rotated, Ogre::Vector3(nan, 2, 2)));
+    EXPECT_EQ(Ogre::Vector3(0, -validation::Clamp::limit(), 4), object.position);
+    EXPECT_EQ(rotated, object.orientation);
+    EXPECT_EQ(Ogre::Vector3(1, 2, 2), object.scale);
+    EXPECT_TRUE(setOrientationSafely<validation::Clamp>(object, Ogre::Quaternion(inf, 0, 0, 0)));
+    EXPECT_EQ(Ogre::Quaternion::IDENTITY, object.orientation);
+
+    EXPECT_THROW(setPositionSafely<validation::Throw>(object, Ogre::Vector3(inf, 0, 0)), std::invalid_argument);
+    EXPECT_EQ(Ogre::Vector3(0, -validation::Clamp::limit(), 4), object.position);
+}
+
+TEST(UtilRviz, recordingSeek) {
+    const std::string path = "util_rviz_recording_test.bin";
+    // Agents are only created in sync(), so the scenes work without Ogre
+    rviz::AgentScene recorded(nullptr);
+    {
+        rviz::SceneRecorder recorder(path, 4);
+        const rviz::AgentScene::Slot car = recorded.add(1, rviz::Archetype::Car);
+        rviz::AgentScene::Slot bike = recorded.add(2, rviz::Archetype::Bike);
+        for (int frame = 0; frame < 10; ++frame) {
+            recorded.setPosition(car, Ogre::Vector3(frame, 0, 0));
+            if (frame == 3) {
+                recorded.remove(bike);
+            }
+            if (frame == 6) {
+                bike = recorded.add(3, rviz::Archetype::Bike);
+                recorded.setColor(bike, Ogre::ColourValue(1, 0, 0, 1));
+            }
+            recorder.record(ros::Time(frame + 1.0), recorded);
+        }
+    }
+
+    rviz::AgentScene replayed(nullptr);
+    rviz::ScenePlayer player(path, replayed);
+    ASSERT_EQ(10u, player.frameCount());
+    auto positionOf = [&replayed](uint64_t id) {
+        for (size_t i = 0; i < replayed.size(); ++i) {
+            if (replayed.ids()[i] == id) {
+                return replayed.positions()[i];
+            }
+        }
+        return Ogre::Vector3(-1, -1, -1);
+    };
+
+    player.seek(ros::Time(3.5));
+    EXPECT_EQ(2u, replayed.size());
+    EXPECT_EQ(Ogre::Vector3(2, 0, 0), positionOf(1));
+    player.seek(ros::Time(10.0)); // Across a keyframe
+    EXPECT_EQ(2u, replayed.size());
+    EXPECT_EQ(Ogre::Vector3(9, 0, 0), positionOf(1));
+    EXPECT_NE(Ogre::Vector3(-1, -1, -1), positionOf(3));
+    player.seek(ros::Time(5.0)); // Backwards
+    EXPECT_EQ(1u, replayed.size());
+    EXPECT_EQ(Ogre::Vector3(4, 0, 0), positionOf(1));
+    player.seek(ros::Time(6.0)); // Forward within the keyframe
+    EXPECT_EQ(Ogre::Vector3(5, 0, 0), positionOf(1));
+    std::remove(path.c_str());
+}
+
+TEST(UtilRviz, recordingKeepsUncoloredAgents) {
+    const std::string path = "util_rviz_recording_color_test.bin";
+    rviz::AgentScene recorded(nullptr);
+    {
+        // Every frame is a keyframe, so that seeking always compares the states
+        rviz::SceneRecorder recorder(path, 1);
+        rviz::AgentScene::Slot uncolored = recorded.add(1, rviz::Archetype::Car);
+        const rviz::AgentScene::Slot colored = recorded.add(2, rviz::Archetype::Car);
+        recorded.setColorPartly(colored, Ogre::ColourValue(0, 1, 0, 1));
+        recorder.record(ros::Time(1.0), recorded);
+
+        // The id is reused by a colored car, and then by an uncolored one again
+        recorded.remove(uncolored);
+        uncolored = recorded.add(1, rviz::Archetype::Car);
+        recorded.setColor(uncolored, Ogre::ColourValue(1, 0, 0, 1));
+        recorder.record(ros::Time(2.0), recorded);
+        recorded.remove(uncolored);
+        recorded.add(1, rviz::Archetype::Car);
+        recorder.record(ros::Time(3.0), recorded);
+    }
+
+    rviz::AgentScene replayed(nullptr);
+    rviz::ScenePlayer player(path, replayed);
+    auto indexOf = [&replayed](uint64_t id) {
+        for (size_t i = 0; i < replayed.size(); ++i) {
+            if (replayed.ids()[i] == id) {
+                return i;
+            }
+        }
+        return replayed.size();
+    };
+
+    player.seek(ros::Time(1.0));
+    ASSERT_EQ(2u, replayed.size());
+    EXPECT_FALSE(replayed.colorsSet()[indexOf(1)]);
+    EXPECT_TRUE(replayed.colorsSet()[indexOf(2)]);
+    EXPECT_TRUE(replayed.colorsPartly()[indexOf(2)]);
+    EXPECT_EQ(Ogre::ColourValue(0, 1, 0, 1), replayed.colors()[indexOf(2)]);
+
+    player.seek(ros::Time(2.0));
+    EXPECT_TRUE(replayed.colorsSet()[indexOf(1)]);
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), replayed.colors()[indexOf(1)]);
+
+    player.seek(ros::Time(3.0));
+    ASSERT_EQ(2u, replayed.size());
+    EXPECT_FALSE(replayed.colorsSet()[indexOf(1)]);
+    EXPECT_TRUE(replayed.colorsSet()[indexOf(2)]);
+    std::remove(path.c_str());
+}
+
+TEST(UtilRviz, idIndexMapErase) {
+    rviz::IdIndexMap map;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        map.insert(i * 7919, i);
+    }
+    EXPECT_EQ(1000u, map.size());
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        map.erase(i * 7919);
+    }
+    EXPECT_EQ(500u, map.size());
+    for (uint32_t i = 0; i < 1000; ++i) {
+        EXPECT_EQ(i % 2 ? i : rviz::IdIndexMap::Missing, map.find(i * 7919));
+    }
+    map.insert(7919, 5);
+    EXPECT_EQ(5u, map.find(7919));
+    EXPECT_EQ(500u, map.size());
+}
+
+TEST(UtilRviz, idIndexMapOverwritesWithoutGrowing) {
+    rviz::IdIndexMap map;
+    // Fill the initial 16 buckets up to the maximum load factor of 1/2
+    for (uint32_t i = 0; i < 8; ++i) {
+        map.insert(i, i);
+    }
+    for (int round = 0; round < 100; ++round) {
+        for (uint32_t i = 0; i < 8; ++i) {
+            map.insert(i, i + 1);
+        }
+    }
+    EXPECT_EQ(8u, map.size());
+    EXPECT_EQ(16u, map.bucketCount());
+    for (uint32_t i = 0; i < 8; ++i) {
+        EXPECT_EQ(i + 1, map.find(i));
+    }
+    map.insert(8, 8);
+    EXPECT_EQ(32u, map.bucketCount());
+    EXPECT_EQ(8u, map.find(8));
+    EXPECT_EQ(3u, map.find(2));
+}
+
+TEST(UtilRviz, reconcilerAppliesDiffs) {
+    rviz::Reconciler reconciler(sceneManager());
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    std::vector<rviz::AgentState> frame;
+    for (uint64_t id = 1; id <= 4; ++id) {
+        frame.push_back(rviz::AgentState{
+            id, rviz::Archetype::Car, Ogre::Vector3(id, 0, 0), Ogre::Quaternion::IDENTITY, red, false});
+    }
+    rviz::Reconciler::Result result = reconciler.apply(frame);
+    EXPECT_EQ(4u, result.added);
+    EXPECT_EQ(0u, result.updated);
+    EXPECT_EQ(0u, result.retyped);
+    EXPECT_EQ(0u, result.removed);
+    EXPECT_EQ(4u, reconciler.size());
+
+    // The same frame again changes nothing
+    result = reconciler.apply(frame);
+    EXPECT_EQ(0u, result.added + result.updated + result.retyped + result.removed);
+
+    // Move 2, turn 3 into a pedestrian, drop 1 and add 5
+    const std::shared_ptr<rviz::MultiShape> car3 = reconciler.find(3);
+    const std::shared_ptr<rviz::MultiShape> car4 = reconciler.find(4);
+    car3->setUserData(Ogre::Any(3));
+    frame.erase(frame.begin());
+    frame[0].position = Ogre::Vector3(2, 2, 0);
+    frame[1].archetype = rviz::Archetype::Pedestrian;
+    frame.push_back(
+        rviz::AgentState{5, rviz::Archetype::Bike, Ogre::Vector3(5, 0, 0), Ogre::Quaternion::IDENTITY, red, false});
+    result = reconciler.apply(frame);
+    EXPECT_EQ(1u, result.added);
+    EXPECT_EQ(2u, result.updated); // The retyped object counts as updated, too
+    EXPECT_EQ(1u, result.retyped);
+    EXPECT_EQ(1u, result.removed);
+    EXPECT_EQ(4u, reconciler.size());
+
+    EXPECT_FALSE(reconciler.find(1));
+    EXPECT_EQ(Ogre::Vector3(2, 2, 0), reconciler.find(2)->getPosition());
+    EXPECT_TRUE(dynamic_cast<rviz::SimpleBike*>(reconciler.find(5).get()));
+    // The retyped object is replaced and takes over the state of the old one
+    const std::shared_ptr<rviz::MultiShape> pedestrian3 = reconciler.find(3);
+    EXPECT_NE(car3, pedestrian3);
+    EXPECT_TRUE(dynamic_cast<rviz::SimplePedestrian*>(pedestrian3.get()));
+    EXPECT_EQ(Ogre::Vector3(3, 0, 0), pedestrian3->getPosition());
+    EXPECT_EQ(3, Ogre::any_cast<int>(pedestrian3->getUserData()));
+    // The other objects are kept
+    EXPECT_EQ(car4, reconciler.find(4));
+
+    size_t count = 0;
+    reconciler.forEach([&](uint64_t id, rviz::MultiShape& shape) {
+        EXPECT_EQ(reconciler.find(id).get(), &shape);
+        ++count;
+    });
+    EXPECT_EQ(4u, count);
+}
+
+TEST(UtilRviz, reconcilerFixesIndicesOfMovedEntries) {
+    rviz::Reconciler reconciler(sceneManager());
+    std::vector<rviz::AgentState> frame;
+    for (uint64_t id = 0; id < 8; ++id) {
+        frame.push_back(rviz::AgentState{id,
+                                         rviz::Archetype::Unknown,
+                                         Ogre::Vector3(id, 0, 0),
+                                         Ogre::Quaternion::IDENTITY,
+                                         Ogre::ColourValue::White,
+                                         false});
+    }
+    reconciler.apply(frame);
+
+    // Removing the first, a middle and the last entries moves the last entries into the gaps
+    std::vector<rviz::AgentState> remaining;
+    for (const auto& agent : frame) {
+        if (agent.id != 0 && agent.id != 3 && agent.id != 7) {
+            remaining.push_back(agent);
+        }
+    }
+    const rviz::Reconciler::Result result = reconciler.apply(remaining);
+    EXPECT_EQ(3u, result.removed);
+    EXPECT_EQ(0u, result.updated);
+    ASSERT_EQ(5u, reconciler.size());
+    for (uint64_t id = 0; id < 8; ++id) {
+        const std::shared_ptr<rviz::MultiShape> shape = reconciler.find(id);
+        if (id == 0 || id == 3 || id == 7) {
+            EXPECT_FALSE(shape) << id;
+        } else {
+            ASSERT_TRUE(shape) << id;
+            EXPECT_EQ(Ogre::Vector3(id, 0, 0), shape->getPosition()) << id;
+        }
+    }
+
+    // Updates after the removal reach the moved entries
+    remaining.back().position = Ogre::Vector3(0, 6, 0);
+    EXPECT_EQ(1u, reconciler.apply(remaining).updated);
+    EXPECT_EQ(Ogre::Vector3(0, 6, 0), reconciler.find(6)->getPosition());
+    EXPECT_EQ(5u, reconciler.size());
+}
+
+TEST(UtilRviz, shapeCommandQueueCoalesces) {
+    rviz::ShapeCommandQueue queue(1 << 16);
+    std::vector<std::thread> producers;
+    for (uint64_t t = 0; t < 4; ++t) {
+        producers.emplace_back([&queue, t] {
+            for (int i = 0; i < 1000; ++i) {
+                queue.setPosition(t, Ogre::Vector3(i, 0, 0));
+            }
+            queue.setColorPartly(t, Ogre::ColourValue(1, 0, 0, 1));
+        });
+    }
+    for (auto& p : producers) {
+        p.join();
+    }
+
+    std::vector<rviz::ShapeUpdate> updates;
+    EXPECT_EQ(4u, queue.drain([&updates](const rviz::ShapeUpdate& u) { updates.push_back(u); }));
+    for (const auto& u : updates) {
+        EXPECT_EQ(rviz::ShapeUpdate::Position | rviz::ShapeUpdate::ColorPartly, u.fields);
+        EXPECT_EQ(Ogre::Vector3(999, 0, 0), u.position);
+        EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), u.colorPartly);
+    }
+    EXPECT_EQ(0u, queue.drain([](const rviz::ShapeUpdate&) {}));
+    const auto statistics = queue.statistics();
+    EXPECT_EQ(4004u, statistics.queued);
+    EXPECT_EQ(3996u, statistics.superseded);
+    EXPECT_EQ(0u, statistics.overflowed);
+}
+
+TEST(UtilRviz, shapeCommandQueueOverflowKeepsLastWrites) {
+    rviz::ShapeCommandQueue queue(4);
+    std::vector<std::thread> producers;
+    for (uint64_t t = 0; t < 4; ++t) {
+        producers.emplace_back([&queue, t] {
+            for (uint64_t id = t * 100; id < t * 100 + 50; ++id) {
+                for (int i = 0; i < 20; ++i) {
+                    queue.setPosition(id, Ogre::Vector3(i, 0, 0));
+                }
+                queue.visible(id, id % 2);
+            }
+        });
+    }
+
+    // Drain while the producers are writing, the last write of each agent has to win in the end
+    std::map<uint64_t, rviz::ShapeUpdate> state;
+    auto drain = [&queue, &state] {
+        return queue.drain([&state](const rviz::ShapeUpdate& u) {
+            auto it = state.emplace(u.id, rviz::ShapeUpdate::none(u.id)).first;
+            it->second.merge(u);
+        });
+    };
+    for (int i = 0; i < 10; ++i) {
+        drain();
+    }
+    for (auto& p : producers) {
+        p.join();
+    }
+    while (drain() > 0) {
+    }
+
+    EXPECT_EQ(200u, state.size());
+    for (const auto& entry : state) {
+        EXPECT_EQ(Ogre::Vector3(19, 0, 0), entry.second.position);
+        EXPECT_EQ(entry.first % 2 == 1, entry.second.visible);
+    }
+    const auto statistics = queue.statistics();
+    EXPECT_EQ(4200u, statistics.queued);
+    EXPECT_GT(statistics.overflowed, 0u);
+}
+
+TEST(UtilRviz, shapeUpdateKeepsColorBeforeColorPartly) {
+    rviz::ShapeUpdate u = rviz::ShapeUpdate::none(1);
+    EXPECT_FALSE(u.setColor(Ogre::ColourValue(1, 0, 0, 1)));
+    EXPECT_FALSE(u.setColorPartly(Ogre::ColourValue(0, 1, 0, 1)));
+    // Both are kept, the full color is applied first
+    EXPECT_EQ(rviz::ShapeUpdate::Color | rviz::ShapeUpdate::ColorPartly, u.fields);
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), u.color);
+    EXPECT_EQ(Ogre::ColourValue(0, 1, 0, 1), u.colorPartly);
+
+    // A later full color replaces both
+    rviz::ShapeUpdate later = rviz::ShapeUpdate::none(1);
+    later.setColor(Ogre::ColourValue(0, 0, 1, 1));
+    EXPECT_EQ(1u, u.merge(later));
+    EXPECT_EQ(rviz::ShapeUpdate::Color, u.fields);
+    EXPECT_EQ(Ogre::ColourValue(0, 0, 1, 1), u.color);
+
+    rviz::ShapeCommandQueue queue;
+    queue.setColor(2, Ogre::ColourValue(1, 0, 0, 1));
+    queue.setColorPartly(2, Ogre::ColourValue(0, 1, 0, 1));
+    EXPECT_EQ(1u, queue.drain([](const rviz::ShapeUpdate& drained) {
+        EXPECT_EQ(rviz::ShapeUpdate::Color | rviz::ShapeUpdate::ColorPartly, drained.fields);
+        EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), drained.color);
+        EXPECT_EQ(Ogre::ColourValue(0, 1, 0, 1), drained.colorPartly);
+    }));
+}
+
+TEST(UtilRviz, labelLayoutCentersGlyphs) {
+    auto width = [](unsigned char c) { return static_cast<float>(c - 'a' + 1); };
+    std::vector<float> offsets;
+    // a, b and c are 1, 2 and 3 wide, the space 0.5
+    EXPECT_FLOAT_EQ(6.5f, rviz::LabelSet::layoutLine("ab c", 0.5f, width, offsets));
+    ASSERT_EQ(3u, offsets.size());
+    EXPECT_FLOAT_EQ(-2.75f, offsets[0]);
+    EXPECT_FLOAT_EQ(-1.25f, offsets[1]);
+    EXPECT_FLOAT_EQ(1.75f, offsets[2]);
+
+    // Leading and trailing spaces shift the glyphs, offsets are appended
+    EXPECT_FLOAT_EQ(2.f, rviz::LabelSet::layoutLine(" a ", 0.5f, width, offsets));
+    ASSERT_EQ(4u, offsets.size());
+    EXPECT_FLOAT_EQ(0.f, offsets[3]);
+
+    offsets.clear();
+    EXPECT_FLOAT_EQ(1.f, rviz::LabelSet::layoutLine("  ", 0.5f, width, offsets));
+    EXPECT_TRUE(offsets.empty());
+    EXPECT_FLOAT_EQ(0.f, rviz::LabelSet::layoutLine("", 0.5f, width, offsets));
+}
+
+TEST(UtilRviz, multiShapePoolReusesAndResets) {
+    PooledShape::created = 0;
+    rviz::MultiShapePool<PooledShape> pool(nullptr, 2, 3);
+    EXPECT_EQ(2, PooledShape::created);
+    EXPECT_EQ(2u, pool.idle());
+
+    std::shared_ptr<PooledShape> a = pool.acquire();
+    EXPECT_EQ(1u, pool.idle());
+    EXPECT_TRUE(a->attached);
+    EXPECT_TRUE(a->shown);
+    a->tag = 42;
+    PooledShape* raw = a.get();
+    a.reset();
+    EXPECT_EQ(2u, pool.idle());
+    EXPECT_FALSE(raw->attached);
+
+    // The most recently returned instance comes back, reset
+    std::shared_ptr<PooledShape> b = pool.acquire();
+    EXPECT_EQ(raw, b.get());
+    EXPECT_EQ(0, b->tag);
+    EXPECT_EQ(2, PooledShape::created);
+
+    // Instances beyond the high water mark are destroyed on release
+    std::vector<std::shared_ptr<PooledShape>> many;
+    for (int i = 0; i < 5; ++i) {
+        many.push_back(pool.acquire());
+    }
+    EXPECT_EQ(0u, pool.idle());
+    many.clear();
+    b.reset();
+    EXPECT_EQ(3u, pool.idle());
+    pool.setHighWaterMark(1);
+    EXPECT_EQ(1u, pool.idle());
+}
+
+TEST(UtilRviz, multiShapePoolAdopts) {
+    PooledShape::created = 0;
+    rviz::MultiShapePool<PooledShape> pool(nullptr, 0, 1);
+    std::unique_ptr<PooledShape> external(new PooledShape(nullptr));
+    external->tag = 7;
+    external->attach(nullptr);
+    PooledShape* raw = external.get();
+    EXPECT_TRUE(pool.adopt(std::move(external)));
+    EXPECT_EQ(1u, pool.idle());
+    EXPECT_FALSE(raw->attached);
+
+    // Beyond the high water mark, adopted instances are destroyed
+    EXPECT_FALSE(pool.adopt(std::unique_ptr<PooledShape>(new PooledShape(nullptr))));
+    EXPECT_EQ(1u, pool.idle());
+
+    std::shared_ptr<PooledShape> a = pool.acquire();
+    EXPECT_EQ(raw, a.get());
+    EXPECT_EQ(0, a->tag);
+    EXPECT_EQ(2, PooledShape::created);
+}
+
+TEST(UtilRviz, multiShapePoolOutlivedByInstances) {
+    std::shared_ptr<PooledShape> a;
+    {
+        rviz::MultiShapePool<PooledShape> pool(nullptr);
+        a = pool.acquire();
+    }
+    // Released without the pool, which must not crash
+    a.reset();
+}
+
+TEST(UtilRviz, multiShapeSkipsUnchangedState) {
+    using namespace util_rviz;
+    rviz::SimpleCar car(sceneManager());
+    car.setChangeEpsilon(0.01f);
+    car.setPosition(Ogre::Vector3(1, 2, 3));
+    car.setOrientation(Ogre::Quaternion(0, 0, 0, 1));
+    car.setScale(Ogre::Vector3(2, 2, 2));
+    car.setColor(Ogre::ColourValue(1, 0, 0, 1));
+    EXPECT_EQ(rviz::MultiShape::DirtyPosition | rviz::MultiShape::DirtyOrientation | rviz::MultiShape::DirtyScale |
+                  rviz::MultiShape::DirtyColor,
+              car.dirtyFlags());
+    car.clearDirtyFlags();
+    const uint32_t revision = car.revision();
+
+    // Within the epsilon, nothing is applied
+    const stats::Snapshot before = stats::snapshot();
+    car.setPosition(Ogre::Vector3(1.005f, 2, 3));
+    car.setOrientation(Ogre::Quaternion(0, 0, 0.005f, 1));
+    car.setScale(Ogre::Vector3(2, 2.005f, 2));
+    car.setColor(Ogre::ColourValue(1, 0.005f, 0, 1));
+    const stats::Snapshot after = stats::snapshot();
+    EXPECT_EQ(0u, car.dirtyFlags());
+    EXPECT_EQ(revision, car.revision());
+    EXPECT_EQ(Ogre::Vector3(1, 2, 3), car.getPosition());
+    EXPECT_EQ(Ogre::Quaternion(0, 0, 0, 1), car.getOrientation());
+    EXPECT_EQ(Ogre::Vector3(2, 2, 2), car.getRootNode()->getScale());
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), *car.getColor());
+    EXPECT_EQ(1u, after.counters[stats::ColorSkipped] - before.counters[stats::ColorSkipped]);
+    EXPECT_EQ(0u, after.counters[stats::ColorApplied] - before.counters[stats::ColorApplied]);
+
+    // The same color applied partly is a change
+    car.setColorPartly(Ogre::ColourValue(1, 0, 0, 1));
+    EXPECT_EQ(rviz::MultiShape::DirtyColor, car.dirtyFlags());
+    car.setPosition(Ogre::Vector3(1.02f, 2, 3));
+    EXPECT_EQ(rviz::MultiShape::DirtyColor | rviz::MultiShape::DirtyPosition, car.dirtyFlags());
+    EXPECT_EQ(revision + 2, car.revision());
+
+    car.clearDirtyFlags();
+    car.reset();
+    EXPECT_EQ(rviz::MultiShape::DirtyAll, car.dirtyFlags());
+    EXPECT_GT(car.revision(), revision + 2);
+    EXPECT_EQ(Ogre::Vector3::ZERO, car.getPosition());
+    EXPECT_FALSE(car.getColor());
+    EXPECT_FALSE(car.isVisible());
+}
+
+TEST(UtilRviz, forEachAccessorsMatchGetters) {
+    auto expectSame = [](rviz::MultiShape& object) {
+        std::vector<Ogre::Entity*> entities;
+        object.forEachEntity([&entities](Ogre::Entity* e) { entities.push_back(e); });
+        EXPECT_EQ(object.getEntities(), entities);
+
+        std::vector<Ogre::Material*> materials;
+        object.forEachMaterial([&materials](const Ogre::MaterialPtr& m) { materials.push_back(m.get()); });
+        std::vector<Ogre::Material*> expected;
+        for (const auto& m : object.getMaterials()) {
+            expected.push_back(m.get());
+        }
+        EXPECT_EQ(expected, materials);
+
+        std::vector<rviz::Shape::Type> types;
+        object.forEachType([&types](rviz::Shape::Type t) { types.push_back(t); });
+        EXPECT_EQ(object.getTypes(), types);
+        EXPECT_EQ(entities.size(), types.size());
+    };
+
+    for (bool baked : {false, true}) {
+        for (rviz::Archetype archetype :
+             {rviz::Archetype::Car, rviz::Archetype::Bike, rviz::Archetype::Pedestrian, rviz::Archetype::Unknown}) {
+            std::unique_ptr<rviz::MultiShape> object = rviz::createArchetype(archetype, sceneManager(), NULL, baked);
+            SCOPED_TRACE(std::string(object->archetypeName()) + (baked ? " baked" : ""));
+            EXPECT_FALSE(object->getEntities().empty());
+            expectSame(*object);
+            // With the box of the reduced level of detail
+            object->setLodLevel(rviz::MultiShape::LodBox);
+            expectSame(*object);
+        }
+    }
+}
+
+TEST(UtilRviz, materialCacheSharesQuantisedColors) {
+    sceneManager(); // Sets up the material manager
+    rviz::MaterialCache cache;
+    // Both quantise to (255, 0, 0, 255)
+    rviz::MaterialCache::Handle red = cache.get(Ogre::ColourValue(1, 0, 0, 1));
+    rviz::MaterialCache::Handle almostRed = cache.get(Ogre::ColourValue(0.999f, 0.001f, 0, 1));
+    EXPECT_EQ(red, almostRed);
+    EXPECT_EQ(1u, cache.size());
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), diffuse(red->material()));
+
+    rviz::MaterialCache::Handle blue = cache.get(Ogre::ColourValue(0, 0, 1, 0.5));
+    EXPECT_NE(red->material().get(), blue->material().get());
+    EXPECT_EQ(2u, cache.size());
+
+    // The material is removed with the last handle
+    const std::string name = blue->material()->getName();
+    EXPECT_TRUE(Ogre::MaterialManager::getSingleton().resourceExists(name));
+    blue.reset();
+    EXPECT_EQ(1u, cache.size());
+    EXPECT_FALSE(Ogre::MaterialManager::getSingleton().resourceExists(name));
+    almostRed.reset();
+    EXPECT_EQ(1u, cache.size());
+    red.reset();
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(UtilRviz, materialCacheMapsNaNToZero) {
+    sceneManager();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_EQ(0x000000ffu, rviz::MaterialCache::key(Ogre::ColourValue(nan, nan, nan, 1)));
+    EXPECT_EQ(0x00800000u, rviz::MaterialCache::key(Ogre::ColourValue(nan, 0.5f, 0, nan)));
+    // Out of range channels are clamped
+    EXPECT_EQ(0xff0000ffu, rviz::MaterialCache::key(Ogre::ColourValue(2, -1, 0, 1)));
+
+    rviz::MaterialCache cache;
+    rviz::MaterialCache::Handle black = cache.get(Ogre::ColourValue(0, 0, 0, 1));
+    EXPECT_EQ(black, cache.get(Ogre::ColourValue(nan, 0, nan, 1)));
+    EXPECT_EQ(Ogre::ColourValue(0, 0, 0, 1), diffuse(black->material()));
+
+    // Handles may outlive the cache
+    {
+        rviz::MaterialCache other;
+        black = other.get(Ogre::ColourValue(0, 0, 0, 1));
+    }
+    black.reset();
+}
+
+// Compares the descriptions of an archetype and the shapes of an instance to the primitives the archetype was built
+// from before it was described by a descriptor
+template <typename ArchetypeT>
+void expectPrimitives(const std::vector<rviz::ShapeDescription>& expected) {
+    const rviz::shape_description_vector& descriptions = ArchetypeT::descriptions();
+    ASSERT_EQ(expected.size(), descriptions.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].type, descriptions[i].type) << i;
+        EXPECT_TRUE(expected[i].scale.positionEquals(descriptions[i].scale, 1e-5)) << i;
+        EXPECT_TRUE(expected[i].position.positionEquals(descriptions[i].position, 1e-5)) << i;
+        EXPECT_TRUE(expected[i].offset.positionEquals(descriptions[i].offset, 1e-5)) << i;
+        EXPECT_TRUE(expected[i].orientation.equals(descriptions[i].orientation, Ogre::Radian(1e-3))) << i;
+        EXPECT_EQ(expected[i].group, descriptions[i].group) << i;
+    }
+
+    ArchetypeT object(sceneManager());
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    object.setColor(red);
+    std::vector<rviz::Shape::Type> types;
+    for (const auto& e : expected) {
+        types.push_back(e.type);
+    }
+    EXPECT_EQ(types, object.getTypes());
+    const rviz::shape_vector& shapes = *object.getShapes();
+    ASSERT_EQ(expected.size(), shapes.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_TRUE(expected[i].position.positionEquals(shapes[i]->getPosition(), 1e-5)) << i;
+        EXPECT_EQ(red, diffuse(shapes[i]->getMaterial())) << i;
+    }
+}
+
+const Ogre::Quaternion uprightCorpus(std::sqrt(0.5), std::sqrt(0.5), 0, 0);
+
+TEST(UtilRviz, carReproducesPrimitives) {
+    using rviz::ShapeDescription;
+    const Ogre::Vector3 wheelScale(0.8, 0.4, 0.8);
+    const Ogre::Vector3 wheelPosition(0, 0, 0.4);
+    expectPrimitives<rviz::SimpleCar>({
+        {rviz::Shape::Cylinder,
+         wheelScale,
+         wheelPosition,
+         {1.4 / 0.8, -0.9 / 0.4, 0},
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Black},
+        {rviz::Shape::Cylinder,
+         wheelScale,
+         wheelPosition,
+         {1.4 / 0.8, 0.9 / 0.4, 0},
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Black},
+        {rviz::Shape::Cylinder,
+         wheelScale,
+         wheelPosition,
+         {-1.4 / 0.8, -0.9 / 0.4, 0},
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Black},
+        {rviz::Shape::Cylinder,
+         wheelScale,
+         wheelPosition,
+         {-1.4 / 0.8, 0.9 / 0.4, 0},
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Black},
+        {rviz::Shape::Cylinder,
+         {4, 1.8, 0.8},
+         {0, 0, 0.8},
+         Ogre::Vector3::ZERO,
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Colored},
+        {rviz::Shape::Cube,
+         {2, 1.8, 0.8},
+         {0, 0, 1.6},
+         Ogre::Vector3::ZERO,
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Colored},
+    });
+
+    // Only the body is colored partly
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    rviz::SimpleCar car(sceneManager());
+    car.setColorPartly(red);
+    const rviz::shape_vector& shapes = *car.getShapes();
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        EXPECT_EQ(i < 4 ? Ogre::ColourValue(0, 0, 0, 1) : red, diffuse(shapes[i]->getMaterial())) << i;
+    }
+}
+
+TEST(UtilRviz, bikeReproducesPrimitives) {
+    using rviz::ShapeDescription;
+    const Ogre::Vector3 wheelScale(1.4, 0.7, 1.4);
+    const Ogre::Vector3 wheelPosition(0, 0, 0.7);
+    expectPrimitives<rviz::SimpleBike>({
+        {rviz::Shape::Cylinder,
+         {3, 0.6, 0.8},
+         {0, 0, 1.1},
+         Ogre::Vector3::ZERO,
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Colored},
+        {rviz::Shape::Cylinder,
+         wheelScale,
+         wheelPosition,
+         {1, 0, 0},
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Black},
+        {rviz::Shape::Cylinder,
+         wheelScale,
+         wheelPosition,
+         {-1, 0, 0},
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Black},
+        {rviz::Shape::Cylinder,
+         {0.7, 1.6, 0.7},
+         {0, 0, 0.8},
+         Ogre::Vector3::ZERO,
+         uprightCorpus,
+         ShapeDescription::Colored},
+        {rviz::Shape::Sphere,
+         {0.7, 0.7, 0.7},
+         {0, 0, 1.95},
+         Ogre::Vector3::ZERO,
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Colored},
+    });
+}
+
+TEST(UtilRviz, pedestrianReproducesPrimitives) {
+    using rviz::ShapeDescription;
+    expectPrimitives<rviz::SimplePedestrian>({
+        {rviz::Shape::Cylinder,
+         {0.7, 1.6, 0.7},
+         {0, 0, 0.8},
+         Ogre::Vector3::ZERO,
+         uprightCorpus,
+         ShapeDescription::Colored},
+        {rviz::Shape::Sphere,
+         {0.7, 0.7, 0.7},
+         {0, 0, 1.95},
+         Ogre::Vector3::ZERO,
+         Ogre::Quaternion::IDENTITY,
+         ShapeDescription::Colored},
+    });
+}
+
+TEST(UtilRviz, unknownReproducesPrimitives) {
+    using rviz::ShapeDescription;
+    expectPrimitives<rviz::SimpleUnknown>({{rviz::Shape::Cube,
+                                            {1, 1, 1},
+                                            {0, 0, 0.5},
+                                            Ogre::Vector3::ZERO,
+                                            Ogre::Quaternion::IDENTITY,
+                                            ShapeDescription::Colored}});
+}
+
+// A downstream car with a spare wheel on its back
+class SpareWheelCar : public rviz::SimpleCar {
+public:
+    explicit SpareWheelCar(Ogre::SceneManager* scene_manager) : SimpleCar(scene_manager) {
+        auto spare = std::make_shared<rviz::Shape>(rviz::Shape::Cylinder, scene_manager_, scene_node_);
+        spare->setPosition(Ogre::Vector3(-2.1, 0, 0.8));
+        blackShapes_.push_back(spare);
+        renewShapesVec();
+    }
+};
+
+TEST(UtilRviz, renewShapesVecKeepsShapesOfSubclasses) {
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    SpareWheelCar car(sceneManager());
+    const rviz::shape_vector& shapes = *car.getShapes();
+    ASSERT_EQ(7u, shapes.size());
+    EXPECT_EQ(7u, car.getEntities().size());
+    EXPECT_TRUE(Ogre::Vector3(-2.1, 0, 0.8).positionEquals(shapes[4]->getPosition()));
+
+    // The spare wheel is colored like the other wheels
+    car.setColorPartly(red);
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        EXPECT_EQ(i < 5 ? Ogre::ColourValue(0, 0, 0, 1) : red, diffuse(shapes[i]->getMaterial())) << i;
+    }
+    car.setColor(red);
+    for (const auto& shape : shapes) {
+        EXPECT_EQ(red, diffuse(shape->getMaterial()));
+    }
+}
+
+TEST(UtilRviz, lazyObjectsMaterializeWhenShown) {
+    rviz::SimpleCar car(sceneManager(), NULL, false, true);
+    EXPECT_FALSE(car.isVisible());
+    EXPECT_FALSE(car.isMaterialized());
+    EXPECT_TRUE(car.getShapes()->empty());
+    EXPECT_TRUE(car.getEntities().empty());
+
+    // The state is recorded until the shapes exist
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    car.setColorPartly(red);
+    car.setPosition(Ogre::Vector3(1, 2, 3));
+    EXPECT_FALSE(car.isMaterialized());
+
+    car.visible(true);
+    EXPECT_TRUE(car.isMaterialized());
+    ASSERT_EQ(6u, car.getShapes()->size());
+    EXPECT_EQ(6u, car.getEntities().size());
+    EXPECT_EQ(Ogre::Vector3(1, 2, 3), car.getPosition());
+    EXPECT_EQ(red, diffuse(car.getShapes()->back()->getMaterial()));
+    EXPECT_EQ(Ogre::ColourValue(0, 0, 0, 1), diffuse(car.getShapes()->front()->getMaterial()));
+
+    // Hiding keeps the shapes until the object is dematerialized
+    car.visible(false);
+    EXPECT_TRUE(car.isMaterialized());
+    EXPECT_TRUE(car.dematerializeIfHidden(0.));
+    EXPECT_FALSE(car.isMaterialized());
+    EXPECT_TRUE(car.getEntities().empty());
+}
+
+TEST(UtilRviz, lodBoxOnlyCreatesTheBox) {
+    rviz::SimpleCar car(sceneManager(), NULL, false, true);
+    car.setLodLevel(rviz::MultiShape::LodBox);
+    car.visible(true);
+    EXPECT_FALSE(car.isMaterialized());
+    EXPECT_TRUE(car.getShapes()->empty());
+    EXPECT_EQ(std::vector<rviz::Shape::Type>{rviz::Shape::Cube}, car.getTypes());
+    EXPECT_EQ(1u, car.getEntities().size());
+
+    // Closer up, the parts are created and the box is hidden
+    car.setLodLevel(rviz::MultiShape::LodFull);
+    EXPECT_TRUE(car.isMaterialized());
+    EXPECT_EQ(6u, car.getShapes()->size());
+    const std::vector<Ogre::Entity*> entities = car.getEntities();
+    ASSERT_EQ(7u, entities.size());
+    for (size_t i = 0; i + 1 < entities.size(); ++i) {
+        EXPECT_TRUE(entities[i]->getVisible()) << i;
+    }
+    EXPECT_FALSE(entities.back()->getVisible());
+
+    // Dematerializing also removes the box
+    car.visible(false);
+    EXPECT_TRUE(car.dematerializeIfHidden(0.));
+    EXPECT_TRUE(car.getEntities().empty());
+    car.setLodLevel(rviz::MultiShape::LodBox);
+    car.visible(true);
+    EXPECT_FALSE(car.isMaterialized());
+    EXPECT_EQ(1u, car.getEntities().size());
+}
+
+TEST(UtilRviz, bakedArchetypesHaveOneSubmeshPerColorGroup) {
+    rviz::SimpleCar car(sceneManager(), NULL, true);
+    rviz::SimpleBike bike(sceneManager(), NULL, true);
+    rviz::SimplePedestrian pedestrian(sceneManager(), NULL, true);
+    rviz::SimpleUnknown unknown(sceneManager(), NULL, true);
+    // Cars and bikes have black wheels, pedestrians and unknown objects are colored only
+    const std::vector<std::pair<rviz::MultiShape*, size_t>> expected{
+        {&car, 2}, {&bike, 2}, {&pedestrian, 1}, {&unknown, 1}};
+    for (const auto& e : expected) {
+        rviz::MultiShape& object = *e.first;
+        EXPECT_TRUE(object.isBaked()) << object.archetypeName();
+        EXPECT_TRUE(object.getShapes()->empty()) << object.archetypeName();
+        const std::vector<Ogre::Entity*> entities = object.getEntities();
+        ASSERT_EQ(1u, entities.size()) << object.archetypeName();
+        EXPECT_EQ(e.second, entities[0]->getMesh()->getNumSubMeshes()) << object.archetypeName();
+        EXPECT_EQ(e.second, entities[0]->getNumSubEntities()) << object.archetypeName();
+        EXPECT_EQ(e.second, object.getMaterials().size()) << object.archetypeName();
+        EXPECT_EQ(std::vector<rviz::Shape::Type>{rviz::Shape::Mesh}, object.getTypes()) << object.archetypeName();
+    }
+
+    // The mesh is shared, the materials are not
+    rviz::SimpleCar other(sceneManager(), NULL, true);
+    EXPECT_EQ(car.getEntities()[0]->getMesh().get(), other.getEntities()[0]->getMesh().get());
+    EXPECT_NE(car.getMaterials()[0].get(), other.getMaterials()[0].get());
+}
+
+TEST(UtilRviz, bakedCarKeepsWheelsBlack) {
+    const Ogre::ColourValue black(0, 0, 0, 1);
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    rviz::SimpleCar car(sceneManager(), NULL, true);
+    // The submeshes are ordered by color group, the wheels come last
+    Ogre::Entity* entity = car.getEntities().at(0);
+    ASSERT_EQ(2u, entity->getNumSubEntities());
+    EXPECT_EQ(Ogre::ColourValue(1, 1, 1, 1), diffuse(entity->getSubEntity(0)->getMaterial()));
+    EXPECT_EQ(black, diffuse(entity->getSubEntity(1)->getMaterial()));
+
+    car.setColorPartly(red);
+    EXPECT_EQ(red, diffuse(entity->getSubEntity(0)->getMaterial()));
+    EXPECT_EQ(black, diffuse(entity->getSubEntity(1)->getMaterial()));
+
+    // Like the shapes of a car that is not baked, setColor() colors the wheels as well
+    const Ogre::ColourValue green(0, 1, 0, 1);
+    car.setColor(green);
+    EXPECT_EQ(green, diffuse(entity->getSubEntity(0)->getMaterial()));
+    EXPECT_EQ(green, diffuse(entity->getSubEntity(1)->getMaterial()));
+    rviz::SimpleCar shapes(sceneManager());
+    shapes.setColor(green);
+    for (const auto& shape : *shapes.getShapes()) {
+        EXPECT_EQ(green, diffuse(shape->getMaterial()));
+    }
+
+    // A transparent partial color keeps the wheels black, with the same alpha
+    car.setColorPartly(Ogre::ColourValue(1, 0, 0, 0.5));
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 0.5), diffuse(entity->getSubEntity(0)->getMaterial()));
+    EXPECT_EQ(Ogre::ColourValue(0, 0, 0, 0.5), diffuse(entity->getSubEntity(1)->getMaterial()));
+}
+
+TEST(UtilRviz, footprintRegistryTracksObjects) {
+    const size_t before = rviz::footprint::objectCount();
+    std::vector<std::unique_ptr<rviz::MultiShape>> objects;
+    for (int i = 0; i < 3; ++i) {
+        objects.emplace_back(new rviz::MultiShape(sceneManager()));
+    }
+    EXPECT_EQ(before + 3, rviz::footprint::objectCount());
+
+    // Removing from the middle moves the last object into the gap, which has to stay removable
+    objects.erase(objects.begin() + 1);
+    EXPECT_EQ(before + 2, rviz::footprint::objectCount());
+    rviz::footprint::unregisterObject(objects[0].get());
+    rviz::footprint::unregisterObject(objects[0].get()); // Unknown objects are ignored
+    EXPECT_EQ(before + 1, rviz::footprint::objectCount());
+    rviz::footprint::registerObject(objects[0].get());
+
+    const rviz::FootprintReport report = rviz::footprint::report();
+    EXPECT_EQ(before + 2, report.total.objects);
+    EXPECT_EQ(before + 2, report.archetypes.at("MultiShape").objects);
+    EXPECT_EQ(before + 2, report.total.sceneNodes);
+    EXPECT_GE(report.total.heapBytes, (before + 2) * sizeof(rviz::MultiShape));
+
+    objects.clear();
+    EXPECT_EQ(before, rviz::footprint::objectCount());
+}
+
+TEST(UtilRviz, updateSchedulerAppliesNearestFirst) {
+    // No budget, so only minPerFrame updates are applied per frame
+    rviz::SchedulerSettings settings;
+    settings.budget = 0.;
+    settings.minPerFrame = 8;
+    rviz::UpdateScheduler scheduler(settings);
+    std::vector<std::unique_ptr<rviz::MultiShape>> objects;
+    for (int i = 0; i < 12; ++i) {
+        objects.emplace_back(new rviz::MultiShape(sceneManager()));
+    }
+    // Distances 1 to 12 from the eye, scheduled in a mixed order
+    for (int i : {7, 2, 11, 0, 5, 9, 1, 10, 3, 8, 6, 4}) {
+        scheduler.setPosition(objects[i].get(), Ogre::Vector3(i + 1, 0, 0));
+    }
+
+    const auto& frame = scheduler.apply(Ogre::Vector3::ZERO);
+    EXPECT_EQ(8u, frame.applied);
+    EXPECT_EQ(0u, frame.overdue);
+    EXPECT_EQ(4u, frame.deferred);
+    EXPECT_EQ(4u, scheduler.pending());
+    for (int i = 0; i < 12; ++i) {
+        EXPECT_EQ(i < 8 ? Ogre::Vector3(i + 1, 0, 0) : Ogre::Vector3::ZERO, objects[i]->getPosition());
+    }
+    scheduler.apply(Ogre::Vector3::ZERO);
+    EXPECT_EQ(0u, scheduler.pending());
+    EXPECT_EQ(Ogre::Vector3(12, 0, 0), objects[11]->getPosition());
+}
+
+TEST(UtilRviz, updateSchedulerPrefersWaitingUpdates) {
+    rviz::SchedulerSettings settings;
+    settings.budget = 0.;
+    settings.minPerFrame = 8;
+    settings.ageScale = 0.01;
+    rviz::UpdateScheduler scheduler(settings);
+    std::vector<std::unique_ptr<rviz::MultiShape>> objects;
+    for (int i = 0; i < 16; ++i) {
+        objects.emplace_back(new rviz::MultiShape(sceneManager()));
+    }
+    // The far objects wait long enough to shrink their priority distance below the one of the near objects
+    for (int i = 8; i < 16; ++i) {
+        scheduler.setPosition(objects[i].get(), Ogre::Vector3(10, i, 0));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    for (int i = 0; i < 8; ++i) {
+        scheduler.setPosition(objects[i].get(), Ogre::Vector3(2, i, 0));
+    }
+
+    scheduler.apply(Ogre::Vector3(0, 4, 0));
+    for (int i = 0; i < 16; ++i) {
+        EXPECT_EQ(i >= 8, objects[i]->getPosition() != Ogre::Vector3::ZERO) << i;
+    }
+    EXPECT_GT(scheduler.lastFrame().maxAge, 0.);
+}
+
+TEST(UtilRviz, updateSchedulerAppliesOverdueUpdates) {
+    rviz::SchedulerSettings settings;
+    settings.budget = 0.;
+    settings.minPerFrame = 8;
+    settings.maxAge = 0.05;
+    rviz::UpdateScheduler scheduler(settings);
+    std::vector<std::unique_ptr<rviz::MultiShape>> objects;
+    for (int i = 0; i < 12; ++i) {
+        objects.emplace_back(new rviz::MultiShape(sceneManager()));
+        scheduler.setPosition(objects.back().get(), Ogre::Vector3(i + 1, 0, 0));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+
+    // All updates reached maxAge, so the budget does not hold them back
+    const auto& frame = scheduler.apply(Ogre::Vector3::ZERO);
+    EXPECT_EQ(12u, frame.applied);
+    EXPECT_EQ(12u, frame.overdue);
+    EXPECT_EQ(0u, frame.deferred);
+    EXPECT_EQ(0u, scheduler.pending());
+    EXPECT_EQ(Ogre::Vector3(12, 0, 0), objects[11]->getPosition());
+}
+
+TEST(UtilRviz, updateSchedulerRemoveAndMerge) {
+    rviz::UpdateScheduler scheduler;
+    rviz::MultiShape a(sceneManager()), b(sceneManager()), c(sceneManager());
+    scheduler.setPosition(&a, Ogre::Vector3(1, 0, 0));
+    scheduler.setPosition(&b, Ogre::Vector3(2, 0, 0));
+    scheduler.setPosition(&c, Ogre::Vector3(3, 0, 0));
+
+    // c moves into the gap of a, later writes to c must still find its update
+    scheduler.remove(&a);
+    scheduler.remove(&a);
+    EXPECT_EQ(2u, scheduler.pending());
+    scheduler.setPosition(&c, Ogre::Vector3(4, 0, 0));
+    EXPECT_EQ(2u, scheduler.pending());
+
+    // A full color replaces an earlier partial one, a partial color is applied after an earlier full one
+    scheduler.setColorPartly(&b, Ogre::ColourValue(0, 1, 0, 1));
+    scheduler.setColor(&b, Ogre::ColourValue(1, 0, 0, 1));
+    rviz::ShapeUpdate update = rviz::ShapeUpdate::none();
+    update.setColor(Ogre::ColourValue(1, 0, 0, 1));
+    update.setColorPartly(Ogre::ColourValue(0, 0, 1, 1));
+    scheduler.schedule(&c, update);
+
+    scheduler.flush();
+    EXPECT_EQ(0u, scheduler.pending());
+    EXPECT_EQ(Ogre::Vector3::ZERO, a.getPosition());
+    EXPECT_EQ(Ogre::Vector3(2, 0, 0), b.getPosition());
+    EXPECT_EQ(Ogre::Vector3(4, 0, 0), c.getPosition());
+    ASSERT_TRUE(b.getColor());
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), *b.getColor());
+    // Not a car, so the partial color covers everything
+    ASSERT_TRUE(c.getColor());
+    EXPECT_EQ(Ogre::ColourValue(0, 0, 1, 1), *c.getColor());
+}
+
+TEST(UtilRviz, spatialIndexQueries) {
+    rviz::SpatialIndex index(10.f);
+    rviz::MultiShape a(sceneManager()), b(sceneManager()), c(sceneManager());
+    a.setPosition(Ogre::Vector3(5, 5, 0));
+    b.setPosition(Ogre::Vector3(-25, -5, 0)); // Negative cells
+    c.setPosition(Ogre::Vector3(100, 100, 0));
+    index.insert(&a, 1.f);
+    index.insert(&b, 1.f);
+    index.insert(&c, 15.f);
+    EXPECT_EQ(3u, index.size());
+
+    std::vector<rviz::MultiShape*> result;
+    index.queryRegion(Ogre::Vector2(-30, -10), Ogre::Vector2(10, 10), result);
+    EXPECT_EQ(sorted({&a, &b}), sorted(result));
+    // c only reaches into the region by its radius
+    result.clear();
+    index.queryRegion(Ogre::Vector2(80, 80), Ogre::Vector2(86, 86), result);
+    EXPECT_EQ(std::vector<rviz::MultiShape*>{&c}, result);
+
+    // Moving across cells is only noticed after an update
+    a.setPosition(Ogre::Vector3(-45, -45, 0));
+    index.update(&a);
+    result.clear();
+    index.queryRegion(Ogre::Vector2(-50, -50), Ogre::Vector2(-40, -40), result);
+    EXPECT_EQ(std::vector<rviz::MultiShape*>{&a}, result);
+
+    index.remove(&a);
+    EXPECT_EQ(2u, index.size());
+    result.clear();
+    index.queryRegion(Ogre::Vector2(-1000, -1000), Ogre::Vector2(1000, 1000), result);
+    EXPECT_EQ(sorted({&b, &c}), sorted(result));
+    // b took the place of a, it still has to be found in its cell
+    b.setPosition(Ogre::Vector3(55, 55, 0));
+    index.updateAll();
+    result.clear();
+    index.queryRegion(Ogre::Vector2(50, 50), Ogre::Vector2(60, 60), result);
+    EXPECT_EQ(std::vector<rviz::MultiShape*>{&b}, result);
+}
+
+TEST(UtilRviz, spatialIndexShrinksQueryRadius) {
+    rviz::SpatialIndex index(10.f);
+    rviz::MultiShape a(sceneManager()), b(sceneManager()), c(sceneManager());
+    index.insert(&a, 1.f);
+    index.insert(&b, 50.f);
+    index.insert(&c, 50.f);
+    EXPECT_FLOAT_EQ(50.f, index.maxRadius());
+
+    // Only shrinks once no object of the largest radius is left
+    index.remove(&b);
+    EXPECT_FLOAT_EQ(50.f, index.maxRadius());
+    index.remove(&c);
+    EXPECT_FLOAT_EQ(1.f, index.maxRadius());
+
+    // Inserting again replaces the radius
+    index.insert(&b, 2.f);
+    EXPECT_FLOAT_EQ(2.f, index.maxRadius());
+    index.insert(&b, 0.5f);
+    EXPECT_FLOAT_EQ(1.f, index.maxRadius());
+    index.remove(&a);
+    index.remove(&b);
+    EXPECT_FLOAT_EQ(0.f, index.maxRadius());
+    index.insert(&c, 3.f);
+    EXPECT_FLOAT_EQ(3.f, index.maxRadius());
+    index.clear();
+    EXPECT_FLOAT_EQ(0.f, index.maxRadius());
+}
+
+TEST(UtilRviz, poseBufferInterpolates) {
+    util_rviz::PoseBuffer<4> buffer;
+    Ogre::Vector3 p;
+    Ogre::Quaternion q;
+    EXPECT_FALSE(buffer.sample(ros::Time(1.0), ros::Duration(0.5), p, q));
+
+    const Ogre::Quaternion quarter(std::sqrt(0.5f), 0, 0, std::sqrt(0.5f)); // 90 degrees about z
+    EXPECT_TRUE(buffer.push(ros::Time(1.0), Ogre::Vector3(0, 0, 0), Ogre::Quaternion::IDENTITY));
+    EXPECT_TRUE(buffer.push(ros::Time(2.0), Ogre::Vector3(10, 0, 0), quarter));
+
+    ASSERT_TRUE(buffer.sample(ros::Time(1.5), ros::Duration(0.5), p, q));
+    EXPECT_NEAR(5.f, p.x, 1e-4);
+    EXPECT_NEAR(std::cos(M_PI / 8), q.w, 1e-4); // Half way, 45 degrees
+    EXPECT_NEAR(std::sin(M_PI / 8), q.z, 1e-4);
+
+    // Before the oldest pose, the oldest pose is held
+    ASSERT_TRUE(buffer.sample(ros::Time(0.5), ros::Duration(0.5), p, q));
+    EXPECT_EQ(Ogre::Vector3(0, 0, 0), p);
+}
+
+TEST(UtilRviz, poseBufferLimitsExtrapolation) {
+    util_rviz::PoseBuffer<4> buffer;
+    buffer.push(ros::Time(1.0), Ogre::Vector3(0, 0, 0), Ogre::Quaternion::IDENTITY);
+    buffer.push(ros::Time(2.0), Ogre::Vector3(10, 0, 0), Ogre::Quaternion::IDENTITY);
+    Ogre::Vector3 p;
+    Ogre::Quaternion q;
+    ASSERT_TRUE(buffer.sample(ros::Time(2.2), ros::Duration(0.5), p, q));
+    EXPECT_NEAR(12.f, p.x, 1e-4);
+    // Held after maxExtrapolation
+    ASSERT_TRUE(buffer.sample(ros::Time(5.0), ros::Duration(0.5), p, q));
+    EXPECT_NEAR(15.f, p.x, 1e-4);
+}
+
+TEST(UtilRviz, poseBufferRejectsInvalidPoses) {
+    util_rviz::PoseBuffer<4> buffer;
+    const float inf = std::numeric_limits<float>::infinity();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_FALSE(buffer.push(ros::Time(1.0), Ogre::Vector3(inf, 0, 0), Ogre::Quaternion::IDENTITY));
+    EXPECT_FALSE(buffer.push(ros::Time(1.0), Ogre::Vector3(0, 0, 0), Ogre::Quaternion(nan, 0, 0, 0)));
+    EXPECT_FALSE(buffer.push(ros::Time(1.0), Ogre::Vector3(0, 0, 0), Ogre::Quaternion(-inf, 0, 0, 0)));
+    EXPECT_TRUE(buffer.empty());
+
+    EXPECT_TRUE(buffer.push(ros::Time(2.0), Ogre::Vector3(1, 0, 0), Ogre::Quaternion::IDENTITY));
+    // Out of order
+    EXPECT_FALSE(buffer.push(ros::Time(1.0), Ogre::Vector3(2, 0, 0), Ogre::Quaternion::IDENTITY));
+    // Same stamp replaces the latest pose
+    EXPECT_TRUE(buffer.push(ros::Time(2.0), Ogre::Vector3(3, 0, 0), Ogre::Quaternion::IDENTITY));
+    EXPECT_EQ(1u, buffer.size());
+    EXPECT_EQ(Ogre::Vector3(3, 0, 0), buffer.latest().position);
+}
+
+TEST(UtilRviz, poseBufferEvictsOldest) {
+    util_rviz::PoseBuffer<3> buffer;
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_TRUE(buffer.push(ros::Time(i + 1.0), Ogre::Vector3(i, 0, 0), Ogre::Quaternion::IDENTITY));
+    }
+    EXPECT_EQ(3u, buffer.size());
+    EXPECT_EQ(Ogre::Vector3(4, 0, 0), buffer.latest().position);
+    // The oldest remaining pose is the third one
+    Ogre::Vector3 p;
+    Ogre::Quaternion q;
+    ASSERT_TRUE(buffer.sample(ros::Time(1.0), ros::Duration(0.5), p, q));
+    EXPECT_EQ(Ogre::Vector3(2, 0, 0), p);
+}
+
+TEST(UtilRviz, agentSceneSlotsSurviveRemoval) {
+    rviz::AgentScene scene(nullptr);
+    const auto a = scene.add(10, rviz::Archetype::Car);
+    const auto b = scene.add(20, rviz::Archetype::Bike);
+    const auto c = scene.add(30, rviz::Archetype::Pedestrian);
+    scene.setPosition(a, Ogre::Vector3(1, 0, 0));
+    scene.setPosition(b, Ogre::Vector3(2, 0, 0));
+    scene.setPosition(c, Ogre::Vector3(3, 0, 0));
+
+    // The last agent fills the gap, its slot keeps pointing at it
+    scene.remove(a);
+    EXPECT_EQ(2u, scene.size());
+    EXPECT_EQ(0u, scene.index(c));
+    EXPECT_EQ(c, scene.slot(0));
+    EXPECT_EQ(30u, scene.ids()[scene.index(c)]);
+    EXPECT_EQ(rviz::Archetype::Pedestrian, scene.archetypes()[scene.index(c)]);
+    EXPECT_EQ(Ogre::Vector3(3, 0, 0), scene.positions()[scene.index(c)]);
+    EXPECT_EQ(Ogre::Vector3(2, 0, 0), scene.positions()[scene.index(b)]);
+
+    // Freed slots are reused
+    const auto d = scene.add(40, rviz::Archetype::Unknown);
+    EXPECT_EQ(a, d);
+    EXPECT_EQ(3u, scene.size());
+    EXPECT_EQ(40u, scene.ids()[scene.index(d)]);
+    EXPECT_EQ(Ogre::Vector3(0, 0, 0), scene.positions()[scene.index(d)]);
+
+    EXPECT_TRUE(scene.remove(d));
+    EXPECT_TRUE(scene.remove(b));
+    EXPECT_EQ(1u, scene.size());
+    EXPECT_EQ(30u, scene.ids()[scene.index(c)]);
+
+    // Stale and unknown slots are rejected without touching the remaining agents
+    EXPECT_FALSE(scene.contains(b));
+    EXPECT_FALSE(scene.remove(b));
+    EXPECT_FALSE(scene.remove(42));
+    EXPECT_TRUE(scene.contains(c));
+    EXPECT_EQ(1u, scene.size());
+    EXPECT_EQ(0u, scene.index(c));
+    EXPECT_EQ(30u, scene.ids()[scene.index(c)]);
+}
+
+TEST(UtilRviz, trailSetSamplesByDistanceAndTime) {
+    rviz::TrailSettings settings;
+    settings.length = 10;
+    settings.minDistance = 1.f;
+    settings.minInterval = 1.;
+    rviz::TrailSet trails(sceneManager(), NULL, 4, settings);
+    rviz::SimpleUnknown object(sceneManager());
+    ASSERT_TRUE(trails.add(&object));
+    const Ogre::BillboardChain* chain = trails.getBillboardChain();
+    const size_t index = trails.chainIndex(&object);
+    ASSERT_NE(rviz::TrailSet::NoTrail, index);
+
+    // The first update always adds a point
+    trails.update(ros::Time(10.));
+    EXPECT_EQ(1u, chain->getNumChainElements(index));
+
+    // Neither far enough nor long enough
+    object.setPosition(Ogre::Vector3(0.5, 0, 0));
+    trails.update(ros::Time(10.1));
+    EXPECT_EQ(1u, chain->getNumChainElements(index));
+
+    // Far enough from the last point
+    object.setPosition(Ogre::Vector3(1.5, 0, 0));
+    trails.update(ros::Time(10.2));
+    ASSERT_EQ(2u, chain->getNumChainElements(index));
+    EXPECT_EQ(Ogre::Vector3(1.5, 0, 0), chain->getChainElement(index, 0).position);
+
+    // Standing still, only time adds points
+    trails.update(ros::Time(11.));
+    EXPECT_EQ(2u, chain->getNumChainElements(index));
+    trails.update(ros::Time(11.2));
+    EXPECT_EQ(3u, chain->getNumChainElements(index));
+
+    // The oldest points are dropped
+    for (int i = 0; i < 20; ++i) {
+        object.setPosition(Ogre::Vector3(2. * i, 0, 0));
+        trails.update(ros::Time(12. + i * 0.01));
+    }
+    EXPECT_EQ(settings.length, chain->getNumChainElements(index));
+    EXPECT_EQ(Ogre::Vector3(38, 0, 0), chain->getChainElement(index, 0).position);
+}
+
+TEST(UtilRviz, trailSetReusesChainsOfRemovedTrails) {
+    rviz::TrailSet trails(sceneManager(), NULL, 1);
+    rviz::SimpleUnknown first(sceneManager());
+    rviz::SimpleUnknown second(sceneManager());
+    ASSERT_TRUE(trails.add(&first));
+    EXPECT_FALSE(trails.add(&second));
+    const size_t index = trails.chainIndex(&first);
+    trails.update(ros::Time(1.));
+    EXPECT_EQ(1u, trails.getBillboardChain()->getNumChainElements(index));
+
+    trails.remove(&first);
+    EXPECT_EQ(rviz::TrailSet::NoTrail, trails.chainIndex(&first));
+    EXPECT_EQ(0u, trails.size());
+    ASSERT_TRUE(trails.add(&second));
+    EXPECT_EQ(index, trails.chainIndex(&second));
+    // The points of the removed trail are gone
+    EXPECT_EQ(0u, trails.getBillboardChain()->getNumChainElements(index));
+    EXPECT_EQ(1u, trails.size());
+}
+
+TEST(UtilRviz, trailSetFollowsColorChanges) {
+    const Ogre::ColourValue red(1, 0, 0, 1);
+    const Ogre::ColourValue green(0, 1, 0, 1);
+    rviz::TrailSet trails(sceneManager());
+    rviz::SimpleUnknown object(sceneManager());
+    trails.add(&object);
+    const Ogre::BillboardChain* chain = trails.getBillboardChain();
+    const size_t index = trails.chainIndex(&object);
+
+    // White until a color is set
+    trails.update(ros::Time(1.));
+    EXPECT_EQ(Ogre::ColourValue::White, chain->getChainElement(index, 0).colour);
+    object.setColor(red);
+    object.setPosition(Ogre::Vector3(10, 0, 0));
+    trails.update(ros::Time(2.));
+    ASSERT_EQ(2u, chain->getNumChainElements(index));
+    EXPECT_EQ(red, chain->getChainElement(index, 0).colour);
+    EXPECT_EQ(red, chain->getChainElement(index, 1).colour);
+
+    // Recoloring does not add a point
+    object.setColor(green);
+    trails.update(ros::Time(2.01));
+    ASSERT_EQ(2u, chain->getNumChainElements(index));
+    EXPECT_EQ(green, chain->getChainElement(index, 0).colour);
+    EXPECT_EQ(green, chain->getChainElement(index, 1).colour);
+}
+
+TEST(UtilRviz, staticBatcherBatchesStationaryObjects) {
+    rviz::StaticBatchSettings settings;
+    settings.stationaryTime = 5.;
+    rviz::StaticBatcher batcher(sceneManager(), settings);
+    rviz::SimpleCar car(sceneManager());
+    rviz::SimpleCar hinted(sceneManager());
+    Ogre::SceneNode* root = sceneManager()->getRootSceneNode();
+    batcher.add(&car);
+    batcher.add(&hinted);
+    batcher.setStationary(&hinted);
+
+    batcher.update(ros::Time(1.));
+    EXPECT_FALSE(batcher.isBatched(&car));
+    EXPECT_TRUE(batcher.isBatched(&hinted));
+    EXPECT_EQ(NULL, hinted.getRootNode()->getParentSceneNode());
+    batcher.update(ros::Time(6.));
+    EXPECT_TRUE(batcher.isBatched(&car));
+    EXPECT_EQ(2u, batcher.batchedCount());
+
+    // Changes attach the object again
+    car.setPosition(Ogre::Vector3(1, 0, 0));
+    batcher.update(ros::Time(7.));
+    EXPECT_FALSE(batcher.isBatched(&car));
+    EXPECT_EQ(root, car.getRootNode()->getParentSceneNode());
+    EXPECT_EQ(1u, batcher.batchedCount());
+
+    batcher.remove(&hinted);
+    EXPECT_EQ(root, hinted.getRootNode()->getParentSceneNode());
+    EXPECT_EQ(1u, batcher.size());
+    EXPECT_EQ(0u, batcher.batchedCount());
+}
+
+TEST(UtilRviz, destroyedObjectsAreDropped) {
+    rviz::StaticBatcher batcher(sceneManager());
+    rviz::TrailSet trails(sceneManager());
+    rviz::UpdateScheduler scheduler;
+    rviz::PickingIndex picking;
+    rviz::SimpleCar survivor(sceneManager());
+    {
+        rviz::SimpleCar car(sceneManager());
+        for (rviz::MultiShape* obj : {static_cast<rviz::MultiShape*>(&car), static_cast<rviz::MultiShape*>(&survivor)}) {
+            batcher.add(obj);
+            batcher.setStationary(obj);
+            trails.add(obj);
+            scheduler.setPosition(obj, Ogre::Vector3(1, 2, 3));
+            picking.insert(obj);
+        }
+        batcher.update(ros::Time(1.));
+        EXPECT_EQ(2u, batcher.batchedCount());
+    }
+    EXPECT_EQ(1u, batcher.size());
+    EXPECT_EQ(1u, batcher.batchedCount());
+    EXPECT_TRUE(batcher.isBatched(&survivor));
+    EXPECT_EQ(1u, trails.size());
+    EXPECT_EQ(1u, scheduler.pending());
+    EXPECT_EQ(1u, picking.size());
+
+    // Nothing refers to the destroyed object anymore
+    trails.update(ros::Time(2.));
+    picking.updateAll(true);
+    scheduler.flush();
+    EXPECT_EQ(Ogre::Vector3(1, 2, 3), survivor.getPosition());
+    batcher.update(ros::Time(2.));
+    EXPECT_FALSE(batcher.isBatched(&survivor));
+}
+
+TEST(UtilRviz, pickingRaycastReportsNearestHitFirst) {
+    rviz::PickingIndex picking;
+    rviz::SimpleCar near(sceneManager()), far(sceneManager());
+    near.setPosition(Ogre::Vector3(10, 0, 0));
+    far.setPosition(Ogre::Vector3(30, 0, 0));
+    picking.insert(&far);
+    picking.insert(&near);
+    // Rays at the height of the center of the cars
+    const float z = near.getLocalBounds().getCenter().z;
+
+    rviz::PickingIndex::Hit hit;
+    ASSERT_TRUE(picking.raycast(Ogre::Ray(Ogre::Vector3(-50, 0, z), Ogre::Vector3::UNIT_X), hit));
+    EXPECT_EQ(&near, hit.obj);
+    EXPECT_EQ(&near.getUserData(), hit.userData);
+    EXPECT_GT(hit.distance, 50.f);
+    EXPECT_LT(hit.distance, 60.f);
+    ASSERT_TRUE(picking.raycast(Ogre::Ray(Ogre::Vector3(50, 0, z), Ogre::Vector3::NEGATIVE_UNIT_X), hit));
+    EXPECT_EQ(&far, hit.obj);
+
+    std::vector<rviz::PickingIndex::Hit> hits;
+    picking.raycastAll(Ogre::Ray(Ogre::Vector3(-50, 0, z), Ogre::Vector3::UNIT_X), hits);
+    ASSERT_EQ(2u, hits.size());
+    EXPECT_EQ(&near, hits[0].obj);
+    EXPECT_EQ(&far, hits[1].obj);
+    EXPECT_LT(hits[0].distance, hits[1].distance);
+
+    // Hidden objects are skipped
+    near.visible(false);
+    ASSERT_TRUE(picking.raycast(Ogre::Ray(Ogre::Vector3(-50, 0, z), Ogre::Vector3::UNIT_X), hit));
+    EXPECT_EQ(&far, hit.obj);
+}
+
+TEST(UtilRviz, pickingRaycastMisses) {
+    rviz::PickingIndex picking;
+    rviz::SimpleCar car(sceneManager());
+    car.setPosition(Ogre::Vector3(10, 0, 0));
+    picking.insert(&car);
+    const float z = car.getLocalBounds().getCenter().z;
+
+    rviz::PickingIndex::Hit hit;
+    std::vector<rviz::PickingIndex::Hit> hits;
+    // Passing beside, pointing away and out of reach
+    EXPECT_FALSE(picking.raycast(Ogre::Ray(Ogre::Vector3(-50, 50, z), Ogre::Vector3::UNIT_X), hit));
+    EXPECT_FALSE(picking.raycast(Ogre::Ray(Ogre::Vector3(-50, 0, z), Ogre::Vector3::NEGATIVE_UNIT_X), hit));
+    EXPECT_FALSE(picking.raycast(Ogre::Ray(Ogre::Vector3(-50, 0, z), Ogre::Vector3::UNIT_X), hit, 30.f));
+    picking.raycastAll(Ogre::Ray(Ogre::Vector3(-50, 50, z), Ogre::Vector3::UNIT_X), hits);
+    picking.raycastAll(Ogre::Ray(Ogre::Vector3(-50, 0, z), Ogre::Vector3::UNIT_X), hits, 30.f);
+    EXPECT_TRUE(hits.empty());
+
+    // The index follows moved objects
+    car.setPosition(Ogre::Vector3(10, 50, 0));
+    picking.update(&car);
+    EXPECT_TRUE(picking.raycast(Ogre::Ray(Ogre::Vector3(-50, 50, z), Ogre::Vector3::UNIT_X), hit));
+}
+
+TEST(UtilRviz, pickingRaycastWalksNegativeCells) {
+    rviz::PickingIndex picking;
+    rviz::SimpleCar car(sceneManager()), other(sceneManager());
+    car.setPosition(Ogre::Vector3(-45, -45, 0));
+    other.setPosition(Ogre::Vector3(45, 45, 0));
+    picking.insert(&car);
+    picking.insert(&other);
+    const float z = car.getLocalBounds().getCenter().z;
+
+    rviz::PickingIndex::Hit hit;
+    ASSERT_TRUE(picking.raycast(Ogre::Ray(Ogre::Vector3(-100, -45, z), Ogre::Vector3::UNIT_X), hit));
+    EXPECT_EQ(&car, hit.obj);
+    // Diagonally through the origin, stepping into negative cells on both axes
+    ASSERT_TRUE(picking.raycast(Ogre::Ray(Ogre::Vector3(10, 10, z), Ogre::Vector3(-1, -1, 0)), hit));
+    EXPECT_EQ(&car, hit.obj);
+    EXPECT_FALSE(picking.raycast(Ogre::Ray(Ogre::Vector3(-100, -100, z), Ogre::Vector3::NEGATIVE_UNIT_Y), hit));
+}
+
+TEST(UtilRviz, pickingSelectionSpansCells) {
+    rviz::PickingIndex picking;
+    rviz::SimpleCar inside(sceneManager()), insideOtherCell(sceneManager()), hidden(sceneManager());
+    rviz::SimpleCar left(sceneManager()), above(sceneManager());
+    inside.setPosition(Ogre::Vector3(50, -50, 0));
+    insideOtherCell.setPosition(Ogre::Vector3(10, -80, 0));
+    hidden.setPosition(Ogre::Vector3(30, -30, 0));
+    hidden.visible(false);
+    left.setPosition(Ogre::Vector3(-50, -50, 0));
+    above.setPosition(Ogre::Vector3(50, 50, 0));
+    for (rviz::MultiShape* obj : std::vector<rviz::MultiShape*>{&inside, &insideOtherCell, &hidden, &left, &above}) {
+        picking.insert(obj);
+    }
+    // Occupy more cells than the selection covers at the shortest far distance below
+    std::vector<std::unique_ptr<rviz::MultiShape>> crowd;
+    for (int i = 0; i < 60; ++i) {
+        crowd.emplace_back(new rviz::SimpleCar(sceneManager()));
+        crowd.back()->setPosition(Ogre::Vector3(-1000 - 40 * i, 500, 0));
+        picking.insert(crowd.back().get());
+    }
+
+    // Looking down from above, the bottom right quarter of the viewport covers x > 0 and y < 0 on the ground
+    Ogre::Camera* camera = sceneManager()->createCamera("pickingSelectionSpansCells");
+    camera->setPosition(Ogre::Vector3(0, 0, 100));
+    camera->setOrientation(Ogre::Quaternion::IDENTITY);
+    camera->setFOVy(Ogre::Radian(Ogre::Math::HALF_PI));
+    camera->setAspectRatio(1.f);
+    camera->setNearClipDistance(1.f);
+
+    // Walking the occupied cells, looking up the selected cells and testing all cells without a far plane
+    for (float farDistance : {200.f, 101.f, 0.f}) {
+        camera->setFarClipDistance(farDistance);
+        std::vector<rviz::PickingIndex::Hit> hits;
+        picking.querySelection(camera, 0.5f, 0.5f, 1.f, 1.f, hits);
+        std::vector<rviz::MultiShape*> objects;
+        for (const auto& hit : hits) {
+            objects.push_back(hit.obj);
+            EXPECT_GT(hit.distance, 100.f);
+            EXPECT_LT(hit.distance, 150.f);
+        }
+        EXPECT_EQ(sorted({&inside, &insideOtherCell}), sorted(objects)) << farDistance;
+    }
+    sceneManager()->destroyCamera(camera);
+}